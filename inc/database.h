@@ -4,11 +4,40 @@
 #include "otp.h"
 #include <sqlite3.h>
 
+/* Row of the entry list, without the entry which is read by db_select_page() */
+typedef struct db_row {
+  int      id;
+  int      sort;
+  gboolean issuer;
+} db_row_s;
+
+/* Gets the label of an entry, which is only valid during the call */
+typedef void (*db_label_cb)(void *data, int id, const char *label, int length);
+
 int db_init();
+void db_close();
+/* Sets the id of the entry to its new row */
 int db_insert(otp_info_s*);
-int db_select_all(GList**);
-int db_select_id(GList**, int);
+int db_select_all(otp_list_s*);
+/* Appends the db_row_s of every entry in the order of db_select_all() */
+int db_select_rows(GArray*);
+/* Entries with a sort key from low to high, in the order of db_select_all() */
+int db_select_page(otp_list_s*, int, int);
+/* Calls the callback with the label of every entry */
+int db_select_labels(db_label_cb, void*);
+int db_select_id(otp_list_s*, int);
+int db_select_sync(otp_list_s*);
+int db_select_uid(otp_list_s*, uint64_t);
+/* Inserts or, if it is newer, updates the entry with the uid of data. Sets
+ * the id of data to the row written, 0 if only the counter was merged. */
+int db_sync_put(otp_info_s*);
+int db_sync_counter(uint64_t, int);
 int db_delete_id(int);
 int db_inc_counter(int);
+/* Returns the counter to use for the next code, the stored one is advanced */
+int db_reserve_counter(int, int*);
+int db_begin();
+int db_commit();
+int db_rollback();
 
 #endif /* __OTP_DATABASE_H__ */
@@ -0,0 +1,48 @@
+#ifndef __OTP_DB_WORKER_H__
+#define __OTP_DB_WORKER_H__
+
+#include "database.h"
+#include "search_index.h"
+
+/* Asynchronous forms of the db_* calls. Requests are queued to a worker
+ * thread and run in order, their results are delivered on the main loop.
+ * The worker is started by the first request. */
+
+/* Gets the result of a select, the callback owns the list which is freed
+ * with otp_list_free() */
+typedef void (*db_select_cb)(void *data, int ret, otp_list_s *result);
+/* Gets the rows of db_select_rows(), the callback owns the array */
+typedef void (*db_rows_cb)(void *data, int ret, GArray *rows);
+/* Gets an index of the labels of every entry, the callback owns it */
+typedef void (*db_index_cb)(void *data, int ret, search_index_s *index);
+/* Gets the result of a write */
+typedef void (*db_done_cb)(void *data, int ret);
+/* Gets a reserved counter */
+typedef void (*db_counter_cb)(void *data, int ret, int counter);
+/* Work made of several db_* calls, run on the worker */
+typedef int (*db_run_fn)(void *data);
+
+/* Opens the database and brings the schema up to date, requests made
+ * afterwards are run once it is done */
+void db_init_async(db_done_cb done, void *data);
+void db_select_rows_async(db_rows_cb done, void *data);
+void db_select_page_async(int low, int high, db_select_cb done, void *data);
+void db_search_index_async(db_index_cb done, void *data);
+void db_select_id_async(int id, db_select_cb done, void *data);
+/* done may be NULL */
+void db_inc_counter_async(int id, db_done_cb done, void *data);
+void db_reserve_counter_async(int id, db_counter_cb done, void *data);
+void db_delete_id_async(int id, db_done_cb done, void *data);
+/* Runs run(data) on the worker and passes what it returns to done, which
+ * may be NULL. free (may be NULL) releases data once the job is over, also
+ * if its result was dropped. */
+void db_run_async(db_run_fn run, db_done_cb done, void *data, GDestroyNotify free);
+
+/* Drops the pending results of every request made with data, to be called
+ * before data is freed */
+void db_async_cancel(const void *data);
+
+/* Runs the queued requests and stops the worker, before db_close() */
+void db_worker_stop();
+
+#endif /* __OTP_DB_WORKER_H__ */
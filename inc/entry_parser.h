@@ -0,0 +1,49 @@
+#ifndef __OTP_ENTRY_PARSER_H__
+#define __OTP_ENTRY_PARSER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_core.h"
+
+/* Incremental parser for entry messages sent by the companion app.
+ *
+ * A message is a single entry object, an array of entries or a sequence of
+ * entry objects (e.g. one per line). Input can be fed in arbitrary chunks,
+ * nothing is allocated and unknown keys are skipped. Strings are collected
+ * in a fixed buffer which is wiped after every value. */
+
+typedef enum entry_parser_status {
+  ENTRY_PARSER_IDLE,   /* at top level, every entry seen so far is complete */
+  ENTRY_PARSER_MORE,   /* inside an entry or array, more input is needed */
+  ENTRY_PARSER_ERROR   /* syntax error, nothing is parsed until reset */
+} entry_parser_status_e;
+
+/* Called for every complete entry. error is NULL if the entry is valid,
+ * otherwise the reason it was rejected. The entry is cleared afterwards. */
+typedef void (*entry_parser_cb)(void *data, otp_info_s *entry, const char *error);
+
+typedef struct entry_parser {
+  int         state;
+  int         array;
+  int         field;
+  int         depth;
+  int         in_string;
+  int         escape;
+  uint32_t    unicode;
+  uint32_t    surrogate;
+  int         overflow;
+  size_t      len;
+  /* Key, string value or number being read */
+  char        buf[OTP_SECRET_MAX_LEN + 1];
+  const char  *error;
+  otp_info_s  entry;
+  entry_parser_cb cb;
+  void        *data;
+} entry_parser_s;
+
+void entry_parser_init(entry_parser_s *parser, entry_parser_cb cb, void *data);
+/* Drops a partially parsed entry and returns to the top level */
+void entry_parser_reset(entry_parser_s *parser);
+entry_parser_status_e entry_parser_feed(entry_parser_s *parser, const char *data, size_t length);
+
+#endif /* __OTP_ENTRY_PARSER_H__ */
@@ -0,0 +1,23 @@
+#ifndef __OTP_IMPORT_H__
+#define __OTP_IMPORT_H__
+
+#include <glib.h>
+
+/* Messages from the companion app: JSON entries, bulk imports and the
+ * binary frames of the wire format, sync frames included. */
+
+/* Gets the reply to a message: the ack frame of a binary message, the
+ * summary of a JSON bulk import or, for a single JSON entry, the whole
+ * message echoed back. reply is NULL if there is none. changed holds the
+ * otp_info_s, without their key, of the entries added, renamed or deleted
+ * by the message, NULL if there are none. */
+typedef void (*add_entries_cb)(void *data, const gchar *reply, gsize reply_length, const GArray *changed);
+
+/* Feeds a chunk of a message from the companion app, which may be split
+ * across several chunks. Returns TRUE once the message is complete, it is
+ * then stored on the db worker and done gets the reply on the main loop. */
+gboolean add_entries(const char *data, gsize length, add_entries_cb done, void *user_data);
+/* Drops a partially received message */
+void add_entries_reset();
+
+#endif /* __OTP_IMPORT_H__ */
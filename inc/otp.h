@@ -4,6 +4,9 @@
 #include <glib.h>
 #include <Elementary.h>
 #include <efl_extension.h>
+#include "otp_core.h"
+#include "transport.h"
+#include "search_index.h"
 
 #ifdef  LOG_TAG
 #undef  LOG_TAG
@@ -14,31 +17,86 @@
 #define PACKAGE "net.nabam.wearable.otp"
 #endif
 
-typedef enum otp_type {
-  TOTP, HOTP
-} otp_type_e;
+/* TOTP codes of consecutive steps, the code of a step is kept at
+ * codes[step % CODE_RING_SIZE] */
+#define CODE_RING_SIZE 4
 
-typedef struct otp_info {
-  otp_type_e type;
-  char label[255];
-  char alias[255];
-  char secret[255];
-  int  counter;
-  int  id;
-} otp_info_s;
+typedef struct code_ring {
+  time_t              step;
+  int                 count;
+  int                 codes[CODE_RING_SIZE];
+} code_ring_s;
 
 typedef struct code_view_data {
-  int                 seconds;
+  /* Step of the shown TOTP code and the unix time at which it expires */
+  time_t              step;
+  double              deadline;
+  /* Codes of the shown step and the following ones, computed when idle */
+  code_ring_s         codes;
+  Ecore_Idler         *codes_idler;
   Evas_Object         *code_label;
+  Evas_Object         *next_label;
   Evas_Object         *progressbar;
+  /* Fires once at the deadline */
   Ecore_Timer         *timer;
+  /* Moves the ring every frame, or in coarse steps while the screen is dimmed */
+  Ecore_Animator      *animator;
+  Ecore_Timer         *progress_timer;
+  gboolean            dimmed;
   otp_info_s          *entry;
+#ifdef OTP_PROFILE
+  int                 wakeups;
+  double              shown;
+#endif
 } code_view_data_s;
 
-typedef struct menu_data {
+/* The menu reads the entries of MENU_PAGE_SIZE consecutive rows at once,
+ * when the first of them is realized */
+#define MENU_PAGE_SIZE 16
+/* Pages kept after their items were unrealized */
+#define MENU_PAGES_CACHED 8
+
+typedef struct menu_data menu_data_s;
+
+typedef struct menu_page {
+  menu_data_s         *menu;
+  otp_list_s          *entries;
+  gboolean            loading;
+  /* Number of realized items */
+  int                 realized;
+} menu_page_s;
+
+typedef struct menu_item {
+  menu_page_s         *page;
+  /* Set while the entries of the page are loaded */
+  otp_info_s          *entry;
+  Elm_Object_Item     *it;
+} menu_item_s;
+
+struct menu_data {
   Evas_Object         *genlist;
   Evas_Object         *circle_genlist;
-} menu_data_s;
+  /* db_row_s of every entry and an item per row */
+  GArray              *rows;
+  menu_item_s         *items;
+  menu_page_s         *pages;
+  guint               page_count;
+  guint               pages_loaded;
+  /* Loaded pages without realized items, least recently used first */
+  GQueue              idle_pages;
+  /* Page of the entry shown by the code view, which is never dropped */
+  menu_page_s         *selected;
+  /* Styles of the entry items, with and without an issuer */
+  Elm_Genlist_Item_Class *style_1text;
+  Elm_Genlist_Item_Class *style_2text;
+  /* Search over the labels, the index is built after the rows are read */
+  Elm_Object_Item     *search_item;
+  Evas_Object         *search_count;
+  search_index_s      *index;
+  /* Rows are filtered unless query is empty, matches holds the ids found */
+  char                *query;
+  GArray              *matches;
+};
 
 typedef struct appdata {
   Evas_Object         *win;
@@ -46,14 +104,26 @@ typedef struct appdata {
   Eext_Circle_Surface *circle_surface;
   code_view_data_s    *current_cvd;
   menu_data_s         *menu;
+  transport_s         *sap;
+  transport_s         *local;
+  /* Transport of the message being received */
+  transport_s         *receiving;
+  /* The transports are started once both are set, off the first frame */
+  gboolean            db_ready;
+  gboolean            shown;
 } appdata_s;
 
-void get_otp_account(char* item, char *res);
-int get_otp_issuer(char* item, char *res);
-void add_entry(char *);
+#ifdef OTP_PROFILE
+/* Logs the startup trace mark of phase, see util/trace.h */
+void startup_mark(const char *phase);
+#endif
 void code_view_create(appdata_s *ad, otp_info_s *entry);
+void code_view_pause(code_view_data_s *cvd);
 void code_view_resume(code_view_data_s *cvd);
 void menu_create(appdata_s *ad);
 void menu_items_create(appdata_s *ad);
+/* Brings the search over the labels up to date with entries written by
+ * the companion app */
+void menu_entries_changed(appdata_s *ad, const otp_info_s *entries, guint count);
 
 #endif /* __OTP_H__ */
@@ -0,0 +1,127 @@
+#ifndef __OTP_CORE_H__
+#define __OTP_CORE_H__
+
+/* Portable OTP core: only depends on libc and src/util, so it can be built
+ * and exercised outside of the Tizen SDK. */
+
+#include <stdint.h>
+#include <time.h>
+#include "util/hash.h"
+#include "util/hmac.h"
+#include "util/strpool.h"
+
+#define OTP_DEFAULT_PERIOD 30
+#define OTP_DEFAULT_DIGITS 6
+#define OTP_MIN_DIGITS     6
+#define OTP_MAX_DIGITS     10
+#define OTP_MAX_PERIOD     UINT16_MAX
+/* Longest stored label */
+#define OTP_LABEL_MAX_LEN  254
+
+/* Longest accepted base32 secret, it always fits in OTP_KEY_SIZE bytes */
+#define OTP_SECRET_MAX_LEN 256
+#define OTP_KEY_SIZE       160
+
+typedef enum otp_type {
+  TOTP, HOTP
+} otp_type_e;
+
+/* Key material of an entry. Lives in a slot of the secure key arena and is
+ * only reachable through otp_info_s.key, so copies of an entry share it. */
+typedef struct otp_key {
+  uint8_t  bytes[OTP_KEY_SIZE];
+  int      len;
+  /* HMAC key schedule derived from bytes for the algorithm of the entry,
+   * built whenever either is set and only read afterwards */
+  HMAC_CTX hmac;
+} otp_key_s;
+
+/* An entry fits in a cache line. The fields needed for a code come first,
+ * strings are interned and shared by every copy of the entry. */
+typedef struct otp_info {
+  int         id;
+  int         counter;
+  /* Set by otp_set_secret(), released by otp_info_clear() */
+  otp_key_s   *key;
+  otp_type_e  type;
+  /* Set by otp_set_algorithm() once the entry has a key */
+  hash_algo_e algorithm;
+  uint16_t    period;
+  uint8_t     digits;
+  uint8_t     deleted;
+  /* Identity shared with the phone, revision of the content and tombstone */
+  uint32_t    rev;
+  uint64_t    uid;
+  /* Set by otp_set_label(), "issuer:account" labels are split once */
+  const strpool_str_s *label;
+  const strpool_str_s *issuer;
+  const strpool_str_s *account;
+} otp_info_s;
+
+/* Entries in one contiguous block, as read from the database. Pointers to
+ * entries stay valid until the list grows. */
+typedef struct otp_list {
+  otp_info_s *entries;
+  int        count;
+  int        capacity;
+} otp_list_s;
+
+/* Interns len bytes of label and its issuer and account parts. Returns
+ * false if out of memory. */
+int otp_set_label(otp_info_s *entry, const char *label, size_t len);
+/* The strings of an entry, "" if not set. Labels without a colon have no
+ * issuer and are all account. */
+static inline const char *otp_label(const otp_info_s *entry) {
+  return entry->label ? entry->label->data : "";
+}
+static inline size_t otp_label_len(const otp_info_s *entry) {
+  return entry->label ? entry->label->len : 0;
+}
+static inline const char *otp_issuer(const otp_info_s *entry) {
+  return entry->issuer ? entry->issuer->data : "";
+}
+static inline const char *otp_account(const otp_info_s *entry) {
+  return entry->account ? entry->account->data : "";
+}
+
+/* Decodes a base32 secret into the entry's key slot. Returns false and
+ * leaves the entry without a key if the secret is invalid. */
+int otp_set_secret(otp_info_s *entry, const char *secret);
+/* Same for a raw binary key */
+int otp_set_key(otp_info_s *entry, const uint8_t *key, int len);
+/* Sets the hash of the entry and rebuilds its key schedule. Unsupported
+ * algorithms fall back to SHA1. */
+void otp_set_algorithm(otp_info_s *entry, hash_algo_e algorithm);
+/* Encodes the entry's key as base32 into secret, returns the length or -1 */
+int otp_get_secret(const otp_info_s *entry, char *secret, int size);
+/* Releases the key slot of an entry */
+void otp_info_clear(otp_info_s *entry);
+/* otp_info_clear() and free() for heap allocated entries */
+void otp_info_free(void *entry);
+/* Appends a zeroed entry, growing the block geometrically. Returns NULL if
+ * out of memory. */
+otp_info_s *otp_list_add(otp_list_s *list);
+/* Releases the key slots and the block, the list can be reused */
+void otp_list_clear(otp_list_s *list);
+/* otp_list_clear() and free() for heap allocated lists */
+void otp_list_free(otp_list_s *list);
+/* Key schedule of the entry, only read so codes of shared entries can be
+ * computed from several threads */
+const HMAC_CTX *otp_get_hmac(const otp_info_s *entry);
+int otp_digits(const otp_info_s *entry);
+int otp_period(const otp_info_s *entry);
+int otp_compute_code(const HMAC_CTX *hmac, uint64_t value, int digits);
+/* Computes codes[i] for entries[i] at counter or time step values[i] */
+void otp_compute_codes(otp_info_s *const *entries, const uint64_t *values, int *codes, int count);
+int otp_totp_code(otp_info_s *entry, time_t now, int skew, int *expires);
+int otp_hotp_code(otp_info_s *entry, uint64_t counter);
+/* Checks code against the TOTP steps from behind steps before to ahead
+ * steps after now, nearest first. On a match returns 1 and stores the step
+ * offset in *offset (if not NULL). */
+int otp_totp_verify(otp_info_s *entry, int code, time_t now, int behind, int ahead, int *offset);
+/* Checks code against counters counter .. counter + look_ahead. On a match
+ * returns 1 and stores the counter to continue from in *next_counter (if
+ * not NULL), which resynchronizes a HOTP token that ran ahead. */
+int otp_hotp_verify(otp_info_s *entry, int code, uint64_t counter, int look_ahead, uint64_t *next_counter);
+
+#endif /* __OTP_CORE_H__ */
@@ -1,6 +1,9 @@
 #ifndef __OTP_SAP_H__
 #define __OTP_SAP_H__
 
-void initialize_sap();
+#include "transport.h"
+
+/* Accessory protocol connection to the companion app on the phone */
+transport_s *transport_sap_new(const transport_cbs_s *cbs, void *data);
 
 #endif /* __OTP_SAP_H__ */
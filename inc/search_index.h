@@ -0,0 +1,30 @@
+#ifndef __OTP_SEARCH_INDEX_H__
+#define __OTP_SEARCH_INDEX_H__
+
+#include <glib.h>
+
+/* Search over the labels of the entries.
+ *
+ * Labels are split into words at every character which isn't a letter or a
+ * digit, e.g. "Example:alice@mail.example.com" gives "example", "alice",
+ * "mail", "example" and "com". Words are kept sorted, so the words starting
+ * with a prefix are found by a binary search. A query matches the labels
+ * having a word starting with each of its words, ASCII letters are
+ * compared case insensitively. */
+
+typedef struct search_index search_index_s;
+
+search_index_s *search_index_new();
+void search_index_free(search_index_s *index);
+/* Adds the words of the label of entry id */
+gboolean search_index_add(search_index_s *index, int id, const char *label, size_t length);
+/* Drops the words of entry id. Words no label has anymore stay interned
+ * until the index is freed. */
+void search_index_remove(search_index_s *index, int id);
+/* Replaces the words of entry id by those of its new label */
+gboolean search_index_update(search_index_s *index, int id, const char *label, size_t length);
+/* Sets ids to the ascending ids of the entries matching query. An empty
+ * query matches nothing. */
+void search_index_query(search_index_s *index, const char *query, GArray *ids);
+
+#endif /* __OTP_SEARCH_INDEX_H__ */
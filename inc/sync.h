@@ -0,0 +1,68 @@
+#ifndef __OTP_SYNC_H__
+#define __OTP_SYNC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_core.h"
+
+/* Delta sync between the phone and the watch.
+ *
+ * Every entry is identified by its uid and summarised by a digest holding
+ * the revision and a hash of its content. Replicas exchange digests, then
+ * only the entries whose digests differ. Content is merged by taking the
+ * higher revision and HOTP counters by taking the maximum, so counters never
+ * go back. Deleted entries are kept as tombstones with a new revision.
+ *
+ * Records of the sync frames, all integers are big endian:
+ *
+ *   summary  u32 root, u32 number of entries
+ *   digest   u64 uid, u32 revision, u32 hash, u32 counter, u8 flags
+ *   request  u64 uid
+ *   counter  u64 uid, u32 counter */
+
+#define SYNC_SUMMARY_SIZE 8
+#define SYNC_DIGEST_SIZE  21
+#define SYNC_REQUEST_SIZE 8
+#define SYNC_COUNTER_SIZE 12
+
+typedef struct sync_digest {
+  uint64_t uid;
+  uint32_t rev;
+  uint32_t hash;
+  uint32_t counter;
+  uint8_t  deleted;
+} sync_digest_s;
+
+typedef enum sync_action {
+  SYNC_SEND,      /* the remote side lacks the entry or has an older revision */
+  SYNC_FETCH,     /* this side lacks the entry or has an older revision */
+  SYNC_COUNTER    /* both sides have the entry with different counters */
+} sync_action_e;
+
+/* local or remote is NULL if the entry is missing on that side */
+typedef void (*sync_plan_cb)(void *data, sync_action_e action,
+                             const sync_digest_s *local, const sync_digest_s *remote);
+
+void sync_digest(const otp_info_s *entry, sync_digest_s *digest);
+/* Whether content with digest a replaces content with digest b */
+int sync_newer(const sync_digest_s *a, const sync_digest_s *b);
+
+/* Orders digests by uid, which sync_root() and sync_plan() expect */
+void sync_sort(sync_digest_s *digests, size_t count);
+/* Hash over all digests, equal roots mean the replicas are in sync */
+uint32_t sync_root(const sync_digest_s *digests, size_t count);
+/* Calls cb for every difference between two sorted digest lists */
+void sync_plan(const sync_digest_s *local, size_t local_count,
+               const sync_digest_s *remote, size_t remote_count,
+               sync_plan_cb cb, void *data);
+
+void sync_encode_digest(uint8_t *out, const sync_digest_s *digest);
+void sync_decode_digest(const uint8_t *in, sync_digest_s *digest);
+void sync_encode_summary(uint8_t *out, uint32_t root, uint32_t count);
+void sync_decode_summary(const uint8_t *in, uint32_t *root, uint32_t *count);
+void sync_encode_request(uint8_t *out, uint64_t uid);
+uint64_t sync_decode_request(const uint8_t *in);
+void sync_encode_counter(uint8_t *out, uint64_t uid, uint32_t counter);
+void sync_decode_counter(const uint8_t *in, uint64_t *uid, uint32_t *counter);
+
+#endif /* __OTP_SYNC_H__ */
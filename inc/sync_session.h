@@ -0,0 +1,21 @@
+#ifndef __OTP_SYNC_SESSION_H__
+#define __OTP_SYNC_SESSION_H__
+
+#include <glib.h>
+#include "sync.h"
+
+/* The watch side of the sync, backed by the entries table. Replies are
+ * appended to reply as complete frames carrying the sequence number seq.
+ * These block on the database and are run on the db worker. */
+
+/* Answers a summary with the summary of the watch */
+int sync_session_summary(uint16_t seq, GByteArray *reply);
+/* Compares the digests of the phone, in any order, with the watch. Takes over the higher
+ * counters of the phone and replies with the entries the phone is missing,
+ * a request for the entries the watch is missing and the counters which are
+ * higher on the watch. Replies with a summary if nothing differs. */
+int sync_session_digest(const sync_digest_s *remote, guint count, uint16_t seq, GByteArray *reply);
+/* Replies with the entries the phone has requested */
+int sync_session_request(const uint64_t *uids, guint count, uint16_t seq, GByteArray *reply);
+
+#endif /* __OTP_SYNC_SESSION_H__ */
@@ -0,0 +1,54 @@
+#ifndef __OTP_TRANSPORT_H__
+#define __OTP_TRANSPORT_H__
+
+#include <glib.h>
+
+/* A channel to the companion app. Each backend delivers whole payloads as
+ * they arrive and sends replies on the connection the payload came from. */
+
+typedef struct transport transport_s;
+
+/* Events reported by a transport to its owner */
+typedef struct transport_cbs {
+  void (*connected)(transport_s *transport, void *data);
+  void (*received)(transport_s *transport, const char *buffer, unsigned int length, void *data);
+  void (*terminated)(transport_s *transport, void *data);
+} transport_cbs_s;
+
+typedef struct transport_ops {
+  const char *name;
+  /* Starts accepting connections, connection attempts may be retried later */
+  gboolean (*start)(transport_s *transport);
+  gboolean (*send)(transport_s *transport, const void *buffer, unsigned int length);
+  /* Terminates the connection and releases the backend */
+  void (*stop)(transport_s *transport);
+} transport_ops_s;
+
+struct transport {
+  const transport_ops_s *ops;
+  transport_cbs_s       cbs;
+  void                  *data;
+  void                  *priv;
+};
+
+/* Listens on a unix domain socket at path, one SOCK_SEQPACKET message per
+ * payload. Used to feed the app from a host while testing, see sap.h for
+ * the backend used on the device. */
+transport_s *transport_unix_new(const char *path, const transport_cbs_s *cbs, void *data);
+
+static inline gboolean transport_start(transport_s *transport) {
+  return transport->ops->start(transport);
+}
+
+static inline gboolean transport_send(transport_s *transport, const void *buffer, unsigned int length) {
+  return transport->ops->send(transport, buffer, length);
+}
+
+static inline void transport_free(transport_s *transport) {
+  if (transport == NULL) return;
+
+  transport->ops->stop(transport);
+  g_free(transport);
+}
+
+#endif /* __OTP_TRANSPORT_H__ */
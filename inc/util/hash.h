@@ -0,0 +1,47 @@
+// Hash backend interface used by HMAC
+//
+// Every supported digest is described by a hash_backend_s with its block
+// and digest sizes and init/update/final operations on a HASH_INFO state.
+
+#ifndef HASH_H__
+#define HASH_H__
+
+#include <stdint.h>
+#include "util/sha1.h"
+#include "util/sha256.h"
+#include "util/sha512.h"
+
+#define HASH_MAX_BLOCKSIZE     SHA512_BLOCKSIZE
+#define HASH_MAX_DIGEST_LENGTH SHA512_DIGEST_LENGTH
+
+typedef enum hash_algo {
+  HASH_SHA1,
+  HASH_SHA256,
+  HASH_SHA512,
+  HASH_ALGO_COUNT
+} hash_algo_e;
+
+typedef union {
+  SHA1_INFO   sha1;
+  SHA256_INFO sha256;
+  SHA512_INFO sha512;
+} HASH_INFO;
+
+typedef struct {
+  const char  *name;
+  hash_algo_e algo;
+  int         block_size;
+  int         digest_length;
+  void        (*init)(HASH_INFO *info);
+  void        (*update)(HASH_INFO *info, const uint8_t *buffer, int count);
+  void        (*final)(HASH_INFO *info, uint8_t *digest);
+} hash_backend_s;
+
+// Returns the backend for algo, or NULL if algo is out of range.
+const hash_backend_s *hash_backend(hash_algo_e algo)
+  __attribute__((visibility("hidden")));
+// Looks an algorithm up by its RFC 6238 name ("SHA1", "SHA256", "SHA512"),
+// case insensitively. Returns -1 if the name is unknown.
+int hash_algo_from_name(const char *name) __attribute__((visibility("hidden")));
+
+#endif
@@ -19,6 +19,36 @@
 #define _HMAC_H_
 
 #include <stdint.h>
+#include "util/hash.h"
+
+// Precomputed HMAC key schedule: hash states after absorbing the inner and
+// outer padded key blocks. Computing a MAC from it only costs the
+// compression of the message and of the inner digest.
+typedef struct {
+  const hash_backend_s *hash;
+  HASH_INFO            inner;
+  HASH_INFO            outer;
+} HMAC_CTX;
+
+// Returns 0 if algo has no hash backend.
+int hmac_init(HMAC_CTX *ctx, hash_algo_e algo,
+              const uint8_t *key, int keyLength)
+ __attribute__((visibility("hidden")));
+// Writes at most resultLength bytes of the MAC, zero padding the rest.
+void hmac_compute(const HMAC_CTX *ctx,
+                  const uint8_t *data, int dataLength,
+                  uint8_t *result, int resultLength)
+ __attribute__((visibility("hidden")));
+// Computes count HMAC-SHA1 values of 8 byte big endian counters, one key
+// state per message, several messages at once in SIMD lanes. Returns the
+// RFC 4226 dynamic truncation (31 bits) of every MAC instead of the MAC.
+// All contexts must have been initialized for HASH_SHA1.
+void hmac_sha1_batch_truncated(const HMAC_CTX *const *ctx,
+                               const uint64_t *counters,
+                               uint32_t *truncated, int count)
+ __attribute__((visibility("hidden")));
+// Number of lanes hmac_sha1_batch_truncated() uses on this CPU.
+int hmac_sha1_batch_lanes(void) __attribute__((visibility("hidden")));
 
 void hmac_sha1(const uint8_t *key, int keyLength,
                const uint8_t *data, int dataLength,
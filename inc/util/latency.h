@@ -0,0 +1,37 @@
+// Latency histograms for profiling builds
+//
+// Samples are counted in power of two buckets of microseconds, bucket i
+// holds samples below 2^i us. A histogram has a single writer.
+
+#ifndef LATENCY_H__
+#define LATENCY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 24
+
+typedef struct latency_hist {
+  const char *name;
+  uint32_t   buckets[LATENCY_BUCKETS];
+  uint32_t   count;
+  uint64_t   total_us;
+  uint64_t   max_us;
+} latency_hist_s;
+
+#define LATENCY_HIST_INIT(name) { (name), { 0 }, 0, 0, 0 }
+
+// Monotonic clock in microseconds.
+int64_t latency_now_us(void) __attribute__((visibility("hidden")));
+// Adds a sample of us microseconds.
+void latency_record(latency_hist_s *hist, int64_t us)
+  __attribute__((visibility("hidden")));
+// Adds the time elapsed since start, as returned by latency_now_us().
+void latency_record_since(latency_hist_s *hist, int64_t start)
+  __attribute__((visibility("hidden")));
+// Formats the count, mean, maximum and the non-empty buckets into a line
+// such as "name: n=12 mean=80us max=1500us <128us:10 <2048us:2".
+size_t latency_format(const latency_hist_s *hist, char *out, size_t size)
+  __attribute__((visibility("hidden")));
+
+#endif  // LATENCY_H__
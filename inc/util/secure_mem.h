@@ -0,0 +1,43 @@
+// Storage for key material
+//
+// A secure arena hands out fixed size slots carved from anonymous pages
+// which are locked in memory (best effort) and excluded from core dumps.
+// Slots are zeroed when handed out and wiped when returned.
+
+#ifndef SECURE_MEM_H__
+#define SECURE_MEM_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct secure_chunk secure_chunk_s;
+
+typedef struct secure_arena {
+  size_t          slot_size;
+  secure_chunk_s  *chunks;
+  void            *free_list;
+  pthread_mutex_t lock;
+} secure_arena_s;
+
+#define SECURE_ARENA_INIT(size) { (size), NULL, NULL, PTHREAD_MUTEX_INITIALIZER }
+
+// Returns a zeroed slot of arena->slot_size bytes, or NULL if out of memory.
+void *secure_arena_alloc(secure_arena_s *arena)
+  __attribute__((visibility("hidden")));
+// Wipes slot and gives it back to the arena. slot may be NULL.
+void secure_arena_free(secure_arena_s *arena, void *slot)
+  __attribute__((visibility("hidden")));
+// Unmaps every chunk, all slots must have been freed.
+void secure_arena_destroy(secure_arena_s *arena)
+  __attribute__((visibility("hidden")));
+
+// memset() that the compiler can't drop as a dead store.
+void secure_wipe(void *buf, size_t len) __attribute__((visibility("hidden")));
+// Compares two integers without branching on their value.
+static inline int secure_equal_u32(uint32_t a, uint32_t b) {
+  uint32_t diff = a ^ b;
+  return (int) (1 & ((diff - 1) >> 31) & ~(diff >> 31));
+}
+
+#endif
@@ -18,6 +18,7 @@
 #ifndef SHA1_H__
 #define SHA1_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define SHA1_BLOCKSIZE     64
@@ -30,6 +31,46 @@ typedef struct {
   int      local;
 } SHA1_INFO;
 
+// Compression backends. Each one processes a run of contiguous 64 byte
+// blocks and updates the five word chaining state in place.
+typedef void (*sha1_compress_fn)(uint32_t digest[5], const uint8_t *data,
+                                 size_t blocks);
+
+typedef struct {
+  const char       *name;
+  sha1_compress_fn compress;
+  int              (*supported)(void);
+} sha1_backend_s;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA1_HAVE_X86
+void sha1_compress_shani(uint32_t digest[5], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+int sha1_shani_supported(void) __attribute__((visibility("hidden")));
+void sha1_compress_ssse3(uint32_t digest[5], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+int sha1_ssse3_supported(void) __attribute__((visibility("hidden")));
+#endif
+
+#if (defined(__aarch64__) || defined(__arm__)) && defined(__ARM_FEATURE_CRYPTO)
+#define SHA1_HAVE_ARMV8
+void sha1_compress_armv8(uint32_t digest[5], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+int sha1_armv8_supported(void) __attribute__((visibility("hidden")));
+#endif
+
+void sha1_compress_generic(uint32_t digest[5], const uint8_t *data,
+                           size_t blocks)
+  __attribute__((visibility("hidden")));
+
+// Compresses blocks with the fastest backend supported by the running CPU.
+void sha1_compress(uint32_t digest[5], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+const char *sha1_backend_name(void) __attribute__((visibility("hidden")));
+// Forces a backend by name, returns 0 if it is unknown or unsupported. Not
+// synchronized with sha1_compress(), call it before hashing on other threads.
+int sha1_backend_select(const char *name) __attribute__((visibility("hidden")));
+
 void sha1_init(SHA1_INFO *sha1_info) __attribute__((visibility("hidden")));
 void sha1_update(SHA1_INFO *sha1_info, const uint8_t *buffer, int count)
   __attribute__((visibility("hidden")));
@@ -0,0 +1,54 @@
+// SHA-256 header file
+
+#ifndef SHA256_H__
+#define SHA256_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCKSIZE     64
+#define SHA256_DIGEST_LENGTH 32
+
+typedef struct {
+  uint32_t digest[8];
+  uint64_t count;
+  uint8_t  data[SHA256_BLOCKSIZE];
+  int      local;
+} SHA256_INFO;
+
+typedef void (*sha256_compress_fn)(uint32_t digest[8], const uint8_t *data,
+                                   size_t blocks);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_HAVE_X86
+void sha256_compress_shani(uint32_t digest[8], const uint8_t *data,
+                           size_t blocks)
+  __attribute__((visibility("hidden")));
+int sha256_shani_supported(void) __attribute__((visibility("hidden")));
+#endif
+
+#if (defined(__aarch64__) || defined(__arm__)) && defined(__ARM_FEATURE_CRYPTO)
+#define SHA256_HAVE_ARMV8
+void sha256_compress_armv8(uint32_t digest[8], const uint8_t *data,
+                           size_t blocks)
+  __attribute__((visibility("hidden")));
+int sha256_armv8_supported(void) __attribute__((visibility("hidden")));
+#endif
+
+extern const uint32_t sha256_k[64] __attribute__((visibility("hidden")));
+
+void sha256_compress_generic(uint32_t digest[8], const uint8_t *data,
+                             size_t blocks)
+  __attribute__((visibility("hidden")));
+// Compresses blocks with the fastest backend supported by the running CPU.
+void sha256_compress(uint32_t digest[8], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+const char *sha256_backend_name(void) __attribute__((visibility("hidden")));
+
+void sha256_init(SHA256_INFO *sha256_info) __attribute__((visibility("hidden")));
+void sha256_update(SHA256_INFO *sha256_info, const uint8_t *buffer, int count)
+  __attribute__((visibility("hidden")));
+void sha256_final(SHA256_INFO *sha256_info, uint8_t digest[32])
+  __attribute__((visibility("hidden")));
+
+#endif
@@ -0,0 +1,28 @@
+// SHA-512 header file
+
+#ifndef SHA512_H__
+#define SHA512_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA512_BLOCKSIZE     128
+#define SHA512_DIGEST_LENGTH 64
+
+typedef struct {
+  uint64_t digest[8];
+  uint64_t count_lo, count_hi;
+  uint8_t  data[SHA512_BLOCKSIZE];
+  int      local;
+} SHA512_INFO;
+
+void sha512_compress(uint64_t digest[8], const uint8_t *data, size_t blocks)
+  __attribute__((visibility("hidden")));
+
+void sha512_init(SHA512_INFO *sha512_info) __attribute__((visibility("hidden")));
+void sha512_update(SHA512_INFO *sha512_info, const uint8_t *buffer, int count)
+  __attribute__((visibility("hidden")));
+void sha512_final(SHA512_INFO *sha512_info, uint8_t digest[64])
+  __attribute__((visibility("hidden")));
+
+#endif
@@ -0,0 +1,41 @@
+// Interned strings
+//
+// A string pool keeps one copy of every distinct string it is given.
+// Strings are length prefixed and NUL terminated, they are stored in
+// chunks and stay valid until the pool is destroyed, so equal strings can
+// be compared by pointer. The pool is thread safe.
+
+#ifndef STRPOOL_H__
+#define STRPOOL_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRPOOL_MAX_LEN UINT16_MAX
+
+typedef struct strpool_str {
+  uint16_t len;
+  char     data[];
+} strpool_str_s;
+
+typedef struct strpool_chunk strpool_chunk_s;
+
+typedef struct strpool {
+  strpool_str_s   **slots;
+  size_t          capacity;
+  size_t          count;
+  strpool_chunk_s *chunks;
+  pthread_mutex_t lock;
+} strpool_s;
+
+#define STRPOOL_INIT { NULL, 0, 0, NULL, PTHREAD_MUTEX_INITIALIZER }
+
+// Returns the pooled copy of the len bytes at s, or NULL if out of memory.
+// Strings longer than STRPOOL_MAX_LEN are truncated.
+const strpool_str_s *strpool_intern(strpool_s *pool, const char *s, size_t len)
+  __attribute__((visibility("hidden")));
+// Frees every string of the pool.
+void strpool_destroy(strpool_s *pool) __attribute__((visibility("hidden")));
+
+#endif  // STRPOOL_H__
@@ -0,0 +1,23 @@
+// Startup trace for profiling builds
+//
+// Phases of the startup are marked with the time elapsed since the process
+// was started, as read from /proc/self/stat to the clock tick when
+// trace_start() is called.
+// A mark is formatted as one line of JSON such as
+//   {"trace":"startup","phase":"db ready","us":48211}
+// so the phases can be picked out of the log by a script. Marks may be
+// made from any thread.
+
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stddef.h>
+
+// Takes the start of the process as the origin of the marks, falls back to
+// the time of the call if it can't be read.
+void trace_start(void) __attribute__((visibility("hidden")));
+// Formats the mark of phase into out, returns the length as snprintf().
+size_t trace_mark(const char *phase, char *out, size_t size)
+  __attribute__((visibility("hidden")));
+
+#endif  // TRACE_H__
@@ -0,0 +1,119 @@
+#ifndef __OTP_WIRE_H__
+#define __OTP_WIRE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_core.h"
+#include "entry_parser.h"
+
+/* Binary framing used by the companion app instead of JSON.
+ *
+ * Every frame starts with a fixed header, all integers are big endian:
+ *
+ *   0  magic   "OT"
+ *   2  u8      version
+ *   3  u8      type (wire_type_e)
+ *   4  u16     sequence number, echoed by the ack
+ *   6  u32     payload length
+ *   10 u32     CRC32 of the payload
+ *
+ * An entries frame carries a sequence of records:
+ *
+ *   0  u8      type (otp_type_e)
+ *   1  u8      algorithm (hash_algo_e)
+ *   2  u8      digits, 0 for the default
+ *   3  u8      flags (WIRE_FLAG_*)
+ *   4  u16     period, 0 for the default
+ *   6  u32     counter
+ *   10 u64     uid, version 2 only
+ *   18 u32     revision, version 2 only
+ *   .. u8      label length, followed by the label
+ *   .. u8      key length, followed by the raw key
+ *
+ * An ack frame carries the u32 number of records, the u32 number of stored
+ * records and a wire_status_e byte per record. The sync frames carry fixed
+ * size records, see sync.h. */
+
+#define WIRE_MAGIC_0         'O'
+#define WIRE_MAGIC_1         'T'
+#define WIRE_VERSION         2
+#define WIRE_HEADER_SIZE     14
+#define WIRE_RECORD_FIXED_V1 11
+#define WIRE_RECORD_FIXED    23
+#define WIRE_RECORD_MAX      (WIRE_RECORD_FIXED + 255 + 1 + 255)
+#define WIRE_MAX_PAYLOAD     (1 << 20)
+
+/* The entry is a tombstone */
+#define WIRE_FLAG_DELETED 0x01
+
+typedef enum wire_type {
+  WIRE_ENTRIES      = 1,
+  WIRE_ACK          = 2,
+  WIRE_SYNC_SUMMARY = 3,
+  WIRE_SYNC_DIGEST  = 4,
+  WIRE_SYNC_REQUEST = 5,
+  WIRE_SYNC_COUNTER = 6,
+  WIRE_TYPE_COUNT
+} wire_type_e;
+
+typedef enum wire_status {
+  WIRE_STATUS_OK,
+  WIRE_STATUS_INVALID,    /* the record was rejected */
+  WIRE_STATUS_DATABASE,   /* the record couldn't be stored */
+  WIRE_STATUS_CORRUPT     /* the frame failed its CRC, nothing was stored */
+} wire_status_e;
+
+typedef struct wire_header {
+  uint8_t  version;
+  uint8_t  type;
+  uint16_t seq;
+  uint32_t length;
+  uint32_t crc;
+} wire_header_s;
+
+typedef enum wire_decoder_status {
+  WIRE_DECODER_IDLE,   /* a whole frame has been read, see crc_ok */
+  WIRE_DECODER_MORE,   /* more input is needed */
+  WIRE_DECODER_ERROR   /* malformed frame, nothing is decoded until reset */
+} wire_decoder_status_e;
+
+/* Called for every record of a frame which isn't an entries frame */
+typedef void (*wire_record_cb)(void *data, wire_type_e type, const uint8_t *record, size_t length);
+
+/* Decodes frames fed in arbitrary chunks. Records are passed to the callbacks
+ * as soon as they are complete, so the CRC is only known once the whole
+ * frame has been read and the caller has to be able to undo them. */
+typedef struct wire_decoder {
+  int             state;
+  size_t          have;
+  size_t          need;
+  uint32_t        remaining;
+  uint32_t        crc;
+  int             crc_ok;
+  wire_header_s   header;
+  uint8_t         buf[WIRE_RECORD_MAX];
+  otp_info_s      entry;
+  entry_parser_cb cb;
+  wire_record_cb  record_cb;
+  void            *data;
+} wire_decoder_s;
+
+uint32_t wire_crc32(uint32_t crc, const void *data, size_t length);
+
+void wire_write_header(uint8_t *out, const wire_header_s *header);
+/* Returns false if the magic or version don't match */
+int wire_read_header(const uint8_t *in, wire_header_s *header);
+
+/* Encode into out and return the number of bytes written, 0 if it doesn't fit */
+size_t wire_encode_entry(uint8_t *out, size_t size, const otp_info_s *entry);
+size_t wire_encode_ack(uint8_t *out, size_t size, const wire_header_s *request,
+                       const uint8_t *status, uint32_t count);
+/* Fills in the header of a frame whose payload follows it in out */
+void wire_seal(uint8_t *out, wire_type_e type, uint16_t seq, size_t length);
+
+void wire_decoder_init(wire_decoder_s *decoder, entry_parser_cb cb, wire_record_cb record_cb, void *data);
+void wire_decoder_reset(wire_decoder_s *decoder);
+/* Stops after a complete frame, consumed is set to the number of bytes used */
+wire_decoder_status_e wire_decoder_feed(wire_decoder_s *decoder, const uint8_t *data, size_t length, size_t *consumed);
+
+#endif /* __OTP_WIRE_H__ */
@@ -1,126 +1,233 @@
 #include <app.h>
 #include <dlog.h>
 #include <system_info.h>
-#include "util/base32.h"
-#include "util/hmac.h"
-#include "util/sha1.h"
+#include <device/callback.h>
+#include <device/display.h>
 #include "otp.h"
-#include "database.h"
-
-#define TOTP_STEP_SIZE 30
+#include "db_worker.h"
+#include "util/secure_mem.h"
+#ifdef OTP_PROFILE
+#include "util/latency.h"
+#endif
 
 #define NAME_LABEL "<font font_weight=Regular font_size=30><align=center>%s</align></font>"
-#define CODE_LABEL "<font font_weight=Regular font_size=75>%06d</font>"
+#define CODE_LABEL "<font font_weight=Regular font_size=75>%0*d</font>"
+#define NEXT_LABEL "<font font_weight=Regular font_size=24>next %0*d</font>"
 
-static uint8_t *_get_shared_secret(const char *secret_string, int *secretLen) {
-  if (!secret_string) {
-    return NULL;
-  }
-  // Decode secret key
-  const int base32Len = strlen(secret_string);
-  *secretLen = (base32Len*5 + 7)/8;
-  uint8_t *secret = malloc(base32Len + 1);
-  if (secret == NULL) {
-    *secretLen = 0;
-    return NULL;
-  }
-  memcpy(secret, secret_string, base32Len);
-  secret[base32Len] = '\000';
+/* Seconds before the boundary from which the next code is shown */
+#define NEXT_CODE_LEAD 5
+
+/* Ring updates per period while the screen is dimmed */
+#define PROGRESS_DIMMED_STEPS 6
+/* Ecore timers run on the monotonic clock, the deadline timer is armed a bit
+ * late so it doesn't fire before the wall clock crossed the boundary */
+#define DEADLINE_SLACK 0.002
+
+#ifdef OTP_PROFILE
+/* Delay from the step boundary to the new code being set */
+static latency_hist_s totp_rollover = LATENCY_HIST_INIT("totp rollover");
+#endif
+
+static void hotp_counter_cb(void *data, int ret, int counter) {
+  code_view_data_s *cvd = data;
+  otp_info_s *entry = cvd->entry;
+  char code[255];
 
-  if ((*secretLen = base32_decode(secret, secret, base32Len)) < 1) {
-    memset(secret, 0, base32Len);
-    free(secret);
-    return NULL;
+  if (ret != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "can't reserve counter of entry %d", entry->id);
+    return;
   }
-  memset(secret + *secretLen, 0, base32Len + 1 - *secretLen);
 
-  return secret;
+  entry->counter = counter + 1;
+  snprintf(code, 255, CODE_LABEL, otp_digits(entry), otp_hotp_code(entry, counter));
+  elm_object_text_set(cvd->code_label, code);
+}
+
+static void progress_update(code_view_data_s *cvd) {
+  double remaining = cvd->deadline - ecore_time_unix_get();
+
+  if (remaining < 0) remaining = 0;
+  eext_circle_object_value_set(cvd->progressbar, remaining);
 }
 
-static int _compute_code(const uint8_t *secret, int secretLen, unsigned long value) {
-  uint8_t val[8];
-  for (int i = 8; i--; value >>= 8) {
-    val[i] = value;
+static void totp_refresh(code_view_data_s *cvd);
+
+static Eina_Bool progress_update_cb(void *data) {
+  code_view_data_s *cvd = data;
+  const double remaining = cvd->deadline - ecore_time_unix_get();
+
+#ifdef OTP_PROFILE
+  cvd->wakeups++;
+#endif
+  /* The wall clock was set, the deadline timer doesn't follow it */
+  if (remaining < -1.0 || remaining > otp_period(cvd->entry))
+    totp_refresh(cvd);
+  progress_update(cvd);
+
+  return ECORE_CALLBACK_RENEW;
+}
+
+/* Animates the progress ring smoothly while the screen is on, a dimmed
+ * screen only gets a few steps per period */
+static void progress_start(code_view_data_s *cvd) {
+  if (cvd->animator) {
+    ecore_animator_del(cvd->animator);
+    cvd->animator = NULL;
   }
-  uint8_t hash[SHA1_DIGEST_LENGTH];
-  hmac_sha1(secret, secretLen, val, 8, hash, SHA1_DIGEST_LENGTH);
-  memset(val, 0, sizeof(val));
-  const int offset = hash[SHA1_DIGEST_LENGTH - 1] & 0xF;
-  unsigned int truncatedHash = 0;
-  for (int i = 0; i < 4; ++i) {
-    truncatedHash <<= 8;
-    truncatedHash  |= hash[offset + i];
+  if (cvd->progress_timer) {
+    ecore_timer_del(cvd->progress_timer);
+    cvd->progress_timer = NULL;
+  }
+
+  progress_update(cvd);
+  if (cvd->dimmed) {
+    cvd->progress_timer = ecore_timer_add((double) otp_period(cvd->entry) / PROGRESS_DIMMED_STEPS, progress_update_cb, cvd);
+  } else {
+    cvd->animator = ecore_animator_add(progress_update_cb, cvd);
   }
-  memset(hash, 0, sizeof(hash));
-  truncatedHash &= 0x7FFFFFFF;
-  truncatedHash %= 1000000;
-  return truncatedHash;
 }
 
-static int _totp_get_code(const char *secret, int skew, int *expires) {
-  const int tm = time(NULL);
-  int len;
-  *expires = TOTP_STEP_SIZE - tm % TOTP_STEP_SIZE;
-  return _compute_code(_get_shared_secret(secret, &len), len, (tm / TOTP_STEP_SIZE) + skew);
+/* Computes the code following the last one of the ring */
+static void codes_fill(code_view_data_s *cvd) {
+  code_ring_s *ring = &cvd->codes;
+  const time_t step = ring->step + ring->count;
+
+  ring->codes[step % CODE_RING_SIZE] = otp_totp_code(cvd->entry, step * otp_period(cvd->entry), 0, NULL);
+  ring->count++;
 }
 
-static int _hotp_get_code(const char *secret, int counter) {
-  int len;
-  return _compute_code(_get_shared_secret(secret, &len), len, counter);
+static Eina_Bool codes_fill_cb(void *data) {
+  code_view_data_s *cvd = data;
+
+  codes_fill(cvd);
+  if (cvd->codes.count < CODE_RING_SIZE)
+    return ECORE_CALLBACK_RENEW;
+
+  cvd->codes_idler = NULL;
+  return ECORE_CALLBACK_CANCEL;
 }
 
-static Eina_Bool code_view_pop_cb(void *data, Elm_Object_Item *it)
-{
-  appdata_s *ad = (appdata_s *) data;
-  code_view_data_s *cvd = ad->current_cvd;
-  if (cvd) {
-    ad->current_cvd = NULL;
-    if (cvd->timer) ecore_timer_del(cvd->timer);
-    if (cvd->progressbar) evas_object_hide(cvd->progressbar);
-    free(cvd);
+/* Returns the code of step, it is only computed here if the ring is behind,
+ * e.g. when the view was paused for longer than the ring covers */
+static int codes_get(code_view_data_s *cvd, time_t step) {
+  code_ring_s *ring = &cvd->codes;
+
+  if (step < ring->step || step >= ring->step + CODE_RING_SIZE) {
+    ring->step = step;
+    ring->count = 0;
+  }
+  while (step >= ring->step + ring->count) {
+    codes_fill(cvd);
   }
 
-  eext_rotary_object_event_activated_set(ad->menu->circle_genlist, EINA_TRUE);
-  return EINA_TRUE;
+  return ring->codes[step % CODE_RING_SIZE];
 }
 
-static void refresh_entry(code_view_data_s *cvd) {
-  GList *entry = NULL;
-  if(db_select_id(&entry, cvd->entry->id) == SQLITE_OK) {
-    memcpy(cvd->entry, entry->data, sizeof(otp_info_s));
-    g_list_free_full(entry, free);
+/* Drops the codes of the steps before step and tops the ring up when idle */
+static void codes_advance(code_view_data_s *cvd, time_t step) {
+  code_ring_s *ring = &cvd->codes;
+
+  if (step >= ring->step + ring->count) {
+    ring->count = 0;
+  } else if (step > ring->step) {
+    ring->count -= step - ring->step;
   }
+  ring->step = step;
+
+  if (cvd->codes_idler == NULL && ring->count < CODE_RING_SIZE)
+    cvd->codes_idler = ecore_idler_add(codes_fill_cb, cvd);
 }
 
-static void refresh_code(code_view_data_s *cvd) {
-  int expires = 0;
+static Eina_Bool totp_deadline_cb(void *data);
+
+/* Shows the code of the current step, and the code of the next one close to
+ * the boundary. The timer is armed for whichever of them comes next. */
+static void totp_refresh(code_view_data_s *cvd) {
   char code[255];
-  otp_info_s *entry = (otp_info_s *) (cvd->entry);
+  otp_info_s *entry = cvd->entry;
+  const double now = ecore_time_unix_get();
+  const time_t period = otp_period(entry);
+  const time_t step = (time_t) now / period;
+  double at;
+
+  if (step != cvd->step) {
+    cvd->step = step;
+    cvd->deadline = (double) ((step + 1) * period);
+    codes_advance(cvd, step);
+
+    snprintf(code, 255, CODE_LABEL, otp_digits(entry), codes_get(cvd, step));
+    elm_object_text_set(cvd->code_label, code);
+    elm_object_text_set(cvd->next_label, "");
+  }
 
-  if (cvd->entry->type == TOTP) {
-    if (entry != NULL) {
-      snprintf(code, 255, CODE_LABEL, _totp_get_code(entry->secret, 0, &expires));
-      elm_object_text_set(cvd->code_label, code);
-    }
-    cvd->seconds = expires;
+  if (cvd->deadline - now > NEXT_CODE_LEAD) {
+    at = cvd->deadline - NEXT_CODE_LEAD;
   } else {
-    refresh_entry(cvd);
-    snprintf(code, 255, CODE_LABEL, _hotp_get_code(entry->secret, entry->counter++));
-    db_inc_counter(cvd->entry->id);
-    elm_object_text_set(cvd->code_label, code);
+    snprintf(code, 255, NEXT_LABEL, otp_digits(entry), codes_get(cvd, step + 1));
+    elm_object_text_set(cvd->next_label, code);
+    at = cvd->deadline + DEADLINE_SLACK;
   }
+
+  if (cvd->timer) ecore_timer_del(cvd->timer);
+  cvd->timer = ecore_timer_add(at - now, totp_deadline_cb, cvd);
 }
 
-static Eina_Bool refresh_view_totp_cb(void *data) {
+static Eina_Bool totp_deadline_cb(void *data) {
   code_view_data_s *cvd = data;
+#ifdef OTP_PROFILE
+  const double deadline = cvd->deadline;
+
+  cvd->wakeups++;
+#endif
+
+  cvd->timer = NULL;
+  totp_refresh(cvd);
+
+#ifdef OTP_PROFILE
+  if (cvd->deadline > deadline)
+    latency_record(&totp_rollover, (ecore_time_unix_get() - deadline) * 1e6);
+#endif
+
+  /* The progress of a dimmed screen may be a step behind the new period */
+  if (cvd->progress_timer) progress_update(cvd);
+
+  return ECORE_CALLBACK_CANCEL;
+}
 
-  if (--cvd->seconds < 1) {
-    refresh_code(cvd);
+static void totp_stop(code_view_data_s *cvd) {
+  if (cvd->timer) {
+    ecore_timer_del(cvd->timer);
+    cvd->timer = NULL;
+  }
+  if (cvd->animator) {
+    ecore_animator_del(cvd->animator);
+    cvd->animator = NULL;
+  }
+  if (cvd->progress_timer) {
+    ecore_timer_del(cvd->progress_timer);
+    cvd->progress_timer = NULL;
   }
+  if (cvd->codes_idler) {
+    ecore_idler_del(cvd->codes_idler);
+    cvd->codes_idler = NULL;
+  }
+}
 
-  eext_circle_object_value_set(cvd->progressbar, cvd->seconds);
+static void display_state_cb(device_callback_e type, void *value, void *data) {
+  code_view_data_s *cvd = data;
+  const display_state_e state = (display_state_e) (intptr_t) value;
 
-  return ECORE_CALLBACK_RENEW;
+  cvd->dimmed = state != DISPLAY_STATE_NORMAL;
+  if (cvd->timer) progress_start(cvd);
+}
+
+static void refresh_code(code_view_data_s *cvd) {
+  if (cvd->entry->type == TOTP) {
+    totp_refresh(cvd);
+  } else {
+    /* The code is shown once the next counter is stored */
+    db_reserve_counter_async(cvd->entry->id, hotp_counter_cb, cvd);
+  }
 }
 
 static void renew_button_cb(void *data, Evas_Object *obj, void *event_info)
@@ -129,6 +236,38 @@ static void renew_button_cb(void *data, Evas_Object *obj, void *event_info)
 	return;
 }
 
+static Eina_Bool code_view_pop_cb(void *data, Elm_Object_Item *it)
+{
+  appdata_s *ad = (appdata_s *) data;
+  code_view_data_s *cvd = ad->current_cvd;
+  if (cvd) {
+    ad->current_cvd = NULL;
+    db_async_cancel(cvd);
+    totp_stop(cvd);
+    if (cvd->entry->type == TOTP)
+      device_remove_callback(DEVICE_CALLBACK_DISPLAY_STATE, display_state_cb);
+    if (cvd->progressbar) evas_object_hide(cvd->progressbar);
+#ifdef OTP_PROFILE
+    if (cvd->entry->type == TOTP) {
+      char stats[256];
+      const double shown = ecore_time_get() - cvd->shown;
+      dlog_print(DLOG_INFO, LOG_TAG, "code view: %d wakeups in %.1fs, %.1f per minute",
+                 cvd->wakeups, shown, shown > 0 ? cvd->wakeups * 60 / shown : 0);
+      latency_format(&totp_rollover, stats, sizeof(stats));
+      dlog_print(DLOG_INFO, LOG_TAG, "%s", stats);
+    }
+#endif
+    secure_wipe(&cvd->codes, sizeof(cvd->codes));
+    free(cvd);
+  }
+
+  /* The page of the entry can be released again */
+  ad->menu->selected = NULL;
+
+  eext_rotary_object_event_activated_set(ad->menu->circle_genlist, EINA_TRUE);
+  return EINA_TRUE;
+}
+
 void code_view_create(appdata_s *ad, otp_info_s *entry)
 {
   code_view_data_s *cvd = calloc(1, sizeof(code_view_data_s));
@@ -159,15 +298,14 @@ void code_view_create(appdata_s *ad, otp_info_s *entry)
   elm_object_style_set(name_label, "slide_bounce");
   elm_label_slide_duration_set(name_label, 2);
 
-  char label[255], issuer[255], account[255];
-  get_otp_account(cvd->entry->label, account);
-  if (get_otp_issuer(cvd->entry->label, issuer)) {
+  char label[255];
+  if (cvd->entry->issuer != NULL) {
     char res[255];
-    snprintf(res, 255, "%s<br/>%s", issuer, account);
+    snprintf(res, 255, "%s<br/>%s", otp_issuer(cvd->entry), otp_account(cvd->entry));
     snprintf(label, 255, NAME_LABEL, res);
     elm_box_align_set(box, EVAS_HINT_FILL, 0.3);
   } else {
-    snprintf(label, 255, NAME_LABEL, account);
+    snprintf(label, 255, NAME_LABEL, otp_account(cvd->entry));
     elm_box_align_set(box, EVAS_HINT_FILL, 0.4);
   }
 
@@ -181,20 +319,36 @@ void code_view_create(appdata_s *ad, otp_info_s *entry)
   evas_object_size_hint_align_set(cvd->code_label, 0.5, 0.5);
   evas_object_size_hint_weight_set(cvd->code_label, 0, 0);
 
+  if (cvd->entry->type == TOTP) {
+    /* Next code label, filled close to the boundary */
+    cvd->next_label = elm_label_add(box);
+    evas_object_size_hint_align_set(cvd->next_label, 0.5, 0.5);
+    evas_object_size_hint_weight_set(cvd->next_label, 0, 0);
+  }
+
   refresh_code(cvd);
   evas_object_show(cvd->code_label);
   elm_box_pack_end(box, cvd->code_label);
+  if (cvd->next_label) {
+    evas_object_show(cvd->next_label);
+    elm_box_pack_end(box, cvd->next_label);
+  }
 
   if (cvd->entry->type == TOTP) {
     /* Progress */
     cvd->progressbar = eext_circle_object_progressbar_add(layout, ad->circle_surface);
-    eext_circle_object_value_min_max_set(cvd->progressbar, 0, TOTP_STEP_SIZE);
-    eext_circle_object_value_set(cvd->progressbar, cvd->seconds);
+    eext_circle_object_value_min_max_set(cvd->progressbar, 0, otp_period(cvd->entry));
 
-    evas_object_show(cvd->progressbar);
+    display_state_e state;
+    if (device_display_get_state(&state) == DEVICE_ERROR_NONE)
+      cvd->dimmed = state != DISPLAY_STATE_NORMAL;
+    device_add_callback(DEVICE_CALLBACK_DISPLAY_STATE, display_state_cb, cvd);
 
-    /* Schedule update */
-    cvd->timer = ecore_timer_add(1.0f, refresh_view_totp_cb, cvd);
+#ifdef OTP_PROFILE
+    cvd->shown = ecore_time_get();
+#endif
+    progress_start(cvd);
+    evas_object_show(cvd->progressbar);
   } else {
     Evas_Object *button = elm_button_add(layout);
     elm_object_text_set(button, "renew");
@@ -208,11 +362,18 @@ void code_view_create(appdata_s *ad, otp_info_s *entry)
   elm_naviframe_item_pop_cb_set(nf_it, code_view_pop_cb, ad);
 }
 
+void code_view_pause(code_view_data_s *cvd) {
+  if (cvd == NULL) return;
+
+  totp_stop(cvd);
+}
+
 void code_view_resume(code_view_data_s *cvd) {
   if (cvd == NULL) return;
 
   if (cvd->entry->type == TOTP) {
-    refresh_code(cvd);
-    eext_circle_object_value_set(cvd->progressbar, cvd->seconds);
+    totp_refresh(cvd);
+    codes_advance(cvd, cvd->step);
+    progress_start(cvd);
   }
 }
@@ -5,6 +5,9 @@
 #include <dlog.h>
 #include "database.h"
 #include "otp.h"
+#include "sync.h"
+#include "util/secure_mem.h"
+#include "util/latency.h"
 
 #define DB_NAME        "otp.db"
 #define DB_TABLE_NAME  "entries"
@@ -13,8 +16,147 @@
 #define DB_COL_LABEL   "LABEL"
 #define DB_COL_COUNTER "COUNTER"
 #define DB_COL_SECRET  "SECRET"
+#define DB_COL_ALGO    "ALGORITHM"
+#define DB_COL_DIGITS  "DIGITS"
+#define DB_COL_PERIOD  "PERIOD"
+#define DB_COL_UID     "UID"
+#define DB_COL_REV     "REV"
+#define DB_COL_DELETED "DELETED"
+#define DB_COL_ISSUER  "ISSUER"
+#define DB_COL_SORT    "SORT_ORDER"
 #define DB_LOG_TAG     "SQLITE:"
 
+/* Negative cache size is in KiB */
+#define DB_CACHE_KIB   512
+#define DB_MMAP_SIZE   (4 * 1024 * 1024)
+
+/* Version of the schema in PRAGMA user_version, see db_migrations */
+#define DB_VERSION     2
+/* Rows copied per transaction when a table is rebuilt */
+#define DB_MIGRATE_BATCH 500
+
+#define DB_COLUMNS DB_COL_TYPE", "DB_COL_LABEL", "DB_COL_COUNTER", "DB_COL_SECRET", "DB_COL_ID", "DB_COL_ALGO", "DB_COL_DIGITS", "DB_COL_PERIOD", "DB_COL_UID", "DB_COL_REV", "DB_COL_DELETED
+
+/* Parameters ?1 to ?10 are bound by _db_bind_entry() */
+#define DB_ENTRY_VALUES "?1, ?2, ?3, ?4, NULL, ?5, ?6, ?7, COALESCE(NULLIF(?8, 0), random()), ?9, ?10"
+
+/* Issuer part of a label in "issuer:account" form */
+#define DB_ISSUER(label) "CASE WHEN instr("label", ':') > 0 THEN substr("label", 1, instr("label", ':') - 1) ELSE '' END"
+
+#define DB_CREATE_TABLE(name) "CREATE TABLE IF NOT EXISTS "name" \
+               ("DB_COL_TYPE"    INTEGER NOT NULL, \
+                "DB_COL_LABEL"   TEXT    NOT NULL, \
+                "DB_COL_COUNTER" INTEGER NOT NULL, \
+                "DB_COL_SECRET"  TEXT    NOT NULL, \
+                "DB_COL_ID"      INTEGER PRIMARY KEY AUTOINCREMENT, \
+                "DB_COL_ALGO"    INTEGER NOT NULL DEFAULT 0, \
+                "DB_COL_DIGITS"  INTEGER NOT NULL DEFAULT 6, \
+                "DB_COL_PERIOD"  INTEGER NOT NULL DEFAULT 30, \
+                "DB_COL_UID"     INTEGER NOT NULL DEFAULT 0, \
+                "DB_COL_REV"     INTEGER NOT NULL DEFAULT 0, \
+                "DB_COL_DELETED" INTEGER NOT NULL DEFAULT 0, \
+                "DB_COL_ISSUER"  TEXT    NOT NULL DEFAULT '', \
+                "DB_COL_SORT"    INTEGER NOT NULL DEFAULT 0);"
+
+#define DB_CREATE_INDEXES \
+  "CREATE UNIQUE INDEX IF NOT EXISTS "DB_TABLE_NAME"_uid ON "DB_TABLE_NAME"("DB_COL_UID"); \
+   CREATE INDEX IF NOT EXISTS "DB_TABLE_NAME"_sort ON "DB_TABLE_NAME"("DB_COL_SORT");"
+
+typedef enum db_stmt {
+  DB_STMT_INSERT,
+  DB_STMT_SELECT_ALL,
+  DB_STMT_SELECT_ROWS,
+  DB_STMT_SELECT_PAGE,
+  DB_STMT_SELECT_LABELS,
+  DB_STMT_SELECT_ID,
+  DB_STMT_SELECT_SYNC,
+  DB_STMT_SELECT_UID,
+  DB_STMT_INC_COUNTER,
+  DB_STMT_SELECT_COUNTER,
+  DB_STMT_DELETE_ID,
+  DB_STMT_SYNC_UPDATE,
+  DB_STMT_SYNC_COUNTER,
+  DB_STMT_BEGIN,
+  DB_STMT_BEGIN_IMMEDIATE,
+  DB_STMT_COMMIT,
+  DB_STMT_ROLLBACK,
+  DB_STMT_SYNC_FULL,
+  DB_STMT_SYNC_NORMAL,
+  DB_STMT_COUNT
+} db_stmt_e;
+
+static const char *db_stmt_sql[DB_STMT_COUNT] = {
+  /* New entries go on top of the list */
+  [DB_STMT_INSERT]      = "INSERT INTO "DB_TABLE_NAME" ("DB_COLUMNS", "DB_COL_ISSUER", "DB_COL_SORT") \
+                           VALUES("DB_ENTRY_VALUES", "DB_ISSUER("?2")", \
+                           (SELECT IFNULL(MAX("DB_COL_SORT"), 0) + 1 FROM "DB_TABLE_NAME"));",
+  [DB_STMT_SELECT_ALL]  = "SELECT "DB_COLUMNS" FROM "DB_TABLE_NAME" WHERE "DB_COL_DELETED"=0 ORDER BY "DB_COL_SORT" DESC;",
+  [DB_STMT_SELECT_ROWS] = "SELECT "DB_COL_ID", "DB_COL_SORT", "DB_COL_ISSUER"<>'' FROM "DB_TABLE_NAME" \
+                           WHERE "DB_COL_DELETED"=0 ORDER BY "DB_COL_SORT" DESC;",
+  [DB_STMT_SELECT_PAGE] = "SELECT "DB_COLUMNS" FROM "DB_TABLE_NAME" WHERE "DB_COL_DELETED"=0 \
+                           AND "DB_COL_SORT" BETWEEN ?1 AND ?2 ORDER BY "DB_COL_SORT" DESC;",
+  [DB_STMT_SELECT_LABELS] = "SELECT "DB_COL_ID", "DB_COL_LABEL" FROM "DB_TABLE_NAME" WHERE "DB_COL_DELETED"=0;",
+  [DB_STMT_SELECT_ID]   = "SELECT "DB_COLUMNS" FROM "DB_TABLE_NAME" WHERE "DB_COL_ID"=?;",
+  [DB_STMT_SELECT_SYNC] = "SELECT "DB_COLUMNS" FROM "DB_TABLE_NAME";",
+  [DB_STMT_SELECT_UID]  = "SELECT "DB_COLUMNS" FROM "DB_TABLE_NAME" WHERE "DB_COL_UID"=?;",
+  [DB_STMT_INC_COUNTER] = "UPDATE "DB_TABLE_NAME" SET "DB_COL_COUNTER" = "DB_COL_COUNTER" + 1 WHERE "DB_COL_ID"=?;",
+  [DB_STMT_SELECT_COUNTER] = "SELECT "DB_COL_COUNTER" FROM "DB_TABLE_NAME" WHERE "DB_COL_ID"=? AND "DB_COL_DELETED"=0;",
+  /* Deleted entries stay behind as tombstones for the sync */
+  [DB_STMT_DELETE_ID]   = "UPDATE "DB_TABLE_NAME" SET "DB_COL_DELETED"=1, "DB_COL_LABEL"='', "DB_COL_ISSUER"='', "DB_COL_SECRET"='', \
+                           "DB_COL_REV"="DB_COL_REV" + 1 WHERE "DB_COL_ID"=?;",
+  [DB_STMT_SYNC_UPDATE] = "UPDATE "DB_TABLE_NAME" SET "DB_COL_TYPE"=?1, "DB_COL_LABEL"=?2, "DB_COL_ISSUER"="DB_ISSUER("?2")", \
+                           "DB_COL_COUNTER"=MAX("DB_COL_COUNTER", ?3), "DB_COL_SECRET"=?4, "DB_COL_ALGO"=?5, \
+                           "DB_COL_DIGITS"=?6, "DB_COL_PERIOD"=?7, "DB_COL_REV"=?9, "DB_COL_DELETED"=?10 \
+                           WHERE "DB_COL_UID"=?8;",
+  [DB_STMT_SYNC_COUNTER] = "UPDATE "DB_TABLE_NAME" SET "DB_COL_COUNTER"=MAX("DB_COL_COUNTER", ?) WHERE "DB_COL_UID"=?;",
+  [DB_STMT_BEGIN]       = "BEGIN;",
+  [DB_STMT_BEGIN_IMMEDIATE] = "BEGIN IMMEDIATE;",
+  [DB_STMT_COMMIT]      = "COMMIT;",
+  [DB_STMT_ROLLBACK]    = "ROLLBACK;",
+  /* NORMAL may lose the last commits on power loss, counters are synced */
+  [DB_STMT_SYNC_FULL]   = "PRAGMA synchronous=FULL;",
+  [DB_STMT_SYNC_NORMAL] = "PRAGMA synchronous=NORMAL;",
+};
+
+/* Connection is opened once by db_init() and kept until db_close(),
+ * statements are prepared on first use and reused afterwards. The
+ * connection is shared with the worker thread of db_worker.c, every public
+ * call holds the lock and an open transaction holds it until it ends. */
+typedef struct db_ctx {
+  sqlite3      *handle;
+  sqlite3_stmt *stmts[DB_STMT_COUNT];
+  GRecMutex    lock;
+  gboolean     transaction;
+} db_ctx_s;
+
+static db_ctx_s db_ctx = { 0 };
+
+#ifdef OTP_PROFILE
+/* Time the main loop spends waiting for the database */
+static latency_hist_s db_stall = LATENCY_HIST_INIT("db main loop stall");
+#endif
+
+static int64_t _db_enter(void)
+{
+  int64_t start = 0;
+
+#ifdef OTP_PROFILE
+  if (eina_main_loop_is())
+    start = latency_now_us();
+#endif
+  g_rec_mutex_lock(&db_ctx.lock);
+
+  return start;
+}
+
+static void _db_leave(int64_t start)
+{
+#ifdef OTP_PROFILE
+  if (start)
+    latency_record_since(&db_stall, start);
+#endif
+  g_rec_mutex_unlock(&db_ctx.lock);
+}
 
 static int _db_open(sqlite3 **otp_db)
 {
@@ -35,204 +177,821 @@ static int _db_open(sqlite3 **otp_db)
   return ret;
 }
 
-int db_init()
+static sqlite3_stmt *_db_stmt(db_stmt_e id)
 {
-  sqlite3 *otp_db;
+  if (db_ctx.handle == NULL) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" database is not initialized");
+    return NULL;
+  }
+
+  if (db_ctx.stmts[id] == NULL) {
+    int ret = sqlite3_prepare_v2(db_ctx.handle, db_stmt_sql[id], -1, &db_ctx.stmts[id], NULL);
+    if (ret != SQLITE_OK) {
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" can't prepare statement: %s", sqlite3_errmsg(db_ctx.handle));
+      db_ctx.stmts[id] = NULL;
+    }
+  }
+
+  return db_ctx.stmts[id];
+}
+
+static void _db_stmt_release(sqlite3_stmt *stmt)
+{
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
+/* Runs a statement which doesn't return rows, the statement is released afterwards */
+static int _db_stmt_exec(sqlite3_stmt *stmt, const char *name)
+{
+  int ret = sqlite3_step(stmt);
+  if (ret != SQLITE_DONE) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" %s query failed: %s", name, sqlite3_errmsg(db_ctx.handle));
+    _db_stmt_release(stmt);
 
-  if(_db_open(&otp_db) != SQLITE_OK)
     return SQLITE_ERROR;
+  }
+
+  _db_stmt_release(stmt);
+
+  return SQLITE_OK;
+}
+
+static int _db_exec(db_stmt_e id, const char *name)
+{
+  sqlite3_stmt *stmt = _db_stmt(id);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  return _db_stmt_exec(stmt, name);
+}
+
+/* Adds a column to tables created by older versions, if it's missing */
+static int _db_add_column(sqlite3 *otp_db, const char *column, const char *definition)
+{
+  sqlite3_stmt *stmt;
+  int found = 0;
+
+  if (sqlite3_prepare_v2(otp_db, "PRAGMA table_info("DB_TABLE_NAME");", -1, &stmt, NULL) != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" table info query failed: %s", sqlite3_errmsg(otp_db));
+    return SQLITE_ERROR;
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *name = (const char *) sqlite3_column_text(stmt, 1);
+    if (name && strcmp(name, column) == 0) {
+      found = 1;
+      break;
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  if (found)
+    return SQLITE_OK;
 
-  int ret;
   char *err_msg;
-  char *sql = "CREATE TABLE IF NOT EXISTS "DB_TABLE_NAME" \
-               ("DB_COL_TYPE"    INTEGER NOT NULL, \
-                "DB_COL_LABEL"    TEXT    NOT NULL, \
-                "DB_COL_COUNTER" INTEGET NOT NULL, \
-                "DB_COL_SECRET"  TEXT    NOT NULL, \
-                "DB_COL_ID"      INTEGER PRIMARY KEY AUTOINCREMENT);";
+  char *sql = sqlite3_mprintf("ALTER TABLE "DB_TABLE_NAME" ADD COLUMN %s %s;", column, definition);
 
-  ret = sqlite3_exec(otp_db, sql, NULL, 0, &err_msg);
-  if(ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" create table query failed: %s", err_msg);
+  int ret = sqlite3_exec(otp_db, sql, NULL, 0, &err_msg);
+  sqlite3_free(sql);
+  if (ret != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" add column query failed: %s", err_msg);
     sqlite3_free(err_msg);
-    sqlite3_close(otp_db);
 
     return SQLITE_ERROR;
   }
-  sqlite3_close(otp_db);
 
   return SQLITE_OK;
 }
 
-static int _insert_cb(void *unused, int count, char **data, char **columns){
-  // TODO: refresh callback
-  return 0;
+static int _db_run(sqlite3 *otp_db, const char *sql, const char *name)
+{
+  char *err_msg;
+
+  int ret = sqlite3_exec(otp_db, sql, NULL, NULL, &err_msg);
+  if (ret != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" %s query failed: %s", name, err_msg);
+    sqlite3_free(err_msg);
+
+    return SQLITE_ERROR;
+  }
+
+  return SQLITE_OK;
 }
 
-int db_insert(otp_info_s *data)
+static int _db_get_int(sqlite3 *otp_db, const char *sql, int *value)
 {
-  sqlite3 *otp_db;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(otp_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" query failed: %s", sqlite3_errmsg(otp_db));
+    return SQLITE_ERROR;
+  }
+
+  *value = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+  sqlite3_finalize(stmt);
+
+  return SQLITE_OK;
+}
+
+/* Version 1: tables created before the schema was versioned got their
+ * columns one by one, entries stored before the sync get a uid */
+static int _db_migrate_columns(sqlite3 *otp_db)
+{
+  if (_db_run(otp_db, "BEGIN;", "begin") != SQLITE_OK)
+    return SQLITE_ERROR;
 
-  if(_db_open(&otp_db) != SQLITE_OK)
+  if (_db_add_column(otp_db, DB_COL_ALGO, "INTEGER NOT NULL DEFAULT 0") != SQLITE_OK ||
+      _db_add_column(otp_db, DB_COL_DIGITS, "INTEGER NOT NULL DEFAULT 6") != SQLITE_OK ||
+      _db_add_column(otp_db, DB_COL_PERIOD, "INTEGER NOT NULL DEFAULT 30") != SQLITE_OK ||
+      _db_add_column(otp_db, DB_COL_UID, "INTEGER NOT NULL DEFAULT 0") != SQLITE_OK ||
+      _db_add_column(otp_db, DB_COL_REV, "INTEGER NOT NULL DEFAULT 0") != SQLITE_OK ||
+      _db_add_column(otp_db, DB_COL_DELETED, "INTEGER NOT NULL DEFAULT 0") != SQLITE_OK ||
+      _db_run(otp_db, "UPDATE "DB_TABLE_NAME" SET "DB_COL_UID"=random() WHERE "DB_COL_UID"=0; \
+                       PRAGMA user_version=1; \
+                       COMMIT;", "uid") != SQLITE_OK) {
+    _db_run(otp_db, "ROLLBACK;", "rollback");
     return SQLITE_ERROR;
+  }
 
-  char *err_msg, *sql;
+  return SQLITE_OK;
+}
+
+/* Version 2: rebuilds the table with the right column types and the issuer
+ * and sort order columns. Rows are copied in batches into entries_new, an
+ * interrupted copy resumes after the last copied id. */
+static int _db_migrate_rebuild(sqlite3 *otp_db)
+{
+  sqlite3_stmt *copy;
   int ret;
 
-  sql = sqlite3_mprintf(
-      "INSERT INTO "DB_TABLE_NAME" VALUES(%d, %Q, %d, %Q, NULL);",
-      data->type, data->label, data->counter, data->secret);
+  if (_db_run(otp_db, DB_CREATE_TABLE(DB_TABLE_NAME"_new"), "create table") != SQLITE_OK)
+    return SQLITE_ERROR;
 
-  ret = sqlite3_exec(otp_db, sql, _insert_cb, 0, &err_msg);
+  ret = sqlite3_prepare_v2(otp_db, "INSERT INTO "DB_TABLE_NAME"_new ("DB_COLUMNS", "DB_COL_ISSUER", "DB_COL_SORT") \
+                                    SELECT "DB_COLUMNS", "DB_ISSUER(DB_COL_LABEL)", "DB_COL_ID" FROM "DB_TABLE_NAME" \
+                                    WHERE "DB_COL_ID" > (SELECT IFNULL(MAX("DB_COL_ID"), 0) FROM "DB_TABLE_NAME"_new) \
+                                    ORDER BY "DB_COL_ID" LIMIT ?;", -1, &copy, NULL);
+  if (ret != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" can't prepare copy: %s", sqlite3_errmsg(otp_db));
+    return SQLITE_ERROR;
+  }
+  sqlite3_bind_int(copy, 1, DB_MIGRATE_BATCH);
+
+  do {
+    if (_db_run(otp_db, "BEGIN;", "begin") != SQLITE_OK) {
+      ret = SQLITE_ERROR;
+      break;
+    }
+
+    ret = sqlite3_step(copy);
+    sqlite3_reset(copy);
+    if (ret != SQLITE_DONE) {
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" copy failed: %s", sqlite3_errmsg(otp_db));
+      _db_run(otp_db, "ROLLBACK;", "rollback");
+      ret = SQLITE_ERROR;
+      break;
+    }
+
+    ret = _db_run(otp_db, "COMMIT;", "commit");
+  } while (ret == SQLITE_OK && sqlite3_changes(otp_db) == DB_MIGRATE_BATCH);
+
+  sqlite3_finalize(copy);
   if (ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" insert query failed: %s", sqlite3_errmsg(otp_db));
-    sqlite3_free(err_msg);
+    return SQLITE_ERROR;
+
+  /* Ids are never reused, the new table continues the old sequence */
+  if (_db_run(otp_db, "BEGIN; \
+                       UPDATE sqlite_sequence SET seq=(SELECT MAX(seq) FROM sqlite_sequence \
+                         WHERE name IN ('"DB_TABLE_NAME"', '"DB_TABLE_NAME"_new')) \
+                         WHERE name='"DB_TABLE_NAME"_new'; \
+                       DROP TABLE "DB_TABLE_NAME"; \
+                       ALTER TABLE "DB_TABLE_NAME"_new RENAME TO "DB_TABLE_NAME"; "
+                       DB_CREATE_INDEXES " \
+                       PRAGMA user_version=2; \
+                       COMMIT;", "swap table") != SQLITE_OK) {
+    _db_run(otp_db, "ROLLBACK;", "rollback");
+    return SQLITE_ERROR;
+  }
+
+  return SQLITE_OK;
+}
+
+typedef struct db_migration {
+  int        version;
+  const char *name;
+  int        (*run)(sqlite3 *otp_db);
+} db_migration_s;
+
+/* Each migration sets user_version in its last transaction */
+static const db_migration_s db_migrations[] = {
+  { 1, "columns", _db_migrate_columns },
+  { 2, "rebuild", _db_migrate_rebuild },
+};
+
+/* Brings the schema to DB_VERSION, new databases get it right away */
+static int _db_migrate(sqlite3 *otp_db)
+{
+  int version, exists;
+
+  if (_db_get_int(otp_db, "PRAGMA user_version;", &version) != SQLITE_OK ||
+      _db_get_int(otp_db, "SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='"DB_TABLE_NAME"';",
+                  &exists) != SQLITE_OK)
+    return SQLITE_ERROR;
+
+  if (!exists) {
+    char *sql = sqlite3_mprintf("BEGIN; %s %s PRAGMA user_version=%d; COMMIT;",
+                                DB_CREATE_TABLE(DB_TABLE_NAME), DB_CREATE_INDEXES, DB_VERSION);
+    int ret = _db_run(otp_db, sql, "create table");
     sqlite3_free(sql);
-    sqlite3_close(otp_db);
 
+    if (ret != SQLITE_OK)
+      _db_run(otp_db, "ROLLBACK;", "rollback");
+
+    return ret;
+  }
+
+  if (version > DB_VERSION) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" schema version %d is newer than %d", version, DB_VERSION);
     return SQLITE_ERROR;
   }
 
-  sqlite3_free(sql);
-  sqlite3_close(otp_db);
+  for (size_t i = 0; i < sizeof(db_migrations) / sizeof(db_migrations[0]); i++) {
+    const db_migration_s *migration = &db_migrations[i];
+
+    if (migration->version <= version)
+      continue;
+
+    const int64_t start = latency_now_us();
+    if (migration->run(otp_db) != SQLITE_OK) {
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" migration %d (%s) failed", migration->version, migration->name);
+      return SQLITE_ERROR;
+    }
+    dlog_print(DLOG_INFO, LOG_TAG, DB_LOG_TAG" migrated to %d (%s) in %lld us", migration->version, migration->name,
+               (long long) (latency_now_us() - start));
+  }
 
   return SQLITE_OK;
 }
 
-static int _select_cb(void *list, int count, char **data, char **columns){
-  GList **head = (GList **) list;
-  otp_info_s *temp = (otp_info_s*) malloc(sizeof(otp_info_s));
-  memset(temp, 0, sizeof(otp_info_s));
+static int _db_journal_mode_cb(void *data, int columns, char **values, char **names)
+{
+  if (columns > 0 && values[0] && strcmp(values[0], "wal") != 0)
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" journal mode is %s instead of wal", values[0]);
+
+  return 0;
+}
+
+/* Readers don't block the writer in WAL mode and commits only append to
+ * the log, which is synced at checkpoints */
+static int _db_configure(sqlite3 *otp_db)
+{
+  char *err_msg;
+  char *sql = sqlite3_mprintf("PRAGMA synchronous=NORMAL; \
+                               PRAGMA cache_size=-%d; \
+                               PRAGMA mmap_size=%d;", DB_CACHE_KIB, DB_MMAP_SIZE);
+
+  int ret = sqlite3_exec(otp_db, "PRAGMA journal_mode=WAL;", _db_journal_mode_cb, NULL, &err_msg);
+  if (ret == SQLITE_OK) {
+    ret = sqlite3_exec(otp_db, sql, NULL, NULL, &err_msg);
+  }
+  sqlite3_free(sql);
+
+  if (ret != SQLITE_OK) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" configuration failed: %s", err_msg);
+    sqlite3_free(err_msg);
 
-  if (temp == NULL){
-    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" can't allocate memory for otp_info_s");
     return SQLITE_ERROR;
-  } else {
-            temp->type   = atoi(data[0]);
-    strncpy(temp->label,        data[1], 254);
-           temp->counter = atoi(data[2]);
-    strncpy(temp->secret,       data[3], 254);
-            temp->id     = atoi(data[4]);
   }
 
-  *head = g_list_append(*head, temp);
   return SQLITE_OK;
 }
 
-int db_select_all(GList** result)
+static int _db_init()
 {
+  if (db_ctx.handle != NULL)
+    return SQLITE_OK;
+
   sqlite3 *otp_db;
 
-  if(_db_open(&otp_db) != SQLITE_OK)
+  if(_db_open(&otp_db) != SQLITE_OK) {
+    sqlite3_close(otp_db);
     return SQLITE_ERROR;
+  }
 
-  char *sql = "SELECT * FROM "DB_TABLE_NAME" ORDER BY ID DESC";
-  int ret;
-  char *err_msg;
+  if (_db_configure(otp_db) != SQLITE_OK) {
+    sqlite3_close(otp_db);
+    return SQLITE_ERROR;
+  }
 
-  ret = sqlite3_exec(otp_db, sql, _select_cb, (void *) result, &err_msg);
-  if (ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_DEBUG, LOG_TAG, DB_LOG_TAG" select query failed: %s", err_msg);
-    sqlite3_free(err_msg);
+  if (_db_migrate(otp_db) != SQLITE_OK) {
     sqlite3_close(otp_db);
+    return SQLITE_ERROR;
+  }
 
+  db_ctx.handle = otp_db;
+
+  return SQLITE_OK;
+}
+
+/* Calls made meanwhile from other threads wait for the schema */
+int db_init()
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_init();
+  _db_leave(start);
+
+  return ret;
+}
+
+void db_close()
+{
+#ifdef OTP_PROFILE
+  char stats[256];
+  latency_format(&db_stall, stats, sizeof(stats));
+  dlog_print(DLOG_INFO, LOG_TAG, DB_LOG_TAG" %s", stats);
+#endif
+
+  g_rec_mutex_lock(&db_ctx.lock);
+  for (int i = 0; i < DB_STMT_COUNT; i++) {
+    sqlite3_finalize(db_ctx.stmts[i]);
+    db_ctx.stmts[i] = NULL;
+  }
+
+  sqlite3_close(db_ctx.handle);
+  db_ctx.handle = NULL;
+  g_rec_mutex_unlock(&db_ctx.lock);
+}
+
+/* Binds the columns of an entry as DB_ENTRY_VALUES expects them */
+static int _db_bind_entry(sqlite3_stmt *stmt, const otp_info_s *data)
+{
+  char secret[OTP_SECRET_MAX_LEN + 1] = "";
+
+  /* Tombstones have no secret */
+  if (!data->deleted && otp_get_secret(data, secret, sizeof(secret)) < 1) {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" refusing to store entry with invalid secret");
     return SQLITE_ERROR;
   }
 
-  sqlite3_close(otp_db);
+  sqlite3_bind_int  (stmt, 1, data->type);
+  sqlite3_bind_text (stmt, 2, data->deleted ? "" : otp_label(data), -1, SQLITE_STATIC);
+  sqlite3_bind_int  (stmt, 3, data->counter);
+  sqlite3_bind_text (stmt, 4, secret, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_int  (stmt, 5, data->algorithm);
+  sqlite3_bind_int  (stmt, 6, otp_digits(data));
+  sqlite3_bind_int  (stmt, 7, otp_period(data));
+  sqlite3_bind_int64(stmt, 8, (sqlite3_int64) data->uid);
+  sqlite3_bind_int64(stmt, 9, data->rev);
+  sqlite3_bind_int  (stmt, 10, data->deleted != 0);
+  secure_wipe(secret, sizeof(secret));
 
   return SQLITE_OK;
 }
 
-int db_select_id(GList** result, int id)
+static int _db_insert(otp_info_s *data)
 {
-  sqlite3 *otp_db;
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_INSERT);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
 
-  if(_db_open(&otp_db) != SQLITE_OK)
+  if (_db_bind_entry(stmt, data) != SQLITE_OK) {
+    _db_stmt_release(stmt);
     return SQLITE_ERROR;
+  }
 
-  char *sql = sqlite3_mprintf("SELECT * FROM "DB_TABLE_NAME" where "DB_COL_ID"=%d;", id);
+  const int ret = _db_stmt_exec(stmt, "insert");
+  if (ret == SQLITE_OK)
+    data->id = (int) sqlite3_last_insert_rowid(db_ctx.handle);
 
+  return ret;
+}
+
+/* Appends the rows to list, columns are read in place from the statement */
+static int _db_select(sqlite3_stmt *stmt, otp_list_s *list)
+{
   int ret;
-  char *err_msg;
 
-  ret = sqlite3_exec(otp_db, sql, _select_cb, (void *) result, &err_msg);
-  if (ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_DEBUG, LOG_TAG, DB_LOG_TAG" select query failed: %s", err_msg);
-    sqlite3_free(err_msg);
-    sqlite3_close(otp_db);
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+    otp_info_s *temp = otp_list_add(list);
+
+    if (temp == NULL) {
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" can't allocate memory for otp_info_s");
+      _db_stmt_release(stmt);
+
+      return SQLITE_ERROR;
+    }
+
+    const char *label  = (const char *) sqlite3_column_text(stmt, 1);
+    const int label_len = label ? sqlite3_column_bytes(stmt, 1) : 0;
+    const char *secret = (const char *) sqlite3_column_text(stmt, 3);
+
+            temp->type   = sqlite3_column_int(stmt, 0);
+           temp->counter = sqlite3_column_int(stmt, 2);
+            temp->id     = sqlite3_column_int(stmt, 4);
+         temp->algorithm = sqlite3_column_int(stmt, 5);
+            temp->digits = sqlite3_column_int(stmt, 6);
+            temp->period = sqlite3_column_int(stmt, 7);
+               temp->uid = (uint64_t) sqlite3_column_int64(stmt, 8);
+               temp->rev = (uint32_t) sqlite3_column_int64(stmt, 9);
+           temp->deleted = sqlite3_column_int(stmt, 10);
+
+    if (!otp_set_label(temp, label ? label : "", label_len))
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" can't allocate label of entry %d", temp->id);
+
+    if (!temp->deleted && !otp_set_secret(temp, secret))
+      dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" entry %d has invalid secret", temp->id);
+  }
+
+  if (ret != SQLITE_DONE) {
+    dlog_print(DLOG_DEBUG, LOG_TAG, DB_LOG_TAG" select query failed: %s", sqlite3_errmsg(db_ctx.handle));
+    _db_stmt_release(stmt);
 
     return SQLITE_ERROR;
   }
 
-  sqlite3_close(otp_db);
+  _db_stmt_release(stmt);
 
   return SQLITE_OK;
 }
 
-static int _delete_cb(void *list, int count, char **data, char **columns){
-  // TODO: refresh interface callback
-  return 0;
+static int _db_select_all(otp_list_s *result)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_ALL);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  return _db_select(stmt, result);
 }
 
-int db_inc_counter(int id)
+static int _db_select_rows(GArray *rows)
 {
-  sqlite3 *otp_db;
+  int ret;
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_ROWS);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const db_row_s row = {
+      .id     = sqlite3_column_int(stmt, 0),
+      .sort   = sqlite3_column_int(stmt, 1),
+      .issuer = sqlite3_column_int(stmt, 2) != 0
+    };
+    g_array_append_val(rows, row);
+  }
+
+  if (ret != SQLITE_DONE) {
+    dlog_print(DLOG_DEBUG, LOG_TAG, DB_LOG_TAG" select query failed: %s", sqlite3_errmsg(db_ctx.handle));
+    _db_stmt_release(stmt);
 
-  if(_db_open(&otp_db) != SQLITE_OK)
     return SQLITE_ERROR;
+  }
 
-  char *sql = sqlite3_mprintf("UPDATE "DB_TABLE_NAME" SET "DB_COL_COUNTER" = "DB_COL_COUNTER" + 1 where "DB_COL_ID"=%d;", id);
+  _db_stmt_release(stmt);
 
-  int counter = 0, ret = 0;
-  char *err_msg;
+  return SQLITE_OK;
+}
 
-  ret = sqlite3_exec(otp_db, sql, _delete_cb, &counter, &err_msg);
-  if (ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" update query failed: %s", err_msg);
-    sqlite3_free(sql);
-    sqlite3_free(err_msg);
-    sqlite3_close(otp_db);
+static int _db_select_labels(db_label_cb cb, void *data)
+{
+  int ret;
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_LABELS);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *label = (const char *) sqlite3_column_text(stmt, 1);
+    cb(data, sqlite3_column_int(stmt, 0), label ? label : "", label ? sqlite3_column_bytes(stmt, 1) : 0);
+  }
+
+  if (ret != SQLITE_DONE) {
+    dlog_print(DLOG_DEBUG, LOG_TAG, DB_LOG_TAG" select query failed: %s", sqlite3_errmsg(db_ctx.handle));
+    _db_stmt_release(stmt);
 
     return SQLITE_ERROR;
   }
 
-  sqlite3_free(sql);
-  sqlite3_close(otp_db);
+  _db_stmt_release(stmt);
 
   return SQLITE_OK;
 }
 
-int db_delete_id(int id)
+static int _db_select_page(otp_list_s *result, int low, int high)
 {
-  sqlite3 *otp_db;
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_PAGE);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
 
-  if(_db_open(&otp_db) != SQLITE_OK)
+  sqlite3_bind_int(stmt, 1, low);
+  sqlite3_bind_int(stmt, 2, high);
+
+  return _db_select(stmt, result);
+}
+
+static int _db_select_id(otp_list_s *result, int id)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_ID);
+  if (stmt == NULL)
     return SQLITE_ERROR;
 
-  char *sql = sqlite3_mprintf("DELETE from "DB_TABLE_NAME" where "DB_COL_ID"=%d;", id);
+  sqlite3_bind_int(stmt, 1, id);
 
-  int counter = 0, ret = 0;
-  char *err_msg;
+  return _db_select(stmt, result);
+}
+
+/* Every entry including tombstones */
+static int _db_select_sync(otp_list_s *result)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_SYNC);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  return _db_select(stmt, result);
+}
+
+static int _db_select_uid(otp_list_s *result, uint64_t uid)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_UID);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  sqlite3_bind_int64(stmt, 1, (sqlite3_int64) uid);
+
+  return _db_select(stmt, result);
+}
+
+static int _db_sync_counter(uint64_t uid, int counter)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SYNC_COUNTER);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  sqlite3_bind_int(stmt, 1, counter);
+  sqlite3_bind_int64(stmt, 2, (sqlite3_int64) uid);
+
+  return _db_stmt_exec(stmt, "sync counter");
+}
+
+/* Merges an entry received by the sync: the higher revision wins, counters
+ * only go up */
+static int _db_sync_put(otp_info_s *data)
+{
+  otp_list_s found = { 0 };
+
+  if (_db_select_uid(&found, data->uid) != SQLITE_OK) {
+    otp_list_clear(&found);
+    return SQLITE_ERROR;
+  }
+
+  if (found.count == 0)
+    return _db_insert(data);
+
+  sync_digest_s incoming, local;
+  const int id = found.entries[0].id;
+  sync_digest(data, &incoming);
+  sync_digest(&found.entries[0], &local);
+  otp_list_clear(&found);
+
+  if (!sync_newer(&incoming, &local)) {
+    data->id = 0;
+    return _db_sync_counter(data->uid, data->counter);
+  }
+
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SYNC_UPDATE);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  if (_db_bind_entry(stmt, data) != SQLITE_OK) {
+    _db_stmt_release(stmt);
+    return SQLITE_ERROR;
+  }
+
+  const int ret = _db_stmt_exec(stmt, "sync update");
+  if (ret == SQLITE_OK)
+    data->id = id;
+
+  return ret;
+}
+
+static int _db_inc_counter(int id)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_INC_COUNTER);
+  if (stmt == NULL)
+    return SQLITE_ERROR;
+
+  sqlite3_bind_int(stmt, 1, id);
+
+  return _db_stmt_exec(stmt, "update");
+}
+
+/* Reads the counter and stores the next one in a single transaction, which
+ * is synced before the code is shown, so a crash never reuses a counter */
+static int _db_reserve_counter(int id, int *counter)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_SELECT_COUNTER);
+  int ret;
+
+  if (stmt == NULL || _db_exec(DB_STMT_SYNC_FULL, "synchronous") != SQLITE_OK)
+    return SQLITE_ERROR;
+
+  if (_db_exec(DB_STMT_BEGIN_IMMEDIATE, "begin") != SQLITE_OK) {
+    _db_exec(DB_STMT_SYNC_NORMAL, "synchronous");
+    return SQLITE_ERROR;
+  }
+
+  sqlite3_bind_int(stmt, 1, id);
+  ret = sqlite3_step(stmt);
+  if (ret == SQLITE_ROW) {
+    *counter = sqlite3_column_int(stmt, 0);
+    ret = SQLITE_OK;
+  } else {
+    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" no counter for entry %d", id);
+    ret = SQLITE_ERROR;
+  }
+  _db_stmt_release(stmt);
+
+  if (ret == SQLITE_OK)
+    ret = _db_inc_counter(id);
+
+  if (ret == SQLITE_OK)
+    ret = _db_exec(DB_STMT_COMMIT, "commit");
 
-  ret = sqlite3_exec(otp_db, sql, _delete_cb, &counter, &err_msg);
   if (ret != SQLITE_OK)
-  {
-    dlog_print(DLOG_ERROR, LOG_TAG, DB_LOG_TAG" delete query failed: %s", err_msg);
-    sqlite3_free(sql);
-    sqlite3_free(err_msg);
-    sqlite3_close(otp_db);
+    _db_exec(DB_STMT_ROLLBACK, "rollback");
 
+  _db_exec(DB_STMT_SYNC_NORMAL, "synchronous");
+
+  return ret;
+}
+
+static int _db_delete_id(int id)
+{
+  sqlite3_stmt *stmt = _db_stmt(DB_STMT_DELETE_ID);
+  if (stmt == NULL)
     return SQLITE_ERROR;
+
+  sqlite3_bind_int(stmt, 1, id);
+
+  return _db_stmt_exec(stmt, "delete");
+}
+
+int db_insert(otp_info_s *data)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_insert(data);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_all(otp_list_s *result)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_all(result);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_rows(GArray *rows)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_rows(rows);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_labels(db_label_cb cb, void *data)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_labels(cb, data);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_page(otp_list_s *result, int low, int high)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_page(result, low, high);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_id(otp_list_s *result, int id)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_id(result, id);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_sync(otp_list_s *result)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_sync(result);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_select_uid(otp_list_s *result, uint64_t uid)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_select_uid(result, uid);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_sync_put(otp_info_s *data)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_sync_put(data);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_sync_counter(uint64_t uid, int counter)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_sync_counter(uid, counter);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_inc_counter(int id)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_inc_counter(id);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_reserve_counter(int id, int *counter)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_reserve_counter(id, counter);
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_delete_id(int id)
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_delete_id(id);
+  _db_leave(start);
+
+  return ret;
+}
+
+/* Groups the following writes into a single transaction, other threads
+ * wait until it's committed or rolled back */
+int db_begin()
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_exec(DB_STMT_BEGIN, "begin");
+
+  if (ret == SQLITE_OK) {
+    g_rec_mutex_lock(&db_ctx.lock);
+    db_ctx.transaction = TRUE;
   }
+  _db_leave(start);
 
-  sqlite3_free(sql);
-  sqlite3_close(otp_db);
+  return ret;
+}
 
-  return SQLITE_OK;
+/* A failed commit leaves the transaction open, it has to be rolled back */
+int db_commit()
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_exec(DB_STMT_COMMIT, "commit");
+
+  if (ret == SQLITE_OK && db_ctx.transaction) {
+    db_ctx.transaction = FALSE;
+    g_rec_mutex_unlock(&db_ctx.lock);
+  }
+  _db_leave(start);
+
+  return ret;
+}
+
+int db_rollback()
+{
+  const int64_t start = _db_enter();
+  const int ret = _db_exec(DB_STMT_ROLLBACK, "rollback");
+
+  if (db_ctx.transaction) {
+    db_ctx.transaction = FALSE;
+    g_rec_mutex_unlock(&db_ctx.lock);
+  }
+  _db_leave(start);
+
+  return ret;
 }
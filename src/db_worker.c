@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <dlog.h>
+#include "otp.h"
+#include "db_worker.h"
+#include "util/latency.h"
+
+typedef enum db_op {
+  DB_OP_INIT,
+  DB_OP_SELECT_ROWS,
+  DB_OP_SELECT_PAGE,
+  DB_OP_SEARCH_INDEX,
+  DB_OP_SELECT_ID,
+  DB_OP_INC_COUNTER,
+  DB_OP_RESERVE_COUNTER,
+  DB_OP_DELETE_ID,
+  DB_OP_RUN,
+  DB_OP_QUIT
+} db_op_e;
+
+typedef struct db_job {
+  db_op_e        op;
+  int            id;
+  /* Range of db_select_page() */
+  int            low;
+  int            high;
+  int            ret;
+  int            counter;
+  otp_list_s     *result;
+  GArray         *rows;
+  search_index_s *index;
+  db_select_cb   select_cb;
+  db_rows_cb     rows_cb;
+  db_index_cb    index_cb;
+  db_done_cb     done_cb;
+  db_counter_cb  counter_cb;
+  db_run_fn      run;
+  void           *data;
+  GDestroyNotify free;
+  gboolean       cancelled;
+  int64_t        queued;
+} db_job_s;
+
+/* Queue of the worker, the jobs it has run and the jobs whose results are
+ * pending which are only touched by the main loop */
+typedef struct db_worker {
+  GThread     *thread;
+  GAsyncQueue *queue;
+  GAsyncQueue *done;
+  GList       *pending;
+} db_worker_s;
+
+static db_worker_s worker = { 0 };
+
+#ifdef OTP_PROFILE
+/* Only written by the worker thread */
+static latency_hist_s db_queue_wait = LATENCY_HIST_INIT("db queue wait");
+static latency_hist_s db_job_run = LATENCY_HIST_INIT("db job");
+#endif
+
+static void _db_job_free(db_job_s *job)
+{
+  otp_list_free(job->result);
+  if (job->rows) g_array_free(job->rows, TRUE);
+  search_index_free(job->index);
+  if (job->free) job->free(job->data);
+  g_free(job);
+}
+
+/* Delivers the result on the main loop */
+static void _db_job_done(db_job_s *job)
+{
+  worker.pending = g_list_remove(worker.pending, job);
+
+  if (!job->cancelled) {
+    if (job->select_cb) {
+      job->select_cb(job->data, job->ret, job->result);
+      job->result = NULL;
+    } else if (job->rows_cb) {
+      job->rows_cb(job->data, job->ret, job->rows);
+      job->rows = NULL;
+    } else if (job->index_cb) {
+      job->index_cb(job->data, job->ret, job->index);
+      job->index = NULL;
+    } else if (job->counter_cb) {
+      job->counter_cb(job->data, job->ret, job->counter);
+    } else if (job->done_cb) {
+      job->done_cb(job->data, job->ret);
+    }
+  }
+
+  _db_job_free(job);
+}
+
+static void _db_jobs_done(void *data)
+{
+  db_job_s *job;
+
+  /* Jobs left when the worker stopped were dropped */
+  if (worker.done == NULL)
+    return;
+
+  while ((job = g_async_queue_try_pop(worker.done)) != NULL)
+    _db_job_done(job);
+}
+
+static void _db_index_label(void *data, int id, const char *label, int length)
+{
+  search_index_add(data, id, label, length);
+}
+
+static void _db_job_run(db_job_s *job)
+{
+  switch (job->op) {
+  case DB_OP_INIT:
+    job->ret = db_init();
+    break;
+  case DB_OP_SELECT_ROWS:
+    job->rows = g_array_new(FALSE, FALSE, sizeof(db_row_s));
+    job->ret = db_select_rows(job->rows);
+    break;
+  case DB_OP_SELECT_PAGE:
+    job->result = calloc(1, sizeof(otp_list_s));
+    job->ret = job->result ? db_select_page(job->result, job->low, job->high) : SQLITE_NOMEM;
+    break;
+  case DB_OP_SEARCH_INDEX:
+    job->index = search_index_new();
+    job->ret = job->index ? db_select_labels(_db_index_label, job->index) : SQLITE_ERROR;
+    break;
+  case DB_OP_SELECT_ID:
+    job->result = calloc(1, sizeof(otp_list_s));
+    job->ret = job->result ? db_select_id(job->result, job->id) : SQLITE_NOMEM;
+    break;
+  case DB_OP_INC_COUNTER:
+    job->ret = db_inc_counter(job->id);
+    break;
+  case DB_OP_RESERVE_COUNTER:
+    job->ret = db_reserve_counter(job->id, &job->counter);
+    break;
+  case DB_OP_DELETE_ID:
+    job->ret = db_delete_id(job->id);
+    break;
+  case DB_OP_RUN:
+    job->ret = job->run(job->data);
+    break;
+  case DB_OP_QUIT:
+    break;
+  }
+}
+
+static gpointer _db_worker_thread(gpointer data)
+{
+  GAsyncQueue *queue = data;
+
+  for (;;) {
+    db_job_s *job = g_async_queue_pop(queue);
+
+    if (job->op == DB_OP_QUIT) {
+      g_free(job);
+      break;
+    }
+
+#ifdef OTP_PROFILE
+    const int64_t start = latency_now_us();
+    latency_record(&db_queue_wait, start - job->queued);
+    _db_job_run(job);
+    latency_record_since(&db_job_run, start);
+#else
+    _db_job_run(job);
+#endif
+
+    g_async_queue_push(worker.done, job);
+    ecore_main_loop_thread_safe_call_async(_db_jobs_done, NULL);
+  }
+
+  return NULL;
+}
+
+static void _db_job_push(db_job_s *job)
+{
+  if (worker.thread == NULL) {
+    worker.queue = g_async_queue_new();
+    worker.done = g_async_queue_new();
+    worker.thread = g_thread_new("db", _db_worker_thread, worker.queue);
+  }
+
+#ifdef OTP_PROFILE
+  job->queued = latency_now_us();
+#endif
+  if (job->op != DB_OP_QUIT)
+    worker.pending = g_list_prepend(worker.pending, job);
+
+  g_async_queue_push(worker.queue, job);
+}
+
+static db_job_s *_db_job_new(db_op_e op, int id, void *data)
+{
+  db_job_s *job = g_new0(db_job_s, 1);
+
+  job->op = op;
+  job->id = id;
+  job->data = data;
+
+  return job;
+}
+
+void db_init_async(db_done_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_INIT, 0, data);
+  job->done_cb = done;
+  _db_job_push(job);
+}
+
+void db_select_rows_async(db_rows_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_SELECT_ROWS, 0, data);
+  job->rows_cb = done;
+  _db_job_push(job);
+}
+
+void db_select_page_async(int low, int high, db_select_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_SELECT_PAGE, 0, data);
+  job->low = low;
+  job->high = high;
+  job->select_cb = done;
+  _db_job_push(job);
+}
+
+void db_search_index_async(db_index_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_SEARCH_INDEX, 0, data);
+  job->index_cb = done;
+  _db_job_push(job);
+}
+
+void db_select_id_async(int id, db_select_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_SELECT_ID, id, data);
+  job->select_cb = done;
+  _db_job_push(job);
+}
+
+void db_inc_counter_async(int id, db_done_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_INC_COUNTER, id, data);
+  job->done_cb = done;
+  _db_job_push(job);
+}
+
+void db_reserve_counter_async(int id, db_counter_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_RESERVE_COUNTER, id, data);
+  job->counter_cb = done;
+  _db_job_push(job);
+}
+
+void db_delete_id_async(int id, db_done_cb done, void *data)
+{
+  db_job_s *job = _db_job_new(DB_OP_DELETE_ID, id, data);
+  job->done_cb = done;
+  _db_job_push(job);
+}
+
+void db_run_async(db_run_fn run, db_done_cb done, void *data, GDestroyNotify free)
+{
+  db_job_s *job = _db_job_new(DB_OP_RUN, 0, data);
+  job->run = run;
+  job->done_cb = done;
+  job->free = free;
+  _db_job_push(job);
+}
+
+void db_async_cancel(const void *data)
+{
+  for (GList *it = worker.pending; it != NULL; it = g_list_next(it)) {
+    db_job_s *job = it->data;
+
+    if (job->data == data)
+      job->cancelled = TRUE;
+  }
+}
+
+void db_worker_stop()
+{
+  if (worker.thread == NULL)
+    return;
+
+  _db_job_push(_db_job_new(DB_OP_QUIT, 0, NULL));
+  g_thread_join(worker.thread);
+  g_async_queue_unref(worker.queue);
+
+  /* The main loop is gone, results which weren't delivered are dropped */
+  db_job_s *job;
+  while ((job = g_async_queue_try_pop(worker.done)) != NULL)
+    _db_job_free(job);
+  g_async_queue_unref(worker.done);
+  g_list_free(worker.pending);
+
+#ifdef OTP_PROFILE
+  char stats[256];
+  latency_format(&db_queue_wait, stats, sizeof(stats));
+  dlog_print(DLOG_INFO, LOG_TAG, "%s", stats);
+  latency_format(&db_job_run, stats, sizeof(stats));
+  dlog_print(DLOG_INFO, LOG_TAG, "%s", stats);
+#endif
+
+  worker.thread = NULL;
+  worker.queue = NULL;
+  worker.done = NULL;
+  worker.pending = NULL;
+}
@@ -0,0 +1,506 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/hash.h"
+#include "util/secure_mem.h"
+#include "entry_parser.h"
+
+typedef enum parser_state {
+  STATE_TOP,
+  STATE_ARRAY_START,     /* after '[' */
+  STATE_ARRAY_ELEMENT,   /* after ',' in the array */
+  STATE_ARRAY_NEXT,      /* after an entry in the array */
+  STATE_OBJECT_START,    /* after '{' */
+  STATE_OBJECT_KEY,      /* after ',' in an entry */
+  STATE_KEY,
+  STATE_COLON,
+  STATE_VALUE,
+  STATE_STRING,
+  STATE_NUMBER,
+  STATE_LITERAL,
+  STATE_SKIP,            /* nested object or array of an unknown key */
+  STATE_OBJECT_NEXT,     /* after a value */
+  STATE_ERROR
+} parser_state_e;
+
+typedef enum entry_field {
+  FIELD_UNKNOWN,
+  FIELD_TYPE,
+  FIELD_LABEL,
+  FIELD_SECRET,
+  FIELD_COUNTER,
+  FIELD_ALGORITHM,
+  FIELD_DIGITS,
+  FIELD_PERIOD
+} entry_field_e;
+
+static const char *entry_fields[] = {
+  [FIELD_TYPE]      = "type",
+  [FIELD_LABEL]     = "label",
+  [FIELD_SECRET]    = "secret",
+  [FIELD_COUNTER]   = "counter",
+  [FIELD_ALGORITHM] = "algorithm",
+  [FIELD_DIGITS]    = "digits",
+  [FIELD_PERIOD]    = "period",
+};
+
+#define WRONG_OBJECT "wrong json object"
+
+static int _is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void _clear_buf(entry_parser_s *p) {
+  secure_wipe(p->buf, p->len);
+  p->len = 0;
+  p->overflow = 0;
+}
+
+static void _append(entry_parser_s *p, char c) {
+  if (p->len < sizeof(p->buf) - 1) {
+    p->buf[p->len++] = c;
+  } else {
+    p->overflow = 1;
+  }
+}
+
+static void _append_utf8(entry_parser_s *p, uint32_t cp) {
+  if (cp < 0x80) {
+    _append(p, cp);
+  } else if (cp < 0x800) {
+    _append(p, 0xC0 | (cp >> 6));
+    _append(p, 0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    _append(p, 0xE0 | (cp >> 12));
+    _append(p, 0x80 | ((cp >> 6) & 0x3F));
+    _append(p, 0x80 | (cp & 0x3F));
+  } else {
+    _append(p, 0xF0 | (cp >> 18));
+    _append(p, 0x80 | ((cp >> 12) & 0x3F));
+    _append(p, 0x80 | ((cp >> 6) & 0x3F));
+    _append(p, 0x80 | (cp & 0x3F));
+  }
+}
+
+/* A high surrogate which isn't followed by a low one is replaced */
+static void _flush_surrogate(entry_parser_s *p) {
+  if (p->surrogate) {
+    _append_utf8(p, 0xFFFD);
+    p->surrogate = 0;
+  }
+}
+
+static void _append_unicode(entry_parser_s *p, uint32_t cp) {
+  if (cp >= 0xDC00 && cp <= 0xDFFF && p->surrogate) {
+    cp = 0x10000 + ((p->surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    p->surrogate = 0;
+  } else {
+    _flush_surrogate(p);
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+      p->surrogate = cp;
+      return;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+      cp = 0xFFFD;
+    }
+  }
+  _append_utf8(p, cp);
+}
+
+static int _hex(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* Reads one character of a string. Returns 1 once the closing quote is seen,
+ * -1 on a syntax error. Characters are collected only if keep is set. */
+static int _string_char(entry_parser_s *p, char c, int keep) {
+  if (p->escape == 1) {
+    char out;
+    switch (c) {
+    case '"':  out = '"';  break;
+    case '\\': out = '\\'; break;
+    case '/':  out = '/';  break;
+    case 'b':  out = '\b'; break;
+    case 'f':  out = '\f'; break;
+    case 'n':  out = '\n'; break;
+    case 'r':  out = '\r'; break;
+    case 't':  out = '\t'; break;
+    case 'u':
+      p->escape = 2;
+      p->unicode = 0;
+      return 0;
+    default:
+      return -1;
+    }
+    p->escape = 0;
+    if (keep) {
+      _flush_surrogate(p);
+      _append(p, out);
+    }
+    return 0;
+  }
+
+  if (p->escape > 1) {
+    int digit = _hex(c);
+    if (digit < 0) return -1;
+    p->unicode = (p->unicode << 4) | digit;
+    if (++p->escape == 6) {
+      p->escape = 0;
+      if (keep) _append_unicode(p, p->unicode);
+    }
+    return 0;
+  }
+
+  if (c == '\\') {
+    p->escape = 1;
+    return 0;
+  }
+  if ((unsigned char) c < 0x20) {
+    return -1;
+  }
+  if (keep) _flush_surrogate(p);
+  if (c == '"') {
+    if (keep) p->buf[p->len] = '\0';
+    return 1;
+  }
+  if (keep) _append(p, c);
+  return 0;
+}
+
+static void _set_error(entry_parser_s *p, const char *error) {
+  if (p->error == NULL) p->error = error;
+}
+
+static entry_field_e _field(const entry_parser_s *p) {
+  if (p->overflow) return FIELD_UNKNOWN;
+
+  for (int i = FIELD_UNKNOWN + 1; i < (int) (sizeof(entry_fields) / sizeof(*entry_fields)); ++i) {
+    if (strcmp(p->buf, entry_fields[i]) == 0) {
+      return i;
+    }
+  }
+  return FIELD_UNKNOWN;
+}
+
+/* Adds a digit to the mantissa, trailing zeros are counted apart so that
+ * the mantissa only holds significant digits */
+static void _add_digit(long long *mantissa, int *zeros, int *big, char c) {
+  if (c == '0') {
+    (*zeros)++;
+    return;
+  }
+  for (; *zeros >= 0; (*zeros)--) {
+    if (*mantissa > INT_MAX) *big = 1;
+    if (!*big) *mantissa = *mantissa * 10 + (*zeros ? 0 : c - '0');
+  }
+  *zeros = 0;
+}
+
+/* Reads a number with an integral value into value, as json-glib did:
+ * 5, -3, 5.0 and 2.5e1 are accepted, 2.5 isn't. Returns 0 if s isn't such
+ * a number or the value doesn't fit an int. */
+static int _integer(const char *s, size_t len, long long *value) {
+  size_t i = s[0] == '-', digits = 0;
+  long long mantissa = 0;
+  int zeros = 0, big = 0, scale = 0, exponent = 0, exp_sign = 1;
+
+  for (; i < len && s[i] >= '0' && s[i] <= '9'; i++, digits++) {
+    _add_digit(&mantissa, &zeros, &big, s[i]);
+  }
+  if (digits == 0) return 0;
+
+  if (i < len && s[i] == '.') {
+    for (digits = 0, i++; i < len && s[i] >= '0' && s[i] <= '9'; i++, digits++) {
+      _add_digit(&mantissa, &zeros, &big, s[i]);
+      scale--;
+    }
+    if (digits == 0) return 0;
+  }
+
+  if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+    if (++i < len && (s[i] == '+' || s[i] == '-')) exp_sign = s[i++] == '-' ? -1 : 1;
+    for (digits = 0; i < len && s[i] >= '0' && s[i] <= '9'; i++, digits++) {
+      if (exponent < 1000) exponent = exponent * 10 + (s[i] - '0');
+    }
+    if (digits == 0) return 0;
+  }
+  if (i != len || big) return 0;
+
+  scale += zeros + exp_sign * exponent;
+  if (mantissa == 0) scale = 0;
+  /* The mantissa doesn't end with a zero, a fraction is left */
+  if (scale < 0) return 0;
+  for (; scale > 0 && mantissa <= INT_MAX; scale--) {
+    mantissa *= 10;
+  }
+
+  *value = s[0] == '-' ? -mantissa : mantissa;
+  return *value >= INT_MIN && *value <= INT_MAX;
+}
+
+static void _set_number(entry_parser_s *p) {
+  otp_info_s *entry = &p->entry;
+  long long value = 0;
+
+  p->buf[p->len] = '\0';
+
+  /* Only integers fit the known fields */
+  const int valid = !p->overflow && p->len > 0 && _integer(p->buf, p->len, &value);
+
+  if (p->field == FIELD_UNKNOWN) return;
+  if (!valid) {
+    _set_error(p, WRONG_OBJECT);
+    return;
+  }
+
+  switch (p->field) {
+  case FIELD_COUNTER:
+    entry->counter = value;
+    break;
+  case FIELD_DIGITS:
+    entry->digits = value;
+    if (value < OTP_MIN_DIGITS || value > OTP_MAX_DIGITS) _set_error(p, "unsupported number of digits");
+    break;
+  case FIELD_PERIOD:
+    entry->period = value;
+    if (value < 1 || value > OTP_MAX_PERIOD) _set_error(p, "wrong period");
+    break;
+  default:
+    _set_error(p, WRONG_OBJECT);
+    break;
+  }
+}
+
+static void _set_string(entry_parser_s *p) {
+  otp_info_s *entry = &p->entry;
+
+  switch (p->field) {
+  case FIELD_TYPE:
+    if (strcmp(p->buf, "TOTP") == 0) entry->type = TOTP;
+    else if (strcmp(p->buf, "HOTP") == 0) entry->type = HOTP;
+    break;
+  case FIELD_LABEL:
+    otp_set_label(entry, p->buf, strnlen(p->buf, p->len));
+    break;
+  case FIELD_SECRET:
+    if (p->overflow || !otp_set_secret(entry, p->buf)) _set_error(p, "invalid secret");
+    break;
+  case FIELD_ALGORITHM: {
+    int algo = p->overflow ? -1 : hash_algo_from_name(p->buf);
+    if (algo < 0) _set_error(p, "unsupported algorithm");
+    else otp_set_algorithm(entry, algo);
+    break;
+  }
+  case FIELD_COUNTER:
+  case FIELD_DIGITS:
+  case FIELD_PERIOD:
+    /* Some senders quote numbers, e.g. "counter":"5" */
+    _set_number(p);
+    break;
+  case FIELD_UNKNOWN:
+    break;
+  default:
+    _set_error(p, WRONG_OBJECT);
+    break;
+  }
+}
+
+static void _begin_entry(entry_parser_s *p) {
+  memset(&p->entry, 0, sizeof(p->entry));
+  p->error = NULL;
+  p->state = STATE_OBJECT_START;
+}
+
+static void _end_entry(entry_parser_s *p) {
+  if (p->error == NULL && !(otp_label_len(&p->entry) > 0 && p->entry.key != NULL)) {
+    p->error = "missing label or secret";
+  }
+
+  p->cb(p->data, &p->entry, p->error);
+
+  otp_info_clear(&p->entry);
+  p->error = NULL;
+  p->state = p->array ? STATE_ARRAY_NEXT : STATE_TOP;
+}
+
+static void _fail(entry_parser_s *p) {
+  if (p->state >= STATE_OBJECT_START) {
+    p->cb(p->data, &p->entry, "wrong json");
+    otp_info_clear(&p->entry);
+  }
+  _clear_buf(p);
+  p->state = STATE_ERROR;
+}
+
+/* Consumes c unless it terminates a number or literal, returns whether it did */
+static int _step(entry_parser_s *p, char c) {
+  int ret;
+
+  switch (p->state) {
+  case STATE_TOP:
+    if (_is_space(c)) return 1;
+    if (c == '{') {
+      p->array = 0;
+      _begin_entry(p);
+    } else if (c == '[') {
+      p->array = 1;
+      p->state = STATE_ARRAY_START;
+    } else {
+      _fail(p);
+    }
+    return 1;
+
+  case STATE_ARRAY_START:
+  case STATE_ARRAY_ELEMENT:
+    if (_is_space(c)) return 1;
+    if (c == '{') _begin_entry(p);
+    else if (c == ']' && p->state == STATE_ARRAY_START) p->state = STATE_TOP;
+    else _fail(p);
+    return 1;
+
+  case STATE_ARRAY_NEXT:
+    if (_is_space(c)) return 1;
+    if (c == ',') p->state = STATE_ARRAY_ELEMENT;
+    else if (c == ']') p->state = STATE_TOP;
+    else _fail(p);
+    return 1;
+
+  case STATE_OBJECT_START:
+  case STATE_OBJECT_KEY:
+    if (_is_space(c)) return 1;
+    if (c == '"') {
+      p->state = STATE_KEY;
+      _clear_buf(p);
+    } else if (c == '}' && p->state == STATE_OBJECT_START) {
+      _end_entry(p);
+    } else {
+      _fail(p);
+    }
+    return 1;
+
+  case STATE_KEY:
+    ret = _string_char(p, c, 1);
+    if (ret < 0) {
+      _fail(p);
+    } else if (ret > 0) {
+      p->field = _field(p);
+      _clear_buf(p);
+      p->state = STATE_COLON;
+    }
+    return 1;
+
+  case STATE_COLON:
+    if (_is_space(c)) return 1;
+    if (c == ':') p->state = STATE_VALUE;
+    else _fail(p);
+    return 1;
+
+  case STATE_VALUE:
+    if (_is_space(c)) return 1;
+    if (c == '"') {
+      p->state = STATE_STRING;
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+      _append(p, c);
+      p->state = STATE_NUMBER;
+    } else if (c == '{' || c == '[') {
+      if (p->field != FIELD_UNKNOWN) _set_error(p, WRONG_OBJECT);
+      p->depth = 1;
+      p->in_string = 0;
+      p->state = STATE_SKIP;
+    } else if (c >= 'a' && c <= 'z') {
+      _append(p, c);
+      p->state = STATE_LITERAL;
+    } else {
+      _fail(p);
+    }
+    return 1;
+
+  case STATE_STRING:
+    ret = _string_char(p, c, p->field != FIELD_UNKNOWN);
+    if (ret < 0) {
+      _fail(p);
+    } else if (ret > 0) {
+      _set_string(p);
+      _clear_buf(p);
+      p->state = STATE_OBJECT_NEXT;
+    }
+    return 1;
+
+  case STATE_NUMBER:
+    if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+      _append(p, c);
+      return 1;
+    }
+    _set_number(p);
+    _clear_buf(p);
+    p->state = STATE_OBJECT_NEXT;
+    return 0;
+
+  case STATE_LITERAL:
+    if (c >= 'a' && c <= 'z') {
+      _append(p, c);
+      return 1;
+    }
+    p->buf[p->len] = '\0';
+    if (p->overflow || (strcmp(p->buf, "true") && strcmp(p->buf, "false") && strcmp(p->buf, "null"))) {
+      _fail(p);
+      return 1;
+    }
+    if (p->field != FIELD_UNKNOWN) _set_error(p, WRONG_OBJECT);
+    _clear_buf(p);
+    p->state = STATE_OBJECT_NEXT;
+    return 0;
+
+  case STATE_SKIP:
+    if (p->in_string) {
+      ret = _string_char(p, c, 0);
+      if (ret < 0) _fail(p);
+      else if (ret > 0) p->in_string = 0;
+    } else if (c == '"') {
+      p->in_string = 1;
+    } else if (c == '{' || c == '[') {
+      p->depth++;
+    } else if ((c == '}' || c == ']') && --p->depth == 0) {
+      p->state = STATE_OBJECT_NEXT;
+    }
+    return 1;
+
+  case STATE_OBJECT_NEXT:
+    if (_is_space(c)) return 1;
+    if (c == ',') p->state = STATE_OBJECT_KEY;
+    else if (c == '}') _end_entry(p);
+    else _fail(p);
+    return 1;
+
+  default:
+    return 1;
+  }
+}
+
+void entry_parser_init(entry_parser_s *parser, entry_parser_cb cb, void *data) {
+  memset(parser, 0, sizeof(*parser));
+  parser->cb = cb;
+  parser->data = data;
+}
+
+void entry_parser_reset(entry_parser_s *parser) {
+  otp_info_clear(&parser->entry);
+  _clear_buf(parser);
+  entry_parser_init(parser, parser->cb, parser->data);
+}
+
+entry_parser_status_e entry_parser_feed(entry_parser_s *parser, const char *data, size_t length) {
+  size_t i = 0;
+
+  while (i < length && parser->state != STATE_ERROR) {
+    i += _step(parser, data[i]);
+  }
+
+  if (parser->state == STATE_ERROR) return ENTRY_PARSER_ERROR;
+  if (parser->state == STATE_TOP) return ENTRY_PARSER_IDLE;
+  return ENTRY_PARSER_MORE;
+}
@@ -0,0 +1,381 @@
+#include <dlog.h>
+#include "otp.h"
+#include "database.h"
+#include "db_worker.h"
+#include "entry_parser.h"
+#include "wire.h"
+#include "sync_session.h"
+#include "import.h"
+#include "util/secure_mem.h"
+
+/* Entry or counter record of a message, with the reason it was rejected */
+typedef struct import_item {
+  otp_info_s  entry;
+  const char  *error;
+} import_item_s;
+
+/* Complete message from the companion app. Its records are stored and its
+ * reply is built on the db worker, the reply is then handed to done on the
+ * main loop. */
+typedef struct import_message {
+  gboolean       binary;
+  gboolean       valid;
+  wire_header_s  header;
+  GArray         *items;
+  GArray         *digests;
+  GArray         *uids;
+  /* JSON message as received while it may be a single entry, which is
+   * acknowledged by echoing it */
+  GByteArray     *echo;
+  /* Entries whose row was written, without their key */
+  GArray         *changed;
+  gchar          *reply;
+  gsize          reply_length;
+  add_entries_cb done;
+  void           *data;
+} import_message_s;
+
+/* Message from the companion app which is being received. Records are
+ * kept until the message is complete and then stored in a single
+ * transaction, so the database isn't held while a slow sender is being
+ * waited for. */
+typedef struct import_data {
+  entry_parser_s   parser;
+  wire_decoder_s   wire;
+  import_message_s *message;
+} import_data_s;
+
+static import_data_s import = { 0 };
+
+static const char import_database_error[] = "database error";
+
+/* Adds a record to the message. The key slot of a valid entry now
+ * belongs to the item, rejected entries are kept without their key. */
+static void _import_add(import_message_s *msg, otp_info_s *entry, const char *error) {
+  import_item_s item = { .entry = *entry, .error = error };
+
+  if (msg->items == NULL) msg->items = g_array_new(FALSE, FALSE, sizeof(import_item_s));
+
+  if (error != NULL) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "add_entries() entry %u: %s", msg->items->len, error);
+    item.entry.key = NULL;
+  } else {
+    entry->key = NULL;
+  }
+  g_array_append_val(msg->items, item);
+}
+
+static void _import_entry(void *data, otp_info_s *entry, const char *error) {
+  import_data_s *im = data;
+  _import_add(im->message, entry, error);
+}
+
+/* Collects the records of the sync frames */
+static void _import_record(void *data, wire_type_e type, const uint8_t *record, size_t length) {
+  import_message_s *msg = ((import_data_s *) data)->message;
+
+  switch (type) {
+  case WIRE_SYNC_DIGEST: {
+    sync_digest_s digest;
+    sync_decode_digest(record, &digest);
+    if (msg->digests == NULL) msg->digests = g_array_new(FALSE, FALSE, sizeof(sync_digest_s));
+    g_array_append_val(msg->digests, digest);
+    break;
+  }
+  case WIRE_SYNC_REQUEST: {
+    uint64_t uid = sync_decode_request(record);
+    if (msg->uids == NULL) msg->uids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+    g_array_append_val(msg->uids, uid);
+    break;
+  }
+  case WIRE_SYNC_COUNTER: {
+    /* Only the uid and the counter are set */
+    otp_info_s entry = { 0 };
+    uint32_t counter;
+
+    sync_decode_counter(record, &entry.uid, &counter);
+    entry.counter = counter;
+    _import_add(msg, &entry, NULL);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+/* Stores the records of a complete message in a single transaction, the
+ * error of every record which isn't stored is set. Returns the number of
+ * records stored. */
+static guint _import_store(import_message_s *msg, gboolean counters) {
+  GArray *items = msg->items;
+  guint stored = 0;
+
+  if (items == NULL || items->len == 0) return 0;
+
+  const gboolean transaction = db_begin() == SQLITE_OK;
+
+  for (guint i = 0; i < items->len; i++) {
+    import_item_s *item = &g_array_index(items, import_item_s, i);
+    otp_info_s *entry = &item->entry;
+    int ret;
+
+    if (item->error != NULL) continue;
+
+    /* Entries from the sync carry their identity and are merged */
+    if (counters) {
+      ret = db_sync_counter(entry->uid, entry->counter);
+    } else {
+      ret = entry->uid ? db_sync_put(entry) : db_insert(entry);
+    }
+
+    if (ret != SQLITE_OK) {
+      item->error = import_database_error;
+    } else {
+      stored++;
+    }
+  }
+
+  if (transaction && db_commit() != SQLITE_OK) {
+    db_rollback();
+    for (guint i = 0; i < items->len; i++) {
+      import_item_s *item = &g_array_index(items, import_item_s, i);
+      if (item->error == NULL) item->error = import_database_error;
+    }
+    stored = 0;
+  }
+
+  /* The search over the labels is told about the rows written */
+  for (guint i = 0; i < items->len && stored > 0; i++) {
+    const import_item_s *item = &g_array_index(items, import_item_s, i);
+    otp_info_s entry = item->entry;
+
+    if (counters || item->error != NULL || entry.id == 0) continue;
+
+    entry.key = NULL;
+    if (msg->changed == NULL) msg->changed = g_array_new(FALSE, FALSE, sizeof(otp_info_s));
+    g_array_append_val(msg->changed, entry);
+  }
+
+  dlog_print(DLOG_INFO, LOG_TAG, "add_entries() imported %u of %u entries", stored, items->len);
+
+  return stored;
+}
+
+static void _import_drop_echo(import_message_s *msg) {
+  if (msg->echo == NULL) return;
+
+  /* The entry carries its secret */
+  secure_wipe(msg->echo->data, msg->echo->len);
+  g_byte_array_free(msg->echo, TRUE);
+  msg->echo = NULL;
+}
+
+static void _import_message_free(void *data) {
+  import_message_s *msg = data;
+
+  if (msg->items != NULL) {
+    for (guint i = 0; i < msg->items->len; i++) {
+      otp_info_clear(&g_array_index(msg->items, import_item_s, i).entry);
+    }
+    g_array_free(msg->items, TRUE);
+  }
+  if (msg->digests != NULL) g_array_free(msg->digests, TRUE);
+  if (msg->uids != NULL) g_array_free(msg->uids, TRUE);
+  if (msg->changed != NULL) g_array_free(msg->changed, TRUE);
+  _import_drop_echo(msg);
+
+  /* Replies to the sync and echoed entries carry keys */
+  if (msg->reply != NULL) {
+    secure_wipe(msg->reply, msg->reply_length);
+    g_free(msg->reply);
+  }
+  g_free(msg);
+}
+
+/* Sets the reply to a JSON message */
+static void _import_finish_json(import_message_s *msg) {
+  const guint count = msg->items ? msg->items->len : 0;
+  const guint imported = _import_store(msg, FALSE);
+
+  /* A single object is the old message format, the payload is echoed back */
+  if (msg->echo != NULL && imported == 1) {
+    msg->reply_length = msg->echo->len;
+    msg->reply = (gchar *) g_byte_array_free(msg->echo, FALSE);
+    msg->echo = NULL;
+  } else if (count > 0) {
+    GString *summary = g_string_new("{\"results\":[");
+    for (guint i = 0; i < count; i++) {
+      const char *error = g_array_index(msg->items, import_item_s, i).error;
+      g_string_append_printf(summary, "%s\"%s\"", i ? "," : "", error ? error : "ok");
+    }
+    g_string_append_printf(summary, "],\"imported\":%u,\"failed\":%u}", imported, count - imported);
+    msg->reply_length = summary->len;
+    msg->reply = g_string_free(summary, FALSE);
+  }
+}
+
+/* Sets the reply frames of a sync message which isn't acked */
+static void _import_finish_sync(import_message_s *msg) {
+  GByteArray *reply = g_byte_array_new();
+
+  switch (msg->header.type) {
+  case WIRE_SYNC_SUMMARY:
+    sync_session_summary(msg->header.seq, reply);
+    break;
+  case WIRE_SYNC_DIGEST:
+    sync_session_digest(msg->digests ? (const sync_digest_s *) msg->digests->data : NULL,
+                        msg->digests ? msg->digests->len : 0, msg->header.seq, reply);
+    break;
+  case WIRE_SYNC_REQUEST:
+    sync_session_request(msg->uids ? (const uint64_t *) msg->uids->data : NULL,
+                         msg->uids ? msg->uids->len : 0, msg->header.seq, reply);
+    break;
+  }
+
+  msg->reply_length = reply->len;
+  msg->reply = (gchar *) g_byte_array_free(reply, FALSE);
+}
+
+/* Sets the ack frame for a binary message, a frame which failed its CRC
+ * isn't stored at all */
+static void _import_finish_binary(import_message_s *msg) {
+  const wire_type_e type = msg->header.type;
+
+  if (msg->valid && (type == WIRE_SYNC_SUMMARY || type == WIRE_SYNC_DIGEST || type == WIRE_SYNC_REQUEST)) {
+    _import_finish_sync(msg);
+    return;
+  }
+
+  const guint count = msg->items ? msg->items->len : 0;
+  GByteArray *status = g_byte_array_sized_new(count ? count : 1);
+
+  if (msg->valid) {
+    _import_store(msg, type == WIRE_SYNC_COUNTER);
+  }
+
+  for (guint i = 0; i < count; i++) {
+    const char *error = g_array_index(msg->items, import_item_s, i).error;
+    guint8 result = WIRE_STATUS_CORRUPT;
+
+    if (msg->valid) {
+      result = error == NULL ? WIRE_STATUS_OK
+             : error == import_database_error ? WIRE_STATUS_DATABASE : WIRE_STATUS_INVALID;
+    }
+    g_byte_array_append(status, &result, 1);
+  }
+  if (!msg->valid && count == 0) {
+    const guint8 corrupt = WIRE_STATUS_CORRUPT;
+    g_byte_array_append(status, &corrupt, 1);
+  }
+
+  gsize size = WIRE_HEADER_SIZE + 8 + status->len;
+  msg->reply = g_malloc(size);
+  msg->reply_length = wire_encode_ack((uint8_t *) msg->reply, size, &msg->header, status->data, status->len);
+
+  g_byte_array_free(status, TRUE);
+}
+
+/* Runs on the db worker */
+static int _import_run(void *data) {
+  import_message_s *msg = data;
+
+  if (msg->binary) {
+    _import_finish_binary(msg);
+  } else {
+    _import_finish_json(msg);
+  }
+
+  return SQLITE_OK;
+}
+
+static void _import_done(void *data, int ret) {
+  import_message_s *msg = data;
+  msg->done(msg->data, msg->reply, msg->reply_length, msg->changed);
+}
+
+/* Hands the received message over to the db worker */
+static void _import_complete(import_data_s *im) {
+  import_message_s *msg = im->message;
+
+  im->message = NULL;
+  db_run_async(_import_run, _import_done, msg, _import_message_free);
+}
+
+gboolean add_entries(const char *data, gsize length, add_entries_cb done, void *user_data) {
+  if (import.parser.cb == NULL) {
+    entry_parser_init(&import.parser, _import_entry, &import);
+    wire_decoder_init(&import.wire, _import_entry, _import_record, &import);
+  }
+
+  const gboolean first = import.message == NULL;
+
+  /* Binary frames are told apart from JSON by their first byte */
+  if (first) {
+    import.message = g_new0(import_message_s, 1);
+    import.message->binary = length > 0 && data[0] == WIRE_MAGIC_0;
+  }
+
+  import_message_s *msg = import.message;
+  msg->done = done;
+  msg->data = user_data;
+
+  if (msg->binary) {
+    gsize consumed = 0;
+
+    switch (wire_decoder_feed(&import.wire, (const uint8_t *) data, length, &consumed)) {
+    case WIRE_DECODER_MORE:
+      return FALSE;
+    case WIRE_DECODER_ERROR:
+      dlog_print(DLOG_ERROR, LOG_TAG, "add_entries() got malformed frame");
+      msg->valid = FALSE;
+      break;
+    case WIRE_DECODER_IDLE:
+      msg->valid = import.wire.crc_ok;
+      if (!msg->valid) dlog_print(DLOG_ERROR, LOG_TAG, "add_entries() frame %u failed crc", import.wire.header.seq);
+      if (consumed < length) dlog_print(DLOG_ERROR, LOG_TAG, "add_entries() dropped %u bytes after frame", (guint) (length - consumed));
+      break;
+    }
+
+    msg->header = import.wire.header;
+    wire_decoder_reset(&import.wire);
+    _import_complete(&import);
+
+    return TRUE;
+  }
+
+  /* An object split across chunks is echoed whole */
+  if (first) msg->echo = g_byte_array_new();
+  if (msg->echo != NULL) g_byte_array_append(msg->echo, (const guint8 *) data, length);
+
+  const entry_parser_status_e status = entry_parser_feed(&import.parser, data, length);
+
+  /* Bulk imports get a summary instead */
+  if (import.parser.array || (msg->items && msg->items->len > 1)) _import_drop_echo(msg);
+
+  switch (status) {
+  case ENTRY_PARSER_MORE:
+    return FALSE;
+  case ENTRY_PARSER_ERROR:
+    dlog_print(DLOG_ERROR, LOG_TAG, "add_entries() got wrong json");
+    entry_parser_reset(&import.parser);
+    break;
+  case ENTRY_PARSER_IDLE:
+    break;
+  }
+
+  _import_complete(&import);
+
+  return TRUE;
+}
+
+void add_entries_reset() {
+  if (import.message != NULL) {
+    _import_message_free(import.message);
+    import.message = NULL;
+  }
+
+  if (import.parser.cb != NULL) {
+    entry_parser_reset(&import.parser);
+    wire_decoder_reset(&import.wire);
+  }
+}
@@ -1,51 +1,200 @@
 #include <app.h>
 #include <dlog.h>
 #include "otp.h"
-#include "database.h"
+#include "db_worker.h"
+#ifdef OTP_PROFILE
+#include "util/latency.h"
+#endif
+
+#define SEARCH_LABEL "<font font_weight=Regular font_size=30><align=center>%u found</align></font>"
+
+#ifdef OTP_PROFILE
+/* Query of the index and update of the genlist */
+static latency_hist_s menu_filter = LATENCY_HIST_INIT("menu filter");
+#endif
 
 static char * menu_text_get_cb(void *data, Evas_Object *obj, const char *part)
 {
-  if (data == NULL) return NULL;
+  menu_item_s *item = data;
 
-  char account[255];
-  char issuer[255];
-  otp_info_s *entry = (otp_info_s *) data;
+  /* Filled in by menu_page_cb() */
+  if (item == NULL || item->entry == NULL) return NULL;
 
-  get_otp_account(entry->label, account);
+  otp_info_s *entry = item->entry;
 
-  if (get_otp_issuer(entry->label, issuer)) {
-    if (!strcmp(part, "elm.text.1")) {
-      return strdup(account);
-    } else {
-      return strdup(issuer);
-    }
+  /* ":account" labels have an empty issuer and show as one line */
+  if (entry->issuer != NULL && entry->issuer->len && strcmp(part, "elm.text.1") != 0) {
+    return strdup(otp_issuer(entry));
   } else {
-    return strdup(account);
+    return strdup(otp_account(entry));
+  }
+}
+
+static guint menu_page_first(menu_page_s *page)
+{
+  return (page - page->menu->pages) * MENU_PAGE_SIZE;
+}
+
+static guint menu_page_end(menu_page_s *page)
+{
+  return MIN(menu_page_first(page) + MENU_PAGE_SIZE, page->menu->rows->len);
+}
+
+static void menu_page_release(menu_page_s *page)
+{
+  menu_data_s *md = page->menu;
+
+  for (guint i = menu_page_first(page); i < menu_page_end(page); i++) {
+    md->items[i].entry = NULL;
+  }
+
+  otp_list_free(page->entries);
+  page->entries = NULL;
+  md->pages_loaded--;
+}
+
+/* Drops the least recently used pages which aren't shown */
+static void menu_pages_trim(menu_data_s *md)
+{
+  GList *it = md->idle_pages.head;
+
+  while (md->pages_loaded > MENU_PAGES_CACHED && it != NULL) {
+    GList *next = it->next;
+    menu_page_s *page = it->data;
+
+    if (page != md->selected) {
+      g_queue_delete_link(&md->idle_pages, it);
+      menu_page_release(page);
+    }
+    it = next;
+  }
+}
+
+static void menu_page_cb(void *data, int ret, otp_list_s *entries)
+{
+  menu_page_s *page = data;
+  menu_data_s *md = page->menu;
+
+  if (ret != SQLITE_OK)
+    dlog_print(DLOG_ERROR, LOG_TAG, "can't read entries of page %d", (int) (page - md->pages));
+
+  page->loading = FALSE;
+  /* Read again once one of its rows is realized */
+  if (entries == NULL) return;
+
+  page->entries = entries;
+  md->pages_loaded++;
+
+  /* Rows which are gone since the list was read are left empty */
+  for (guint i = menu_page_first(page); i < menu_page_end(page); i++) {
+    const int id = g_array_index(md->rows, db_row_s, i).id;
+
+    for (int j = 0; j < entries->count; j++) {
+      if (entries->entries[j].id == id) {
+        md->items[i].entry = &entries->entries[j];
+        if (md->items[i].it) elm_genlist_item_update(md->items[i].it);
+        break;
+      }
+    }
+  }
+
+  if (page->realized == 0) {
+    g_queue_push_tail(&md->idle_pages, page);
+    menu_pages_trim(md);
+  }
+}
+
+static void menu_page_load(menu_page_s *page)
+{
+  GArray *rows = page->menu->rows;
+  const int high = g_array_index(rows, db_row_s, menu_page_first(page)).sort;
+  const int low = g_array_index(rows, db_row_s, menu_page_end(page) - 1).sort;
+
+  page->loading = TRUE;
+  db_select_page_async(low, high, menu_page_cb, page);
+}
+
+/* Returns the menu_item_s of an entry item, NULL for the search and
+ * padding items which carry other data */
+static menu_item_s *menu_entry_item_get(menu_data_s *md, Elm_Object_Item *it)
+{
+  const Elm_Genlist_Item_Class *class = elm_genlist_item_item_class_get(it);
+
+  if (class == NULL || (class != md->style_1text && class != md->style_2text))
+    return NULL;
+
+  return elm_object_item_data_get(it);
+}
+
+static void menu_realized_cb(void *data, Evas_Object *obj, void *event_info)
+{
+  menu_item_s *item = menu_entry_item_get(data, event_info);
+  if (item == NULL) return;
+
+  menu_page_s *page = item->page;
+
+  if (page->realized++ == 0 && page->entries != NULL)
+    g_queue_remove(&page->menu->idle_pages, page);
+
+  if (page->entries == NULL && !page->loading)
+    menu_page_load(page);
+}
+
+static void menu_unrealized_cb(void *data, Evas_Object *obj, void *event_info)
+{
+  menu_item_s *item = menu_entry_item_get(data, event_info);
+  if (item == NULL) return;
+
+  menu_page_s *page = item->page;
+
+  if (--page->realized == 0 && page->entries != NULL) {
+    g_queue_push_tail(&page->menu->idle_pages, page);
+    menu_pages_trim(page->menu);
   }
 }
 
 static Eina_Bool menu_pop_cb(void *data, Elm_Object_Item *it)
 {
   appdata_s *ad = data;
-  free(ad->menu);
+  menu_data_s *md = ad->menu;
+
+  db_async_cancel(ad);
+  for (guint i = 0; i < md->page_count; i++) {
+    db_async_cancel(&md->pages[i]);
+    otp_list_free(md->pages[i].entries);
+  }
+  g_queue_clear(&md->idle_pages);
+  if (md->style_1text) elm_genlist_item_class_free(md->style_1text);
+  if (md->style_2text) elm_genlist_item_class_free(md->style_2text);
+  search_index_free(md->index);
+  g_array_free(md->matches, TRUE);
+  free(md->query);
+#ifdef OTP_PROFILE
+  char stats[256];
+  latency_format(&menu_filter, stats, sizeof(stats));
+  dlog_print(DLOG_INFO, LOG_TAG, "%s", stats);
+#endif
+  free(md->pages);
+  free(md->items);
+  if (md->rows) g_array_free(md->rows, TRUE);
+  free(md);
+  ad->menu = NULL;
   ui_app_exit();
   return EINA_FALSE;
 }
 
-static void menu_del_cb(void *data, Evas_Object *obj)
-{
-	otp_info_s *payload = (otp_info_s *)data;
-	if (payload) free(payload);
-}
-
 static void menu_sel_cb(void *data, Evas_Object *obj, void *event_info)
 {
   appdata_s *ad = data;
 	Elm_Object_Item *it = (Elm_Object_Item *)event_info;
 	elm_genlist_item_selected_set(it, EINA_FALSE);
 
+  menu_item_s *item = elm_object_item_data_get(it);
+  if (item == NULL || item->entry == NULL) return;
+
+  ad->menu->selected = item->page;
   eext_rotary_object_event_activated_set(ad->menu->circle_genlist, EINA_FALSE);
-  code_view_create(data, elm_object_item_data_get(it));
+  code_view_create(data, item->entry);
 
 	return;
 }
@@ -59,26 +208,185 @@ static void menu_longpressed_cb(void *data, Evas_Object *obj, void *event_info)
 	return;
 }
 
-void menu_items_create(appdata_s *ad) {
-  GList *entries = NULL, *entry = NULL;
+static int menu_compare_ids(const void *a, const void *b)
+{
+  const int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+static gboolean menu_row_matches(menu_data_s *md, guint row)
+{
+  const int id = g_array_index(md->rows, db_row_s, row).id;
+
+  if (md->query[0] == '\0') return TRUE;
+
+  return bsearch(&id, md->matches->data, md->matches->len, sizeof(int), menu_compare_ids) != NULL;
+}
+
+/* Shows the rows matching the query. Only the items whose state changes
+ * are added or deleted, the others stay realized. */
+static void menu_filter_apply(appdata_s *ad)
+{
+  menu_data_s *md = ad->menu;
+  Elm_Object_Item *prev = md->search_item;
+
+  /* Applied by menu_index_cb() */
+  if (md->query[0] != '\0' && md->index == NULL) return;
+
+#ifdef OTP_PROFILE
+  const int64_t start = latency_now_us();
+#endif
+
+  if (md->query[0] != '\0')
+    search_index_query(md->index, md->query, md->matches);
+
+  for (guint i = 0; i < md->rows->len; i++) {
+    menu_item_s *item = &md->items[i];
+    const gboolean shown = menu_row_matches(md, i);
+
+    if (shown && item->it == NULL) {
+      Elm_Genlist_Item_Class *class = g_array_index(md->rows, db_row_s, i).issuer ? md->style_2text : md->style_1text;
+      item->it = elm_genlist_item_insert_after(md->genlist, class, item, NULL, prev,
+                                               ELM_GENLIST_ITEM_NONE, menu_sel_cb, ad);
+    } else if (!shown && item->it != NULL) {
+      elm_object_item_del(item->it);
+      item->it = NULL;
+    }
+
+    if (item->it != NULL) prev = item->it;
+  }
+
+  elm_genlist_item_update(md->search_item);
+  if (md->search_count) {
+    char label[255];
+    snprintf(label, 255, SEARCH_LABEL, md->query[0] == '\0' ? md->rows->len : md->matches->len);
+    elm_object_text_set(md->search_count, label);
+  }
+
+#ifdef OTP_PROFILE
+  latency_record_since(&menu_filter, start);
+#endif
+}
+
+static void menu_index_cb(void *data, int ret, search_index_s *index)
+{
+  appdata_s *ad = data;
+
+  if (ret != SQLITE_OK)
+    dlog_print(DLOG_ERROR, LOG_TAG, "can't index entries");
+
+  ad->menu->index = index;
+  if (ad->menu->query[0] != '\0')
+    menu_filter_apply(ad);
+}
+
+static char * menu_search_text_get_cb(void *data, Evas_Object *obj, const char *part)
+{
+  menu_data_s *md = data;
+
+  return strdup(md->query[0] != '\0' ? md->query : "Search");
+}
+
+static void menu_search_changed_cb(void *data, Evas_Object *obj, void *event_info)
+{
+  appdata_s *ad = data;
+  char *query = elm_entry_markup_to_utf8(elm_entry_entry_get(obj));
+
+  free(ad->menu->query);
+  ad->menu->query = query ? query : strdup("");
+  menu_filter_apply(ad);
+}
+
+static void menu_search_activated_cb(void *data, Evas_Object *obj, void *event_info)
+{
+  appdata_s *ad = data;
+  elm_naviframe_item_pop(ad->nf);
+}
+
+static Eina_Bool menu_search_pop_cb(void *data, Elm_Object_Item *it)
+{
+  appdata_s *ad = data;
+
+  ad->menu->search_count = NULL;
+  eext_rotary_object_event_activated_set(ad->menu->circle_genlist, EINA_TRUE);
+  return EINA_TRUE;
+}
+
+/* Edits the query, the list is filtered as it is typed or dictated */
+static void menu_search_cb(void *data, Evas_Object *obj, void *event_info)
+{
+  appdata_s *ad = data;
+  menu_data_s *md = ad->menu;
+  char label[255];
+
+  elm_genlist_item_selected_set(event_info, EINA_FALSE);
+  eext_rotary_object_event_activated_set(md->circle_genlist, EINA_FALSE);
+
+  Evas_Object *box = elm_box_add(ad->nf);
+  evas_object_size_hint_weight_set(box, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
+  elm_box_align_set(box, EVAS_HINT_FILL, 0.4);
+  evas_object_show(box);
+
+  Evas_Object *entry = elm_entry_add(box);
+  elm_entry_single_line_set(entry, EINA_TRUE);
+  elm_entry_scrollable_set(entry, EINA_TRUE);
+  elm_object_part_text_set(entry, "elm.guide", "Search");
+  elm_entry_input_panel_return_key_type_set(entry, ELM_INPUT_PANEL_RETURN_KEY_TYPE_SEARCH);
+  evas_object_size_hint_weight_set(entry, EVAS_HINT_EXPAND, 0);
+  evas_object_size_hint_align_set(entry, EVAS_HINT_FILL, 0.5);
+
+  char *markup = elm_entry_utf8_to_markup(md->query);
+  elm_entry_entry_set(entry, markup);
+  free(markup);
+  elm_entry_cursor_end_set(entry);
+
+  evas_object_smart_callback_add(entry, "changed,user", menu_search_changed_cb, ad);
+  evas_object_smart_callback_add(entry, "activated", menu_search_activated_cb, ad);
+  evas_object_show(entry);
+  elm_box_pack_end(box, entry);
+
+  md->search_count = elm_label_add(box);
+  snprintf(label, 255, SEARCH_LABEL, md->query[0] == '\0' ? md->rows->len : md->matches->len);
+  elm_object_text_set(md->search_count, label);
+  evas_object_show(md->search_count);
+  elm_box_pack_end(box, md->search_count);
+
+  Elm_Object_Item *nf_it = elm_naviframe_item_push(ad->nf, NULL, NULL, NULL, box, "empty");
+  elm_naviframe_item_pop_cb_set(nf_it, menu_search_pop_cb, ad);
+  elm_object_focus_set(entry, EINA_TRUE);
+}
+
+static void menu_items_cb(void *data, int ret, GArray *rows) {
+  appdata_s *ad = data;
+  menu_data_s *md = ad->menu;
   Evas_Object *popup = NULL, *layout = NULL;
   Elm_Genlist_Item_Class *ptc = elm_genlist_item_class_new();
-  Elm_Genlist_Item_Class *style_1text = elm_genlist_item_class_new();
-  Elm_Genlist_Item_Class *style_2text = elm_genlist_item_class_new();
+  Elm_Genlist_Item_Class *search = elm_genlist_item_class_new();
 
   ptc->item_style = "padding";
 
-  style_1text->item_style = "1text";
-  style_1text->func.text_get = menu_text_get_cb;
-	style_1text->func.del = menu_del_cb;
+  search->item_style = "1text";
+  search->func.text_get = menu_search_text_get_cb;
+
+  /* Kept for the items added back by the filter */
+  md->style_1text = elm_genlist_item_class_new();
+  md->style_1text->item_style = "1text";
+  md->style_1text->func.text_get = menu_text_get_cb;
+
+  md->style_2text = elm_genlist_item_class_new();
+  md->style_2text->item_style = "2text";
+  md->style_2text->func.text_get = menu_text_get_cb;
 
-  style_2text->item_style = "2text";
-  style_2text->func.text_get = menu_text_get_cb;
-	style_2text->func.del = menu_del_cb;
+  if (ret != SQLITE_OK)
+    dlog_print(DLOG_ERROR, LOG_TAG, "can't read entries");
 
-  db_select_all(&entries);
+  /* Only the rows are read here, the entries follow a page at a time */
+  md->rows = rows;
+  md->page_count = (rows->len + MENU_PAGE_SIZE - 1) / MENU_PAGE_SIZE;
+  md->pages = calloc(md->page_count, sizeof(menu_page_s));
+  md->items = calloc(rows->len, sizeof(menu_item_s));
 
-  if (entries == NULL) {
+  if (rows->len == 0) {
     popup = elm_popup_add(ad->nf);
     elm_object_style_set(popup, "circle");
     evas_object_size_hint_weight_set(popup, EVAS_HINT_EXPAND, EVAS_HINT_EXPAND);
@@ -94,40 +402,66 @@ void menu_items_create(appdata_s *ad) {
     goto free;
   }
 
-  elm_genlist_item_append(ad->menu->genlist, ptc, NULL, NULL, ELM_GENLIST_ITEM_NONE, NULL, NULL);
+  for (guint i = 0; i < md->page_count; i++) {
+    md->pages[i].menu = md;
+  }
 
-  entry = entries;
-  while (entry != NULL) {
-    if (entry->data != NULL) {
-      otp_info_s *payload = malloc(sizeof(otp_info_s));
-      memcpy(payload, entry->data, sizeof(otp_info_s));
-      dlog_print(DLOG_ERROR, LOG_TAG, ((otp_info_s*) entry->data)->label);
+  elm_genlist_item_append(md->genlist, ptc, NULL, NULL, ELM_GENLIST_ITEM_NONE, NULL, NULL);
+  md->search_item = elm_genlist_item_append(md->genlist, search, md, NULL, ELM_GENLIST_ITEM_NONE,
+                                            menu_search_cb, ad);
 
-      Elm_Genlist_Item_Class *class;
-      if (strchr(payload->label, ':')) {
-        class = style_2text;
-      } else {
-        class = style_1text;
-      }
+  for (guint i = 0; i < rows->len; i++) {
+    menu_item_s *item = &md->items[i];
 
-      elm_genlist_item_append(
-          ad->menu->genlist, // genlist object
-          class,    // item class
-          payload,  // data
-          NULL,
-          ELM_GENLIST_ITEM_NONE,
-          menu_sel_cb,
-          ad);
+    Elm_Genlist_Item_Class *class;
+    if (g_array_index(rows, db_row_s, i).issuer) {
+      class = md->style_2text;
+    } else {
+      class = md->style_1text;
     }
-    entry = g_list_next(entry);
+
+    item->page = &md->pages[i / MENU_PAGE_SIZE];
+    item->it = elm_genlist_item_append(
+        md->genlist, // genlist object
+        class,    // item class
+        item,     // data
+        NULL,
+        ELM_GENLIST_ITEM_NONE,
+        menu_sel_cb,
+        ad);
   }
 
-  elm_genlist_item_append(ad->menu->genlist, ptc, NULL, NULL, ELM_GENLIST_ITEM_NONE, NULL, NULL);
+  elm_genlist_item_append(md->genlist, ptc, NULL, NULL, ELM_GENLIST_ITEM_NONE, NULL, NULL);
+
+  db_search_index_async(menu_index_cb, ad);
 
 free:
-  elm_genlist_item_class_free(style_1text);
-  elm_genlist_item_class_free(style_2text);
-  g_list_free_full(entries, free);
+#ifdef OTP_PROFILE
+  startup_mark("list populated");
+#endif
+  elm_genlist_item_class_free(ptc);
+  elm_genlist_item_class_free(search);
+}
+
+void menu_entries_changed(appdata_s *ad, const otp_info_s *entries, guint count) {
+  menu_data_s *md = ad->menu;
+
+  /* Rows written before the index is read are in it already */
+  if (md == NULL || md->index == NULL) return;
+
+  for (guint i = 0; i < count; i++) {
+    if (entries[i].deleted)
+      search_index_remove(md->index, entries[i].id);
+    else if (!search_index_update(md->index, entries[i].id, otp_label(&entries[i]), otp_label_len(&entries[i])))
+      dlog_print(DLOG_ERROR, LOG_TAG, "can't index entry %d", entries[i].id);
+  }
+
+  if (md->query[0] != '\0')
+    menu_filter_apply(ad);
+}
+
+void menu_items_create(appdata_s *ad) {
+  db_select_rows_async(menu_items_cb, ad);
 }
 
 void menu_create(appdata_s *ad) {
@@ -139,6 +473,12 @@ void menu_create(appdata_s *ad) {
   elm_genlist_mode_set(md->genlist, ELM_LIST_COMPRESS);
   elm_object_style_set(md->genlist, "focus_bg");
 	evas_object_smart_callback_add(md->genlist, "longpressed", menu_longpressed_cb, NULL);
+  evas_object_smart_callback_add(md->genlist, "realized", menu_realized_cb, md);
+  evas_object_smart_callback_add(md->genlist, "unrealized", menu_unrealized_cb, md);
+
+  g_queue_init(&md->idle_pages);
+  md->query = strdup("");
+  md->matches = g_array_new(FALSE, FALSE, sizeof(int));
 
   md->circle_genlist = eext_circle_object_genlist_add(md->genlist, ad->circle_surface);
   eext_circle_object_genlist_scroller_policy_set(md->circle_genlist, ELM_SCROLLER_POLICY_OFF, ELM_SCROLLER_POLICY_AUTO);
@@ -153,7 +493,7 @@ void menu_create(appdata_s *ad) {
   menu_items_create(ad);
 
   nf_it = elm_naviframe_item_push(ad->nf, NULL, btn, NULL, ad->menu->genlist, "empty");
-  elm_naviframe_item_pop_cb_set(nf_it, menu_pop_cb, ad->win);
+  elm_naviframe_item_pop_cb_set(nf_it, menu_pop_cb, ad);
 }
 
 
@@ -1,109 +1,80 @@
 #include <app.h>
 #include <system_settings.h>
 #include <dlog.h>
-#include <json-glib.h>
 #include "otp.h"
 #include "database.h"
+#include "db_worker.h"
 #include "sap.h"
+#include "import.h"
+#ifdef OTP_PROFILE
+#include "util/trace.h"
+#endif
 
-void add_entry(char *data) {
-  JsonParser *parser = json_parser_new();
-  GError *error = NULL;
+/* Socket of the unix transport in the data directory of the app */
+#define LOCAL_SOCKET_NAME "otp.sock"
 
-  json_parser_load_from_data(parser, data, strlen(data), &error);
-  if (error != NULL) {
-    dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() json parser failed: %s", error);
-    g_error_free(error);
-    goto end;
-  }
+static void _transport_replied(void *data, const gchar *reply, gsize reply_length, const GArray *changed) {
+  transport_s *transport = data;
 
-  JsonNode *root = json_parser_get_root(parser);
-  if (!(root != NULL && JSON_NODE_TYPE(root) == JSON_NODE_OBJECT)) {
-    dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() got wrong json");
-    goto end;
-  }
+  if (changed != NULL) menu_entries_changed(transport->data, (const otp_info_s *) changed->data, changed->len);
+  if (reply != NULL) transport_send(transport, reply, reply_length);
+}
 
-  JsonObject *object;
-  object = json_node_get_object(root);
-  if (object == NULL) {
-    dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() empty json object");
-    goto end;
-  }
+static void _transport_received(transport_s *transport, const char *buffer, unsigned int length, void *data) {
+  appdata_s *ad = data;
 
-  guint size = json_object_get_size(object);
-
-  GList *keys = json_object_get_members(object);
-  GList *values = json_object_get_values(object);
-  GList *keys_c = keys;
-  GList *values_c = values;
-
-  otp_info_s result = {0};
-
-  for (int i = 0; i < size; i++) {
-    if (keys_c) {
-      gchar *key = (gchar*)(keys_c->data);
-
-      if (values_c) {
-        JsonNode *value = (JsonNode*)(values_c->data);
-
-        if (!(value != NULL && JSON_NODE_TYPE(value) == JSON_NODE_VALUE)) {
-          dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-          goto free;
-        }
-
-        if (strcmp(key, "type") == 0) {
-          const gchar *type = json_node_get_string(value);
-          if (type == NULL) {
-            dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-            goto free;
-          }
-          if (strcmp(type, "TOTP") == 0) result.type = TOTP;
-          else if (strcmp(type, "HOTP") == 0) result.type = HOTP;
-        } else if (strcmp(key, "counter") == 0) {
-          result.counter = json_node_get_int(value);
-        } else if (strcmp(key, "label") == 0) {
-          const gchar *label = json_node_get_string(value);
-          if (label == NULL) {
-            dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-            goto free;
-          }
-          strncpy(result.label, label, 254);
-        } else if (strcmp(key, "secret") == 0) {
-          const gchar *secret = json_node_get_string(value);
-          if (secret == NULL) {
-            dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-            goto free;
-          }
-          strncpy(result.secret, secret, 254);
-        }
-      } else {
-        dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-        goto free;
-      }
-    } else {
-      dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-      goto free;
-    }
-
-    keys_c = g_list_next(keys_c);
-    values_c = g_list_next(values_c);
+  /* Messages are not interleaved across transports */
+  if (ad->receiving != transport) {
+    add_entries_reset();
+    ad->receiving = transport;
   }
 
-  if (result.label[0] != '\0' && result.secret[0] != '\0') {
-    dlog_print(DLOG_DEBUG, LOG_TAG, "add_entry() adding new entry to database");
-    db_insert(&result);
-  } else {
-    dlog_print(DLOG_ERROR, LOG_TAG, "add_entry() wrong json object");
-    goto free;
+  if (add_entries(buffer, length, _transport_replied, transport))
+    ad->receiving = NULL;
+}
+
+static void _transport_terminated(transport_s *transport, void *data) {
+  appdata_s *ad = data;
+
+  if (ad->receiving == transport) {
+    add_entries_reset();
+    ad->receiving = NULL;
   }
+}
 
-free:
-  if (keys   != NULL) g_list_free(keys);
-  if (values != NULL) g_list_free(values);
-end:
-  g_object_unref(parser);
+#ifdef OTP_PROFILE
+void startup_mark(const char *phase)
+{
+  char line[128];
 
-  return;
+  trace_mark(phase, line, sizeof(line));
+  dlog_print(DLOG_INFO, LOG_TAG, "%s", line);
+}
+#endif
+
+static void transports_create(appdata_s *ad)
+{
+  const transport_cbs_s cbs = {
+    .received   = _transport_received,
+    .terminated = _transport_terminated,
+  };
+
+  ad->sap = transport_sap_new(&cbs, ad);
+  transport_start(ad->sap);
+
+#ifdef OTP_TRANSPORT_UNIX
+  char *data_path = app_get_data_path();
+  gchar *path = g_strconcat(data_path, LOCAL_SOCKET_NAME, NULL);
+
+  ad->local = transport_unix_new(path, &cbs, ad);
+  if (!transport_start(ad->local)) {
+    transport_free(ad->local);
+    ad->local = NULL;
+  }
+
+  g_free(path);
+  free(data_path);
+#endif
 }
 
 static void win_delete_request_cb(void *data, Evas_Object *obj, void *event_info)
@@ -158,6 +129,40 @@ static void base_ui_create(appdata_s *ad)
   eext_object_event_callback_add(ad->nf, EEXT_CALLBACK_MORE, eext_naviframe_more_cb, NULL);
 }
 
+static void transports_start(appdata_s *ad)
+{
+  if (ad->db_ready && ad->shown && ad->sap == NULL)
+    transports_create(ad);
+}
+
+static void db_ready_cb(void *data, int ret)
+{
+  appdata_s *ad = data;
+
+  if (ret != SQLITE_OK)
+    dlog_print(DLOG_ERROR, LOG_TAG, "can't open the database");
+
+#ifdef OTP_PROFILE
+  startup_mark("db ready");
+#endif
+  /* Imports only come in once the entries can be stored */
+  ad->db_ready = ret == SQLITE_OK;
+  transports_start(ad);
+}
+
+static void first_frame_cb(void *data, Evas *e, void *event_info)
+{
+  appdata_s *ad = data;
+
+  evas_event_callback_del(e, EVAS_CALLBACK_RENDER_POST, first_frame_cb);
+
+#ifdef OTP_PROFILE
+  startup_mark("first frame");
+#endif
+  ad->shown = TRUE;
+  transports_start(ad);
+}
+
 static bool app_create(void *data)
 {
   /* Hook to take necessary actions before main event loop starts
@@ -166,11 +171,16 @@ static bool app_create(void *data)
     If this function returns false, the application is terminated */
   appdata_s *ad = data;
 
-  initialize_sap();
+  /* The schema is checked on the db worker, the reads of the menu are
+   * queued behind it */
+  db_init_async(db_ready_cb, ad);
 
   base_ui_create(ad);
   menu_create(ad);
 
+  /* The transports are started after the first frame */
+  evas_event_callback_add(evas_object_evas_get(ad->win), EVAS_CALLBACK_RENDER_POST, first_frame_cb, ad);
+
   /* Show window after base gui is set up */
   evas_object_show(ad->win);
 
@@ -184,7 +194,8 @@ static void app_control(app_control_h app_control, void *data)
 
 static void app_pause(void *data)
 {
-  /* Take necessary actions when application becomes invisible. */
+  appdata_s *ad = (appdata_s *) data;
+  code_view_pause(ad->current_cvd);
 }
 
 static void app_resume(void *data)
@@ -196,6 +207,13 @@ static void app_resume(void *data)
 static void app_terminate(void *data)
 {
   /* Release all resources. */
+  appdata_s *ad = data;
+
+  transport_free(ad->local);
+  transport_free(ad->sap);
+  add_entries_reset();
+  db_worker_stop();
+  db_close();
 }
 
 static void ui_app_lang_changed(app_event_info_h event_info, void *label_data)
@@ -237,7 +255,10 @@ int main(int argc, char *argv[])
   ui_app_lifecycle_callback_s event_callback = {0};
   app_event_handler_h handlers[5] = {NULL};
 
-  db_init();
+#ifdef OTP_PROFILE
+  trace_start();
+  startup_mark("main");
+#endif
 
   event_callback.create = app_create;
   event_callback.terminate = app_terminate;
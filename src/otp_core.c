@@ -0,0 +1,375 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util/base32.h"
+#include "util/hash.h"
+#include "util/hmac.h"
+#include "util/secure_mem.h"
+#include "otp_core.h"
+
+_Static_assert(sizeof(otp_info_s) <= 64, "otp_info_s should fit in a cache line");
+
+static secure_arena_s key_arena = SECURE_ARENA_INIT(sizeof(otp_key_s));
+/* Labels live as long as the process, only distinct strings are kept */
+static strpool_s label_pool = STRPOOL_INIT;
+/* Entries without a key behave like the empty key did before */
+static HMAC_CTX empty_hmac[HASH_ALGO_COUNT];
+static pthread_once_t empty_hmac_once = PTHREAD_ONCE_INIT;
+
+static void _empty_hmac_init(void) {
+  for (int algo = 0; algo < HASH_ALGO_COUNT; algo++) {
+    hmac_init(&empty_hmac[algo], algo, NULL, 0);
+  }
+}
+
+static hash_algo_e _algorithm(const otp_info_s *entry) {
+  return hash_backend(entry->algorithm) != NULL ? entry->algorithm : HASH_SHA1;
+}
+
+static otp_key_s *_key_slot(otp_info_s *entry) {
+  if (entry->key == NULL) {
+    entry->key = secure_arena_alloc(&key_arena);
+  }
+  return entry->key;
+}
+
+static void _key_schedule(otp_info_s *entry) {
+  hmac_init(&entry->key->hmac, _algorithm(entry), entry->key->bytes, entry->key->len);
+}
+
+int otp_set_secret(otp_info_s *entry, const char *secret) {
+  if (secret == NULL || strlen(secret) > OTP_SECRET_MAX_LEN) {
+    otp_info_clear(entry);
+    return false;
+  }
+
+  otp_key_s *key = _key_slot(entry);
+  if (key == NULL) {
+    return false;
+  }
+
+  key->len = base32_decode((const uint8_t *) secret, key->bytes, OTP_KEY_SIZE);
+
+  if (key->len < 1) {
+    otp_info_clear(entry);
+    return false;
+  }
+  _key_schedule(entry);
+
+  return true;
+}
+
+int otp_set_key(otp_info_s *entry, const uint8_t *bytes, int len) {
+  if (len < 1 || len > OTP_KEY_SIZE) {
+    otp_info_clear(entry);
+    return false;
+  }
+
+  otp_key_s *key = _key_slot(entry);
+  if (key == NULL) {
+    return false;
+  }
+
+  memcpy(key->bytes, bytes, len);
+  key->len = len;
+  _key_schedule(entry);
+
+  return true;
+}
+
+void otp_set_algorithm(otp_info_s *entry, hash_algo_e algorithm) {
+  entry->algorithm = hash_backend(algorithm) != NULL ? algorithm : HASH_SHA1;
+
+  if (entry->key != NULL) {
+    _key_schedule(entry);
+  }
+}
+
+int otp_get_secret(const otp_info_s *entry, char *secret, int size) {
+  if (entry->key == NULL) {
+    return -1;
+  }
+  return base32_encode(entry->key->bytes, entry->key->len, (uint8_t *) secret, size);
+}
+
+int otp_set_label(otp_info_s *entry, const char *label, size_t len) {
+  if (len > OTP_LABEL_MAX_LEN) {
+    len = OTP_LABEL_MAX_LEN;
+  }
+
+  const char *colon = memchr(label, ':', len);
+
+  entry->label = strpool_intern(&label_pool, label, len);
+  if (colon != NULL) {
+    entry->issuer = strpool_intern(&label_pool, label, colon - label);
+    entry->account = strpool_intern(&label_pool, colon + 1, len - (colon - label) - 1);
+  } else {
+    entry->issuer = NULL;
+    entry->account = entry->label;
+  }
+
+  return entry->label != NULL && entry->account != NULL && (colon == NULL || entry->issuer != NULL);
+}
+
+void otp_info_clear(otp_info_s *entry) {
+  secure_arena_free(&key_arena, entry->key);
+  entry->key = NULL;
+}
+
+void otp_info_free(void *entry) {
+  if (entry == NULL) return;
+
+  otp_info_clear(entry);
+  secure_wipe(entry, sizeof(otp_info_s));
+  free(entry);
+}
+
+otp_info_s *otp_list_add(otp_list_s *list) {
+  if (list->count == list->capacity) {
+    const int capacity = list->capacity ? list->capacity * 2 : 16;
+    otp_info_s *entries = realloc(list->entries, capacity * sizeof(otp_info_s));
+
+    if (entries == NULL) {
+      return NULL;
+    }
+    list->entries = entries;
+    list->capacity = capacity;
+  }
+
+  otp_info_s *entry = &list->entries[list->count++];
+  memset(entry, 0, sizeof(*entry));
+
+  return entry;
+}
+
+void otp_list_clear(otp_list_s *list) {
+  for (int i = 0; i < list->count; ++i) {
+    otp_info_clear(&list->entries[i]);
+  }
+  secure_wipe(list->entries, list->count * sizeof(otp_info_s));
+  free(list->entries);
+
+  list->entries = NULL;
+  list->count = 0;
+  list->capacity = 0;
+}
+
+void otp_list_free(otp_list_s *list) {
+  if (list == NULL) return;
+
+  otp_list_clear(list);
+  free(list);
+}
+
+const HMAC_CTX *otp_get_hmac(const otp_info_s *entry) {
+  if (entry->key == NULL) {
+    pthread_once(&empty_hmac_once, _empty_hmac_init);
+    return &empty_hmac[_algorithm(entry)];
+  }
+
+  return &entry->key->hmac;
+}
+
+static unsigned int _truncate(const uint8_t *hash, int hashLength) {
+  const int offset = hash[hashLength - 1] & 0xF;
+  unsigned int truncatedHash = 0;
+  for (int i = 0; i < 4; ++i) {
+    truncatedHash <<= 8;
+    truncatedHash  |= hash[offset + i];
+  }
+  return truncatedHash & 0x7FFFFFFF;
+}
+
+int otp_digits(const otp_info_s *entry) {
+  if (entry->digits < OTP_MIN_DIGITS || entry->digits > OTP_MAX_DIGITS) {
+    return OTP_DEFAULT_DIGITS;
+  }
+  return entry->digits;
+}
+
+int otp_period(const otp_info_s *entry) {
+  return entry->period > 0 ? entry->period : OTP_DEFAULT_PERIOD;
+}
+
+/* Every case divides by a constant, so the compiler replaces the division
+ * with a multiply and shift. The truncated hash is below 2^31, so ten digit
+ * codes need no reduction at all. */
+static inline unsigned int _reduce(unsigned int truncatedHash, int digits) {
+  switch (digits) {
+  case 7:  return truncatedHash % 10000000u;
+  case 8:  return truncatedHash % 100000000u;
+  case 9:  return truncatedHash % 1000000000u;
+  case 10: return truncatedHash;
+  default: return truncatedHash % 1000000u;
+  }
+}
+
+int otp_compute_code(const HMAC_CTX *hmac, uint64_t value, int digits) {
+  uint8_t val[8];
+  for (int i = 8; i--; value >>= 8) {
+    val[i] = value;
+  }
+  const int hashLength = hmac->hash->digest_length;
+  uint8_t hash[HASH_MAX_DIGEST_LENGTH];
+  hmac_compute(hmac, val, 8, hash, hashLength);
+  secure_wipe(val, sizeof(val));
+  unsigned int truncatedHash = _truncate(hash, hashLength);
+  secure_wipe(hash, sizeof(hash));
+  return _reduce(truncatedHash, digits);
+}
+
+/* Batches are split into chunks so the lane arrays stay on the stack */
+#define OTP_BATCH_CHUNK 64
+
+void otp_compute_codes(otp_info_s *const *entries, const uint64_t *values, int *codes, int count) {
+  const HMAC_CTX *ctx[OTP_BATCH_CHUNK];
+  uint64_t counters[OTP_BATCH_CHUNK];
+  uint32_t truncated[OTP_BATCH_CHUNK];
+  int index[OTP_BATCH_CHUNK];
+
+  for (int i = 0; i < count; i += OTP_BATCH_CHUNK) {
+    const int n = count - i < OTP_BATCH_CHUNK ? count - i : OTP_BATCH_CHUNK;
+    int lanes = 0;
+
+    /* SHA1 entries go through the SIMD lanes, the rest one by one */
+    for (int j = 0; j < n; ++j) {
+      const HMAC_CTX *hmac = otp_get_hmac(entries[i + j]);
+      if (hmac->hash->algo == HASH_SHA1) {
+        ctx[lanes] = hmac;
+        counters[lanes] = values[i + j];
+        index[lanes++] = i + j;
+      } else {
+        codes[i + j] = otp_compute_code(hmac, values[i + j], otp_digits(entries[i + j]));
+      }
+    }
+    hmac_sha1_batch_truncated(ctx, counters, truncated, lanes);
+    for (int j = 0; j < lanes; ++j) {
+      codes[index[j]] = _reduce(truncated[j], otp_digits(entries[index[j]]));
+    }
+  }
+
+  secure_wipe(counters, sizeof(counters));
+  secure_wipe(truncated, sizeof(truncated));
+}
+
+int otp_totp_code(otp_info_s *entry, time_t now, int skew, int *expires) {
+  const int period = otp_period(entry);
+  if (expires != NULL) {
+    *expires = period - now % period;
+  }
+  return otp_compute_code(otp_get_hmac(entry), (now / period) + skew, otp_digits(entry));
+}
+
+int otp_hotp_code(otp_info_s *entry, uint64_t counter) {
+  return otp_compute_code(otp_get_hmac(entry), counter, otp_digits(entry));
+}
+
+/* Candidates of a verification window are evaluated in groups as wide as
+ * the SIMD lanes, so a SHA1 window costs one batch call per group and the
+ * search still stops at the first group holding a match. */
+#define OTP_WINDOW_LANES 16
+
+typedef struct otp_window {
+  const HMAC_CTX *hmac;
+  int      code;
+  int      digits;
+  int      lanes;
+  int      count;
+  uint64_t values[OTP_WINDOW_LANES];
+  int64_t  offsets[OTP_WINDOW_LANES];
+  int      found;
+  int64_t  match;
+} otp_window_s;
+
+static void _window_init(otp_window_s *w, otp_info_s *entry, int code) {
+  memset(w, 0, sizeof(*w));
+  w->hmac = otp_get_hmac(entry);
+  w->code = code;
+  w->digits = otp_digits(entry);
+  w->lanes = 1;
+  if (w->hmac->hash->algo == HASH_SHA1) {
+    w->lanes = hmac_sha1_batch_lanes();
+    if (w->lanes > OTP_WINDOW_LANES) {
+      w->lanes = OTP_WINDOW_LANES;
+    }
+  }
+}
+
+static int _window_flush(otp_window_s *w) {
+  if (w->count == 0 || w->found) {
+    return w->found;
+  }
+
+  int codes[OTP_WINDOW_LANES];
+  if (w->lanes > 1) {
+    const HMAC_CTX *ctx[OTP_WINDOW_LANES];
+    uint32_t truncated[OTP_WINDOW_LANES];
+    for (int i = 0; i < w->count; ++i) {
+      ctx[i] = w->hmac;
+    }
+    hmac_sha1_batch_truncated(ctx, w->values, truncated, w->count);
+    for (int i = 0; i < w->count; ++i) {
+      codes[i] = _reduce(truncated[i], w->digits);
+    }
+    secure_wipe(truncated, sizeof(truncated));
+  } else {
+    codes[0] = otp_compute_code(w->hmac, w->values[0], w->digits);
+  }
+
+  /* Every code of the group is compared, without branching on the result */
+  for (int i = 0; i < w->count; ++i) {
+    const int64_t hit = -(int64_t) (secure_equal_u32(codes[i], w->code) & !w->found);
+    w->match = (w->offsets[i] & hit) | (w->match & ~hit);
+    w->found |= (int) (hit & 1);
+  }
+  w->count = 0;
+  secure_wipe(codes, sizeof(codes));
+
+  return w->found;
+}
+
+static int _window_push(otp_window_s *w, uint64_t value, int64_t offset) {
+  w->values[w->count] = value;
+  w->offsets[w->count++] = offset;
+  if (w->count == w->lanes) {
+    return _window_flush(w);
+  }
+  return 0;
+}
+
+int otp_totp_verify(otp_info_s *entry, int code, time_t now, int behind, int ahead, int *offset) {
+  const uint64_t step = now / otp_period(entry);
+  const int width = behind > ahead ? behind : ahead;
+  otp_window_s w;
+
+  _window_init(&w, entry, code);
+
+  /* Closest steps first: 0, -1, +1, -2, +2, ... */
+  for (int d = 0; d <= width && !w.found; ++d) {
+    if (d <= ahead && _window_push(&w, step + d, d)) break;
+    if (d > 0 && d <= behind && (uint64_t) d <= step && _window_push(&w, step - d, -d)) break;
+  }
+  _window_flush(&w);
+
+  if (w.found && offset != NULL) {
+    *offset = (int) w.match;
+  }
+  return w.found;
+}
+
+int otp_hotp_verify(otp_info_s *entry, int code, uint64_t counter, int look_ahead, uint64_t *next_counter) {
+  otp_window_s w;
+
+  _window_init(&w, entry, code);
+
+  for (int d = 0; d <= look_ahead; ++d) {
+    if (_window_push(&w, counter + d, d)) break;
+  }
+  _window_flush(&w);
+
+  if (w.found && next_counter != NULL) {
+    *next_counter = counter + w.match + 1;
+  }
+  return w.found;
+}
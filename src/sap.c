@@ -1,27 +1,36 @@
 #include <glib.h>
 #include <dlog.h>
 #include <sap_client/sap.h>
+#include <Ecore.h>
 #include "sap.h"
 #include "otp.h"
+#include "transport.h"
 
 #define ACC_ASPID "/nabam/otp"
 #define ACC_CHANNELID 104
 
+/* Delay before retrying sap_agent_initialize(), doubled after every failure */
+#define AGENT_RETRY_MIN 0.5
+#define AGENT_RETRY_MAX 30.0
+
 struct priv {
   sap_agent_h agent;
   sap_socket_h socket;
   sap_peer_agent_h peer_agent;
+  Ecore_Timer *retry_timer;
+  double retry_delay;
 };
 
-static gboolean agent_created = FALSE;
-
-static struct priv priv_data = { 0 };
+static gboolean agent_initialize(transport_s *transport);
 
 static void on_service_connection_terminated(sap_peer_agent_h peer_agent,
                sap_socket_h socket,
                sap_service_connection_terminated_reason_e result,
                void *user_data)
 {
+  transport_s *transport = user_data;
+  struct priv *priv = transport->priv;
+
   switch (result) {
   case SAP_CONNECTION_TERMINATED_REASON_PEER_DISCONNECTED:
     dlog_print(DLOG_INFO, LOG_TAG, "disconnected because peer lost");
@@ -36,8 +45,11 @@ static void on_service_connection_terminated(sap_peer_agent_h peer_agent,
     break;
   }
 
-  sap_socket_destroy(priv_data.socket);
-  priv_data.socket = NULL;
+  sap_socket_destroy(priv->socket);
+  priv->socket = NULL;
+
+  if (transport->cbs.terminated)
+    transport->cbs.terminated(transport, transport->data);
 
   dlog_print(DLOG_INFO, LOG_TAG, "status:%d", result);
 }
@@ -49,9 +61,10 @@ static void on_data_recieved(sap_socket_h socket,
            void *buffer,
            void *user_data)
 {
-  add_entry(buffer);
+  transport_s *transport = user_data;
 
-  sap_socket_send_data(priv_data.socket, ACC_CHANNELID, payload_length, buffer);
+  if (transport->cbs.received)
+    transport->cbs.received(transport, buffer, payload_length, transport->data);
 }
 
 static void on_service_connection_requested(sap_peer_agent_h peer_agent,
@@ -59,31 +72,42 @@ static void on_service_connection_requested(sap_peer_agent_h peer_agent,
               sap_service_connection_result_e result,
               void *user_data)
 {
-  priv_data.socket = socket;
-  priv_data.peer_agent = peer_agent;
+  transport_s *transport = user_data;
+  struct priv *priv = transport->priv;
+
+  priv->socket = socket;
+  priv->peer_agent = peer_agent;
 
   sap_peer_agent_set_service_connection_terminated_cb
-    (priv_data.peer_agent, on_service_connection_terminated, user_data);
+    (priv->peer_agent, on_service_connection_terminated, transport);
 
-  sap_socket_set_data_received_cb(socket, on_data_recieved, peer_agent);
+  sap_socket_set_data_received_cb(socket, on_data_recieved, transport);
 
   sap_peer_agent_accept_service_connection(peer_agent);
+
+  if (transport->cbs.connected)
+    transport->cbs.connected(transport, transport->data);
 }
 
 static void on_agent_initialized(sap_agent_h agent,
          sap_agent_initialized_result_e result,
          void *user_data)
 {
+  transport_s *transport = user_data;
+  struct priv *priv = transport->priv;
+
   switch (result) {
   case SAP_AGENT_INITIALIZED_RESULT_SUCCESS:
     dlog_print(DLOG_INFO, LOG_TAG, "agent is initialized");
 
     sap_agent_set_service_connection_requested_cb(agent,
                     on_service_connection_requested,
-                    NULL);
+                    transport);
 
-    priv_data.agent = agent;
-    agent_created = TRUE;
+    priv->agent = agent;
+#ifdef OTP_PROFILE
+    startup_mark("sap ready");
+#endif
     break;
 
   case SAP_AGENT_INITIALIZED_RESULT_DUPLICATED:
@@ -110,6 +134,9 @@ static void on_agent_initialized(sap_agent_h agent,
 static void on_device_status_changed(sap_device_status_e status, sap_transport_type_e transport_type,
              void *user_data)
 {
+  transport_s *transport = user_data;
+  struct priv *priv = transport->priv;
+
   switch (transport_type) {
   case SAP_TRANSPORT_TYPE_BT:
     dlog_print(DLOG_INFO, LOG_TAG, "connectivity type(%d): bt", transport_type);
@@ -139,12 +166,14 @@ static void on_device_status_changed(sap_device_status_e status, sap_transport_t
   switch (status) {
   case SAP_DEVICE_STATUS_DETACHED:
 
-    if (priv_data.peer_agent) {
-      sap_socket_destroy(priv_data.socket);
-      priv_data.socket = NULL;
-      sap_peer_agent_destroy(priv_data.peer_agent);
-      priv_data.peer_agent = NULL;
+    if (priv->peer_agent) {
+      sap_socket_destroy(priv->socket);
+      priv->socket = NULL;
+      sap_peer_agent_destroy(priv->peer_agent);
+      priv->peer_agent = NULL;
 
+      if (transport->cbs.terminated)
+        transport->cbs.terminated(transport, transport->data);
     }
 
     break;
@@ -158,34 +187,107 @@ static void on_device_status_changed(sap_device_status_e status, sap_transport_t
   }
 }
 
-gboolean agent_initialize()
+static Eina_Bool agent_retry_cb(void *data)
 {
-  int result = 0;
+  transport_s *transport = data;
+  struct priv *priv = transport->priv;
 
-  do {
-    result = sap_agent_initialize(priv_data.agent, ACC_ASPID, SAP_AGENT_ROLE_PROVIDER,
-                on_agent_initialized, NULL);
+  priv->retry_timer = NULL;
+  agent_initialize(transport);
 
-    dlog_print(DLOG_INFO, LOG_TAG, "SAP >>> getRegisteredServiceAgent() >>> %d", result);
-  } while (result != SAP_RESULT_SUCCESS);
+  return ECORE_CALLBACK_CANCEL;
+}
 
-  return TRUE;
+/* Registers the service agent, failures are retried from the main loop
+ * with an exponential backoff */
+static gboolean agent_initialize(transport_s *transport)
+{
+  struct priv *priv = transport->priv;
+  int result = sap_agent_initialize(priv->agent, ACC_ASPID, SAP_AGENT_ROLE_PROVIDER,
+                on_agent_initialized, transport);
+
+  dlog_print(DLOG_INFO, LOG_TAG, "SAP >>> getRegisteredServiceAgent() >>> %d", result);
+
+  if (result == SAP_RESULT_SUCCESS) {
+    priv->retry_delay = AGENT_RETRY_MIN;
+    return TRUE;
+  }
+
+  priv->retry_timer = ecore_timer_add(priv->retry_delay, agent_retry_cb, transport);
+  priv->retry_delay *= 2;
+  if (priv->retry_delay > AGENT_RETRY_MAX)
+    priv->retry_delay = AGENT_RETRY_MAX;
+
+  return FALSE;
 }
 
-void initialize_sap()
+static gboolean sap_start(transport_s *transport)
 {
+  struct priv *priv = transport->priv;
   sap_agent_h agent = NULL;
 
   sap_agent_create(&agent);
 
-  if (agent == NULL)
+  if (agent == NULL) {
     dlog_print(DLOG_ERROR, LOG_TAG, "ERROR in creating agent");
-  else
-    dlog_print(DLOG_INFO, LOG_TAG, "SUCCESSFULLY create sap agent");
+    return FALSE;
+  }
+
+  dlog_print(DLOG_INFO, LOG_TAG, "SUCCESSFULLY create sap agent");
+
+  priv->agent = agent;
+  priv->retry_delay = AGENT_RETRY_MIN;
 
-  priv_data.agent = agent;
+  sap_set_device_status_changed_cb(on_device_status_changed, transport);
+
+  agent_initialize(transport);
+
+  return TRUE;
+}
+
+static gboolean sap_send(transport_s *transport, const void *buffer, unsigned int length)
+{
+  struct priv *priv = transport->priv;
+
+  if (priv->socket == NULL)
+    return FALSE;
+
+  return sap_socket_send_data(priv->socket, ACC_CHANNELID, length, (void *) buffer) == SAP_RESULT_SUCCESS;
+}
+
+static void sap_stop(transport_s *transport)
+{
+  struct priv *priv = transport->priv;
+
+  if (priv->retry_timer)
+    ecore_timer_del(priv->retry_timer);
+
+  if (priv->socket)
+    sap_socket_destroy(priv->socket);
+  if (priv->peer_agent)
+    sap_peer_agent_destroy(priv->peer_agent);
+  if (priv->agent)
+    sap_agent_destroy(priv->agent);
+
+  g_free(priv);
+  transport->priv = NULL;
+}
+
+static const transport_ops_s sap_ops = {
+  .name  = "sap",
+  .start = sap_start,
+  .send  = sap_send,
+  .stop  = sap_stop,
+};
+
+transport_s *transport_sap_new(const transport_cbs_s *cbs, void *data)
+{
+  transport_s *transport = g_new0(transport_s, 1);
 
-  sap_set_device_status_changed_cb(on_device_status_changed, NULL);
+  transport->ops = &sap_ops;
+  transport->cbs = *cbs;
+  transport->data = data;
+  transport->priv = g_new0(struct priv, 1);
 
-  agent_initialize();
+  return transport;
 }
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+#include "search_index.h"
+#include "util/strpool.h"
+
+/* Longest word kept, longer words are indexed by their beginning */
+#define SEARCH_WORD_MAX 64
+
+typedef struct search_word {
+  const strpool_str_s *word;
+  int                 id;
+} search_word_s;
+
+struct search_index {
+  /* Lower case words, shared by the labels having them */
+  strpool_s     pool;
+  search_word_s *words;
+  size_t        count;
+  size_t        capacity;
+  /* Words before sorted are in order. Words added since are appended, the
+   * next query sorts them and merges them in. */
+  size_t        sorted;
+};
+
+static gboolean _is_word_char(unsigned char c) {
+  /* Bytes of UTF-8 sequences are kept within words */
+  return g_ascii_isalnum(c) || c >= 0x80;
+}
+
+/* Copies the next word of text to word in lower case and returns where it
+ * ends, or NULL once there is no word left */
+static const char *_next_word(const char *text, const char *end, char *word, size_t *length) {
+  while (text < end && !_is_word_char(*text)) text++;
+  if (text == end) return NULL;
+
+  *length = 0;
+  for (; text < end && _is_word_char(*text); text++) {
+    if (*length < SEARCH_WORD_MAX) word[(*length)++] = g_ascii_tolower(*text);
+  }
+
+  return text;
+}
+
+/* Orders by word, the shorter of two words sharing a prefix first */
+static int _compare_words(const strpool_str_s *a, const char *b, size_t b_len) {
+  const int ret = memcmp(a->data, b, MIN(a->len, b_len));
+  return ret != 0 ? ret : (a->len > b_len) - (a->len < b_len);
+}
+
+static int _compare(const void *a, const void *b) {
+  const search_word_s *x = a, *y = b;
+  const int ret = _compare_words(x->word, y->word->data, y->word->len);
+  return ret != 0 ? ret : (x->id > y->id) - (x->id < y->id);
+}
+
+static int _compare_ids(const void *a, const void *b) {
+  const int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+search_index_s *search_index_new() {
+  search_index_s *index = calloc(1, sizeof(search_index_s));
+  if (index == NULL) return NULL;
+
+  const strpool_s pool = STRPOOL_INIT;
+  index->pool = pool;
+
+  return index;
+}
+
+void search_index_free(search_index_s *index) {
+  if (index == NULL) return;
+
+  strpool_destroy(&index->pool);
+  free(index->words);
+  free(index);
+}
+
+gboolean search_index_add(search_index_s *index, int id, const char *label, size_t length) {
+  const char *end = label + length;
+  char word[SEARCH_WORD_MAX];
+  size_t word_len;
+
+  while ((label = _next_word(label, end, word, &word_len)) != NULL) {
+    if (index->count == index->capacity) {
+      const size_t capacity = index->capacity ? index->capacity * 2 : 256;
+      search_word_s *words = realloc(index->words, capacity * sizeof(search_word_s));
+      if (words == NULL) return FALSE;
+
+      index->words = words;
+      index->capacity = capacity;
+    }
+
+    const strpool_str_s *interned = strpool_intern(&index->pool, word, word_len);
+    if (interned == NULL) return FALSE;
+
+    index->words[index->count].word = interned;
+    index->words[index->count].id = id;
+    index->count++;
+  }
+
+  return TRUE;
+}
+
+void search_index_remove(search_index_s *index, int id) {
+  size_t kept = 0, sorted = 0;
+
+  /* The words left keep their order */
+  for (size_t i = 0; i < index->count; i++) {
+    if (index->words[i].id == id) continue;
+
+    if (i < index->sorted) sorted++;
+    index->words[kept++] = index->words[i];
+  }
+  index->count = kept;
+  index->sorted = sorted;
+}
+
+gboolean search_index_update(search_index_s *index, int id, const char *label, size_t length) {
+  search_index_remove(index, id);
+  return search_index_add(index, id, label, length);
+}
+
+/* Sorts the words added since the last query and merges them into the
+ * sorted ones, so a rename doesn't sort the whole index again */
+static void _sort(search_index_s *index) {
+  const size_t added = index->count - index->sorted;
+  search_word_s *words = index->words;
+
+  if (added == 0) return;
+
+  qsort(words + index->sorted, added, sizeof(search_word_s), _compare);
+
+  search_word_s *tail = index->sorted ? malloc(added * sizeof(search_word_s)) : NULL;
+  if (tail != NULL) {
+    size_t i = index->sorted, j = added, k = index->count;
+
+    memcpy(tail, words + index->sorted, added * sizeof(search_word_s));
+    while (j > 0) {
+      if (i > 0 && _compare(&words[i - 1], &tail[j - 1]) > 0) words[--k] = words[--i];
+      else words[--k] = tail[--j];
+    }
+    free(tail);
+  } else if (index->sorted) {
+    qsort(words, index->count, sizeof(search_word_s), _compare);
+  }
+
+  index->sorted = index->count;
+}
+
+/* Returns the first word not ordered before prefix */
+static size_t _lower_bound(const search_index_s *index, const char *prefix, size_t length) {
+  size_t low = 0, high = index->count;
+
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (_compare_words(index->words[mid].word, prefix, length) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+/* Sets ids to the ascending ids having a word starting with prefix */
+static void _match(const search_index_s *index, const char *prefix, size_t length, GArray *ids) {
+  g_array_set_size(ids, 0);
+
+  for (size_t i = _lower_bound(index, prefix, length); i < index->count; i++) {
+    const strpool_str_s *word = index->words[i].word;
+    if (word->len < length || memcmp(word->data, prefix, length) != 0) break;
+
+    g_array_append_val(ids, index->words[i].id);
+  }
+
+  /* Words of a prefix come in word order, a label may have several of them */
+  if (ids->len > 1) qsort(ids->data, ids->len, sizeof(int), _compare_ids);
+
+  guint unique = 0;
+  for (guint i = 0; i < ids->len; i++) {
+    if (unique == 0 || g_array_index(ids, int, i) != g_array_index(ids, int, unique - 1))
+      g_array_index(ids, int, unique++) = g_array_index(ids, int, i);
+  }
+  g_array_set_size(ids, unique);
+}
+
+/* Keeps the ids of result which are in ids, both are ascending */
+static void _intersect(GArray *result, const GArray *ids) {
+  guint kept = 0, j = 0;
+
+  for (guint i = 0; i < result->len; i++) {
+    const int id = g_array_index(result, int, i);
+
+    while (j < ids->len && g_array_index(ids, int, j) < id) j++;
+    if (j < ids->len && g_array_index(ids, int, j) == id)
+      g_array_index(result, int, kept++) = id;
+  }
+  g_array_set_size(result, kept);
+}
+
+void search_index_query(search_index_s *index, const char *query, GArray *ids) {
+  const char *end = query + strlen(query);
+  char word[SEARCH_WORD_MAX];
+  size_t word_len;
+  gboolean first = TRUE;
+
+  g_array_set_size(ids, 0);
+
+  _sort(index);
+
+  GArray *matches = g_array_new(FALSE, FALSE, sizeof(int));
+
+  while ((query = _next_word(query, end, word, &word_len)) != NULL) {
+    if (first) {
+      _match(index, word, word_len, ids);
+      first = FALSE;
+    } else {
+      _match(index, word, word_len, matches);
+      _intersect(ids, matches);
+    }
+
+    if (ids->len == 0) break;
+  }
+
+  g_array_free(matches, TRUE);
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include "wire.h"
+#include "sync.h"
+
+static void _put32(uint8_t *out, uint32_t v) {
+  out[0] = v >> 24;
+  out[1] = v >> 16;
+  out[2] = v >> 8;
+  out[3] = v;
+}
+
+static void _put64(uint8_t *out, uint64_t v) {
+  _put32(out, v >> 32);
+  _put32(out + 4, v);
+}
+
+static uint32_t _get32(const uint8_t *in) {
+  return (uint32_t) in[0] << 24 | (uint32_t) in[1] << 16 | (uint32_t) in[2] << 8 | in[3];
+}
+
+static uint64_t _get64(const uint8_t *in) {
+  return (uint64_t) _get32(in) << 32 | _get32(in + 4);
+}
+
+/* Hash of everything but the counter, which is merged separately */
+static uint32_t _content_hash(const otp_info_s *entry) {
+  uint8_t fields[12];
+
+  if (entry->deleted) {
+    static const uint8_t tombstone = 0xFF;
+    return wire_crc32(0, &tombstone, 1);
+  }
+
+  fields[0] = entry->type;
+  fields[1] = entry->algorithm;
+  fields[2] = 0;
+  fields[3] = 0;
+  _put32(fields + 4, otp_digits(entry));
+  _put32(fields + 8, otp_period(entry));
+
+  uint32_t hash = wire_crc32(0, fields, sizeof(fields));
+  hash = wire_crc32(hash, otp_label(entry), otp_label_len(entry));
+  if (entry->key != NULL) {
+    hash = wire_crc32(hash, entry->key->bytes, entry->key->len);
+  }
+
+  return hash;
+}
+
+void sync_digest(const otp_info_s *entry, sync_digest_s *digest) {
+  digest->uid     = entry->uid;
+  digest->rev     = entry->rev;
+  digest->hash    = _content_hash(entry);
+  digest->counter = entry->counter;
+  digest->deleted = entry->deleted != 0;
+}
+
+int sync_newer(const sync_digest_s *a, const sync_digest_s *b) {
+  if (a->rev != b->rev) {
+    return a->rev > b->rev;
+  }
+  /* Concurrent edits of the same revision, both sides pick the same one */
+  return a->hash > b->hash;
+}
+
+static int _compare(const void *a, const void *b) {
+  const uint64_t x = ((const sync_digest_s *) a)->uid;
+  const uint64_t y = ((const sync_digest_s *) b)->uid;
+  return (x > y) - (x < y);
+}
+
+void sync_sort(sync_digest_s *digests, size_t count) {
+  qsort(digests, count, sizeof(*digests), _compare);
+}
+
+uint32_t sync_root(const sync_digest_s *digests, size_t count) {
+  uint8_t record[SYNC_DIGEST_SIZE];
+  uint32_t root = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    sync_encode_digest(record, &digests[i]);
+    root = wire_crc32(root, record, sizeof(record));
+  }
+
+  return root;
+}
+
+void sync_plan(const sync_digest_s *local, size_t local_count,
+               const sync_digest_s *remote, size_t remote_count,
+               sync_plan_cb cb, void *data) {
+  size_t l = 0, r = 0;
+
+  while (l < local_count || r < remote_count) {
+    if (r == remote_count || (l < local_count && local[l].uid < remote[r].uid)) {
+      cb(data, SYNC_SEND, &local[l++], NULL);
+    } else if (l == local_count || remote[r].uid < local[l].uid) {
+      cb(data, SYNC_FETCH, NULL, &remote[r++]);
+    } else {
+      const sync_digest_s *a = &local[l++], *b = &remote[r++];
+
+      if (a->rev != b->rev || a->hash != b->hash) {
+        cb(data, sync_newer(a, b) ? SYNC_SEND : SYNC_FETCH, a, b);
+      }
+      if (a->counter != b->counter) {
+        cb(data, SYNC_COUNTER, a, b);
+      }
+    }
+  }
+}
+
+void sync_encode_digest(uint8_t *out, const sync_digest_s *digest) {
+  _put64(out, digest->uid);
+  _put32(out + 8, digest->rev);
+  _put32(out + 12, digest->hash);
+  _put32(out + 16, digest->counter);
+  out[20] = digest->deleted ? WIRE_FLAG_DELETED : 0;
+}
+
+void sync_decode_digest(const uint8_t *in, sync_digest_s *digest) {
+  digest->uid     = _get64(in);
+  digest->rev     = _get32(in + 8);
+  digest->hash    = _get32(in + 12);
+  digest->counter = _get32(in + 16);
+  digest->deleted = (in[20] & WIRE_FLAG_DELETED) != 0;
+}
+
+void sync_encode_summary(uint8_t *out, uint32_t root, uint32_t count) {
+  _put32(out, root);
+  _put32(out + 4, count);
+}
+
+void sync_decode_summary(const uint8_t *in, uint32_t *root, uint32_t *count) {
+  *root = _get32(in);
+  *count = _get32(in + 4);
+}
+
+void sync_encode_request(uint8_t *out, uint64_t uid) {
+  _put64(out, uid);
+}
+
+uint64_t sync_decode_request(const uint8_t *in) {
+  return _get64(in);
+}
+
+void sync_encode_counter(uint8_t *out, uint64_t uid, uint32_t counter) {
+  _put64(out, uid);
+  _put32(out + 8, counter);
+}
+
+void sync_decode_counter(const uint8_t *in, uint64_t *uid, uint32_t *counter) {
+  *uid = _get64(in);
+  *counter = _get32(in + 8);
+}
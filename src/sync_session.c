@@ -0,0 +1,221 @@
+#include <string.h>
+#include <dlog.h>
+#include "otp.h"
+#include "database.h"
+#include "wire.h"
+#include "sync_session.h"
+#include "util/secure_mem.h"
+
+/* Entries of the watch with their digests sorted by uid */
+typedef struct sync_local {
+  otp_list_s entries;
+  GArray     *digests;
+  GHashTable *by_uid;
+} sync_local_s;
+
+/* Differences found by sync_plan() */
+typedef struct sync_diff {
+  GArray *send;
+  GArray *fetch;
+  GArray *counters;
+  int    ret;
+} sync_diff_s;
+
+static int _local_load(sync_local_s *local)
+{
+  memset(&local->entries, 0, sizeof(local->entries));
+  if (db_select_sync(&local->entries) != SQLITE_OK) {
+    otp_list_clear(&local->entries);
+    return SQLITE_ERROR;
+  }
+
+  local->digests = g_array_sized_new(FALSE, FALSE, sizeof(sync_digest_s), local->entries.count);
+  local->by_uid = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+  for (int i = 0; i < local->entries.count; i++) {
+    otp_info_s *entry = &local->entries.entries[i];
+    sync_digest_s digest;
+
+    sync_digest(entry, &digest);
+    g_array_append_val(local->digests, digest);
+    g_hash_table_insert(local->by_uid, &entry->uid, entry);
+  }
+  sync_sort((sync_digest_s *) local->digests->data, local->digests->len);
+
+  return SQLITE_OK;
+}
+
+static void _local_free(sync_local_s *local)
+{
+  g_hash_table_destroy(local->by_uid);
+  g_array_free(local->digests, TRUE);
+  otp_list_clear(&local->entries);
+}
+
+/* Frames are built in place, the header is filled in by _frame_end() */
+static guint _frame_begin(GByteArray *reply)
+{
+  const guint8 header[WIRE_HEADER_SIZE] = { 0 };
+  const guint offset = reply->len;
+
+  g_byte_array_append(reply, header, sizeof(header));
+
+  return offset;
+}
+
+static void _frame_end(GByteArray *reply, guint offset, wire_type_e type, uint16_t seq)
+{
+  wire_seal(reply->data + offset, type, seq, reply->len - offset - WIRE_HEADER_SIZE);
+}
+
+static void _append_entry(GByteArray *reply, const otp_info_s *entry)
+{
+  uint8_t record[WIRE_RECORD_MAX];
+  const size_t length = wire_encode_entry(record, sizeof(record), entry);
+
+  g_byte_array_append(reply, record, length);
+  secure_wipe(record, length);
+}
+
+static void _append_summary(GByteArray *reply, const sync_local_s *local, uint16_t seq)
+{
+  uint8_t record[SYNC_SUMMARY_SIZE];
+  const guint frame = _frame_begin(reply);
+
+  sync_encode_summary(record, sync_root((const sync_digest_s *) local->digests->data, local->digests->len),
+                      local->digests->len);
+  g_byte_array_append(reply, record, sizeof(record));
+  _frame_end(reply, frame, WIRE_SYNC_SUMMARY, seq);
+}
+
+int sync_session_summary(uint16_t seq, GByteArray *reply)
+{
+  sync_local_s local;
+
+  if (_local_load(&local) != SQLITE_OK)
+    return SQLITE_ERROR;
+
+  _append_summary(reply, &local, seq);
+  _local_free(&local);
+
+  return SQLITE_OK;
+}
+
+static void _diff_cb(void *data, sync_action_e action, const sync_digest_s *local, const sync_digest_s *remote)
+{
+  sync_diff_s *diff = data;
+
+  switch (action) {
+  case SYNC_SEND:
+    g_array_append_val(diff->send, local->uid);
+    break;
+  case SYNC_FETCH:
+    g_array_append_val(diff->fetch, remote->uid);
+    break;
+  case SYNC_COUNTER:
+    if (remote->counter > local->counter) {
+      if (db_sync_counter(local->uid, remote->counter) != SQLITE_OK)
+        diff->ret = SQLITE_ERROR;
+    } else {
+      g_array_append_val(diff->counters, *local);
+    }
+    break;
+  }
+}
+
+int sync_session_digest(const sync_digest_s *remote, guint count, uint16_t seq, GByteArray *reply)
+{
+  sync_local_s local;
+
+  if (_local_load(&local) != SQLITE_OK)
+    return SQLITE_ERROR;
+
+  sync_diff_s diff = {
+    .send     = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+    .fetch    = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+    .counters = g_array_new(FALSE, FALSE, sizeof(sync_digest_s)),
+    .ret      = SQLITE_OK
+  };
+
+  /* The phone orders its digests its own way, a Java peer sorts the uids
+   * as signed, sync_plan() needs them ascending as unsigned */
+  GArray *sorted = g_array_sized_new(FALSE, FALSE, sizeof(sync_digest_s), count);
+  if (count > 0) g_array_append_vals(sorted, remote, count);
+  sync_sort((sync_digest_s *) sorted->data, sorted->len);
+
+  /* Without a transaction the counters are still taken over one by one */
+  const gboolean transaction = db_begin() == SQLITE_OK;
+  if (!transaction)
+    dlog_print(DLOG_WARN, LOG_TAG, "sync: counters updated outside of a transaction");
+
+  sync_plan((const sync_digest_s *) local.digests->data, local.digests->len,
+            (const sync_digest_s *) sorted->data, sorted->len, _diff_cb, &diff);
+  if (transaction && db_commit() != SQLITE_OK) {
+    db_rollback();
+    diff.ret = SQLITE_ERROR;
+  }
+
+  dlog_print(DLOG_INFO, LOG_TAG, "sync: %u to send, %u to fetch, %u counters",
+             diff.send->len, diff.fetch->len, diff.counters->len);
+
+  if (diff.send->len > 0) {
+    const guint frame = _frame_begin(reply);
+    for (guint i = 0; i < diff.send->len; i++) {
+      _append_entry(reply, g_hash_table_lookup(local.by_uid, &g_array_index(diff.send, uint64_t, i)));
+    }
+    _frame_end(reply, frame, WIRE_ENTRIES, seq);
+  }
+
+  if (diff.fetch->len > 0) {
+    const guint frame = _frame_begin(reply);
+    for (guint i = 0; i < diff.fetch->len; i++) {
+      uint8_t record[SYNC_REQUEST_SIZE];
+      sync_encode_request(record, g_array_index(diff.fetch, uint64_t, i));
+      g_byte_array_append(reply, record, sizeof(record));
+    }
+    _frame_end(reply, frame, WIRE_SYNC_REQUEST, seq);
+  }
+
+  if (diff.counters->len > 0) {
+    const guint frame = _frame_begin(reply);
+    for (guint i = 0; i < diff.counters->len; i++) {
+      const sync_digest_s *digest = &g_array_index(diff.counters, sync_digest_s, i);
+      uint8_t record[SYNC_COUNTER_SIZE];
+      sync_encode_counter(record, digest->uid, digest->counter);
+      g_byte_array_append(reply, record, sizeof(record));
+    }
+    _frame_end(reply, frame, WIRE_SYNC_COUNTER, seq);
+  }
+
+  if (diff.send->len + diff.fetch->len + diff.counters->len == 0) {
+    _append_summary(reply, &local, seq);
+  }
+
+  g_array_free(diff.send, TRUE);
+  g_array_free(diff.fetch, TRUE);
+  g_array_free(diff.counters, TRUE);
+  g_array_free(sorted, TRUE);
+  _local_free(&local);
+
+  return diff.ret;
+}
+
+int sync_session_request(const uint64_t *uids, guint count, uint16_t seq, GByteArray *reply)
+{
+  const guint frame = _frame_begin(reply);
+  otp_list_s found = { 0 };
+  int ret = SQLITE_OK;
+
+  for (guint i = 0; i < count; i++) {
+    if (db_select_uid(&found, uids[i]) != SQLITE_OK) {
+      ret = SQLITE_ERROR;
+    } else if (found.count > 0) {
+      _append_entry(reply, &found.entries[0]);
+    }
+    otp_list_clear(&found);
+  }
+
+  _frame_end(reply, frame, WIRE_ENTRIES, seq);
+
+  return ret;
+}
@@ -0,0 +1,181 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <dlog.h>
+#include <Ecore.h>
+#include "otp.h"
+#include "transport.h"
+
+/* Messages are read into a single buffer, larger ones are truncated */
+#define UNIX_MESSAGE_MAX 65536
+/* Messages read per wakeup before yielding to the main loop */
+#define UNIX_READ_BATCH 64
+
+struct priv {
+  char             *path;
+  int              listen_fd;
+  int              client_fd;
+  Ecore_Fd_Handler *listen_handler;
+  Ecore_Fd_Handler *client_handler;
+  char             buffer[UNIX_MESSAGE_MAX];
+};
+
+static void _client_close(transport_s *transport, gboolean notify)
+{
+  struct priv *priv = transport->priv;
+
+  if (priv->client_fd < 0)
+    return;
+
+  ecore_main_fd_handler_del(priv->client_handler);
+  priv->client_handler = NULL;
+  close(priv->client_fd);
+  priv->client_fd = -1;
+
+  if (notify && transport->cbs.terminated)
+    transport->cbs.terminated(transport, transport->data);
+}
+
+static Eina_Bool _client_cb(void *data, Ecore_Fd_Handler *handler)
+{
+  transport_s *transport = data;
+  struct priv *priv = transport->priv;
+
+  for (int i = 0; i < UNIX_READ_BATCH; i++) {
+    ssize_t length = recv(priv->client_fd, priv->buffer, sizeof(priv->buffer), MSG_DONTWAIT);
+
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      break;
+
+    if (length <= 0) {
+      if (length < 0)
+        dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: recv failed: %s", strerror(errno));
+      _client_close(transport, TRUE);
+      break;
+    }
+
+    if (transport->cbs.received)
+      transport->cbs.received(transport, priv->buffer, length, transport->data);
+
+    /* The callback may have stopped the transport */
+    if (priv->client_fd < 0)
+      break;
+  }
+
+  return ECORE_CALLBACK_RENEW;
+}
+
+static Eina_Bool _listen_cb(void *data, Ecore_Fd_Handler *handler)
+{
+  transport_s *transport = data;
+  struct priv *priv = transport->priv;
+  int fd = accept4(priv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: accept failed: %s", strerror(errno));
+    return ECORE_CALLBACK_RENEW;
+  }
+
+  /* A single client at a time, a new one replaces the previous */
+  _client_close(transport, TRUE);
+
+  priv->client_fd = fd;
+  priv->client_handler = ecore_main_fd_handler_add(fd, ECORE_FD_READ | ECORE_FD_ERROR, _client_cb, transport, NULL, NULL);
+
+  if (transport->cbs.connected)
+    transport->cbs.connected(transport, transport->data);
+
+  return ECORE_CALLBACK_RENEW;
+}
+
+static gboolean unix_start(transport_s *transport)
+{
+  struct priv *priv = transport->priv;
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+  if (strlen(priv->path) >= sizeof(addr.sun_path)) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: path is too long: %s", priv->path);
+    return FALSE;
+  }
+  strcpy(addr.sun_path, priv->path);
+
+  priv->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (priv->listen_fd < 0) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: socket failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  unlink(priv->path);
+  if (bind(priv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(priv->listen_fd, 4) < 0) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: can't listen on %s: %s", priv->path, strerror(errno));
+    close(priv->listen_fd);
+    priv->listen_fd = -1;
+    return FALSE;
+  }
+
+  priv->listen_handler = ecore_main_fd_handler_add(priv->listen_fd, ECORE_FD_READ, _listen_cb, transport, NULL, NULL);
+
+  dlog_print(DLOG_INFO, LOG_TAG, "unix transport: listening on %s", priv->path);
+
+  return TRUE;
+}
+
+static gboolean unix_send(transport_s *transport, const void *buffer, unsigned int length)
+{
+  struct priv *priv = transport->priv;
+
+  if (priv->client_fd < 0)
+    return FALSE;
+
+  if (send(priv->client_fd, buffer, length, MSG_NOSIGNAL) != (ssize_t) length) {
+    dlog_print(DLOG_ERROR, LOG_TAG, "unix transport: send failed: %s", strerror(errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void unix_stop(transport_s *transport)
+{
+  struct priv *priv = transport->priv;
+
+  _client_close(transport, FALSE);
+
+  if (priv->listen_fd >= 0) {
+    ecore_main_fd_handler_del(priv->listen_handler);
+    close(priv->listen_fd);
+    unlink(priv->path);
+  }
+
+  g_free(priv->path);
+  g_free(priv);
+  transport->priv = NULL;
+}
+
+static const transport_ops_s unix_ops = {
+  .name  = "unix",
+  .start = unix_start,
+  .send  = unix_send,
+  .stop  = unix_stop,
+};
+
+transport_s *transport_unix_new(const char *path, const transport_cbs_s *cbs, void *data)
+{
+  transport_s *transport = g_new0(transport_s, 1);
+  struct priv *priv = g_new0(struct priv, 1);
+
+  priv->path = g_strdup(path);
+  priv->listen_fd = -1;
+  priv->client_fd = -1;
+
+  transport->ops = &unix_ops;
+  transport->cbs = *cbs;
+  transport->data = data;
+  transport->priv = priv;
+
+  return transport;
+}
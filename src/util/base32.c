@@ -19,7 +19,7 @@
 #include "util/base32.h"
 
 int base32_decode(const uint8_t *encoded, uint8_t *result, int bufSize) {
-  int buffer = 0;
+  unsigned int buffer = 0;
   int bitsLeft = 0;
   int count = 0;
   for (const uint8_t *ptr = encoded; count < bufSize && *ptr; ++ptr) {
@@ -67,7 +67,7 @@ int base32_encode(const uint8_t *data, int length, uint8_t *result,
   }
   int count = 0;
   if (length > 0) {
-    int buffer = data[0];
+    unsigned int buffer = data[0];
     int next = 1;
     int bitsLeft = 8;
     while (count < bufSize && (bitsLeft > 0 || next < length)) {
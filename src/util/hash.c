@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include <strings.h>
+
+#include "util/hash.h"
+
+static void hash_sha1_init(HASH_INFO *info) { sha1_init(&info->sha1); }
+static void hash_sha1_update(HASH_INFO *info, const uint8_t *buffer, int count) {
+  sha1_update(&info->sha1, buffer, count);
+}
+static void hash_sha1_final(HASH_INFO *info, uint8_t *digest) {
+  sha1_final(&info->sha1, digest);
+}
+
+static void hash_sha256_init(HASH_INFO *info) { sha256_init(&info->sha256); }
+static void hash_sha256_update(HASH_INFO *info, const uint8_t *buffer, int count) {
+  sha256_update(&info->sha256, buffer, count);
+}
+static void hash_sha256_final(HASH_INFO *info, uint8_t *digest) {
+  sha256_final(&info->sha256, digest);
+}
+
+static void hash_sha512_init(HASH_INFO *info) { sha512_init(&info->sha512); }
+static void hash_sha512_update(HASH_INFO *info, const uint8_t *buffer, int count) {
+  sha512_update(&info->sha512, buffer, count);
+}
+static void hash_sha512_final(HASH_INFO *info, uint8_t *digest) {
+  sha512_final(&info->sha512, digest);
+}
+
+static const hash_backend_s hash_backends[HASH_ALGO_COUNT] = {
+  [HASH_SHA1] = {
+    "SHA1", HASH_SHA1, SHA1_BLOCKSIZE, SHA1_DIGEST_LENGTH,
+    hash_sha1_init, hash_sha1_update, hash_sha1_final
+  },
+  [HASH_SHA256] = {
+    "SHA256", HASH_SHA256, SHA256_BLOCKSIZE, SHA256_DIGEST_LENGTH,
+    hash_sha256_init, hash_sha256_update, hash_sha256_final
+  },
+  [HASH_SHA512] = {
+    "SHA512", HASH_SHA512, SHA512_BLOCKSIZE, SHA512_DIGEST_LENGTH,
+    hash_sha512_init, hash_sha512_update, hash_sha512_final
+  },
+};
+
+const hash_backend_s *hash_backend(hash_algo_e algo) {
+  if ((int) algo < 0 || algo >= HASH_ALGO_COUNT) {
+    return NULL;
+  }
+  return &hash_backends[algo];
+}
+
+int hash_algo_from_name(const char *name) {
+  for (int i = 0; i < HASH_ALGO_COUNT; ++i) {
+    if (strcasecmp(name, hash_backends[i].name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -17,63 +17,99 @@
 
 #include <string.h>
 
+#include "util/hash.h"
 #include "util/hmac.h"
-#include "util/sha1.h"
+#include "util/secure_mem.h"
 
-void hmac_sha1(const uint8_t *key, int keyLength,
-               const uint8_t *data, int dataLength,
-               uint8_t *result, int resultLength) {
-  SHA1_INFO ctx;
-  uint8_t hashed_key[SHA1_DIGEST_LENGTH];
-  if (keyLength > 64) {
-    // The key can be no bigger than 64 bytes. If it is, we'll hash it down to
-    // 20 bytes.
-    sha1_init(&ctx);
-    sha1_update(&ctx, key, keyLength);
-    sha1_final(&ctx, hashed_key);
+int hmac_init(HMAC_CTX *ctx, hash_algo_e algo,
+              const uint8_t *key, int keyLength) {
+  const hash_backend_s *hash = hash_backend(algo);
+  if (hash == NULL) {
+    return 0;
+  }
+  const int blockSize = hash->block_size;
+  ctx->hash = hash;
+
+  uint8_t hashed_key[HASH_MAX_DIGEST_LENGTH];
+  if (keyLength > blockSize) {
+    // The key can be no bigger than a block. If it is, we'll hash it down to
+    // digest size.
+    hash->init(&ctx->inner);
+    hash->update(&ctx->inner, key, keyLength);
+    hash->final(&ctx->inner, hashed_key);
     key = hashed_key;
-    keyLength = SHA1_DIGEST_LENGTH;
+    keyLength = hash->digest_length;
   }
 
   // The key for the inner digest is derived from our key, by padding the key
-  // the full length of 64 bytes, and then XOR'ing each byte with 0x36.
-  uint8_t tmp_key[64];
+  // the full length of the block, and then XOR'ing each byte with 0x36.
+  uint8_t tmp_key[HASH_MAX_BLOCKSIZE];
   for (int i = 0; i < keyLength; ++i) {
     tmp_key[i] = key[i] ^ 0x36;
   }
-  if (keyLength < 64) {
-    memset(tmp_key + keyLength, 0x36, 64 - keyLength);
+  if (keyLength < blockSize) {
+    memset(tmp_key + keyLength, 0x36, blockSize - keyLength);
   }
 
-  // Compute inner digest
-  sha1_init(&ctx);
-  sha1_update(&ctx, tmp_key, 64);
-  sha1_update(&ctx, data, dataLength);
-  uint8_t sha[SHA1_DIGEST_LENGTH];
-  sha1_final(&ctx, sha);
+  // Absorb the inner key block
+  hash->init(&ctx->inner);
+  hash->update(&ctx->inner, tmp_key, blockSize);
 
   // The key for the outer digest is derived from our key, by padding the key
-  // the full length of 64 bytes, and then XOR'ing each byte with 0x5C.
+  // the full length of the block, and then XOR'ing each byte with 0x5C.
   for (int i = 0; i < keyLength; ++i) {
     tmp_key[i] = key[i] ^ 0x5C;
   }
-  memset(tmp_key + keyLength, 0x5C, 64 - keyLength);
+  memset(tmp_key + keyLength, 0x5C, blockSize - keyLength);
+
+  // Absorb the outer key block
+  hash->init(&ctx->outer);
+  hash->update(&ctx->outer, tmp_key, blockSize);
+
+  // Zero out all internal data structures
+  secure_wipe(hashed_key, sizeof(hashed_key));
+  secure_wipe(tmp_key, sizeof(tmp_key));
+
+  return 1;
+}
+
+void hmac_compute(const HMAC_CTX *ctx,
+                  const uint8_t *data, int dataLength,
+                  uint8_t *result, int resultLength) {
+  const hash_backend_s *hash = ctx->hash;
+  HASH_INFO info;
+  uint8_t sha[HASH_MAX_DIGEST_LENGTH];
+
+  // Compute inner digest
+  memcpy(&info, &ctx->inner, sizeof(info));
+  hash->update(&info, data, dataLength);
+  hash->final(&info, sha);
 
   // Compute outer digest
-  sha1_init(&ctx);
-  sha1_update(&ctx, tmp_key, 64);
-  sha1_update(&ctx, sha, SHA1_DIGEST_LENGTH);
-  sha1_final(&ctx, sha);
+  memcpy(&info, &ctx->outer, sizeof(info));
+  hash->update(&info, sha, hash->digest_length);
+  hash->final(&info, sha);
 
   // Copy result to output buffer and truncate or pad as necessary
   memset(result, 0, resultLength);
-  if (resultLength > SHA1_DIGEST_LENGTH) {
-    resultLength = SHA1_DIGEST_LENGTH;
+  if (resultLength > hash->digest_length) {
+    resultLength = hash->digest_length;
   }
   memcpy(result, sha, resultLength);
 
   // Zero out all internal data structures
-  memset(hashed_key, 0, sizeof(hashed_key));
-  memset(sha, 0, sizeof(sha));
-  memset(tmp_key, 0, sizeof(tmp_key));
+  secure_wipe(&info, sizeof(info));
+  secure_wipe(sha, sizeof(sha));
+}
+
+void hmac_sha1(const uint8_t *key, int keyLength,
+               const uint8_t *data, int dataLength,
+               uint8_t *result, int resultLength) {
+  HMAC_CTX ctx;
+
+  hmac_init(&ctx, HASH_SHA1, key, keyLength);
+  hmac_compute(&ctx, data, dataLength, result, resultLength);
+
+  // Zero out all internal data structures
+  secure_wipe(&ctx, sizeof(ctx));
 }
@@ -0,0 +1,172 @@
+// Multi-lane HMAC-SHA1 for HOTP/TOTP counters.
+//
+// Every lane runs the same fixed shape computation: one compression of the
+// 8 byte counter against the precomputed inner state and one compression of
+// the inner digest against the precomputed outer state. The lanes are packed
+// into GCC vector types, which map onto SSE2/AVX2/AVX-512 on x86 and NEON on
+// ARM, so one key is hashed per vector lane.
+
+#include <pthread.h>
+#include <string.h>
+
+#include "util/hmac.h"
+#include "util/secure_mem.h"
+#include "util/sha1.h"
+
+// Bit lengths of the padded inner (key block + counter) and outer
+// (key block + inner digest) messages
+#define HMAC_INNER_BITS ((SHA1_BLOCKSIZE + 8) * 8)
+#define HMAC_OUTER_BITS ((SHA1_BLOCKSIZE + SHA1_DIGEST_LENGTH) * 8)
+
+#define SHA1_K1 0x5a827999u
+#define SHA1_K2 0x6ed9eba1u
+#define SHA1_K3 0x8f1bbcdcu
+#define SHA1_K4 0xca62c1d6u
+
+#define VROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define VROUND(f, k)                                                          \
+  do {                                                                        \
+    if (i >= 16) {                                                            \
+      W[i & 15] = VROL(W[(i - 3) & 15] ^ W[(i - 8) & 15] ^                    \
+                       W[(i - 14) & 15] ^ W[i & 15], 1);                      \
+    }                                                                         \
+    t = VROL(a, 5) + (f) + e + W[i & 15] + (k);                               \
+    e = d; d = c; c = VROL(b, 30); b = a; a = t;                              \
+  } while (0)
+
+// Defines the compression and the batch kernel for one lane count. The
+// vector type is local to each kernel so the same source can be compiled
+// for several instruction sets in one translation unit.
+#define HMAC_BATCH_KERNEL(lanes, attr)                                        \
+typedef uint32_t vec##lanes __attribute__((vector_size(4 * (lanes))));       \
+                                                                              \
+attr static inline void                                                       \
+sha1_lanes_##lanes(vec##lanes s[5], vec##lanes W[16]) {                       \
+  vec##lanes a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], t;             \
+  int i;                                                                      \
+  for (i = 0; i < 20; ++i) VROUND((b & c) | (~b & d), SHA1_K1);               \
+  for (; i < 40; ++i) VROUND(b ^ c ^ d, SHA1_K2);                             \
+  for (; i < 60; ++i) VROUND((b & c) | (b & d) | (c & d), SHA1_K3);           \
+  for (; i < 80; ++i) VROUND(b ^ c ^ d, SHA1_K4);                             \
+  s[0] += a; s[1] += b; s[2] += c; s[3] += d; s[4] += e;                      \
+}                                                                             \
+                                                                              \
+attr static void                                                              \
+hmac_sha1_lanes_##lanes(const HMAC_CTX *const *ctx,                      \
+                        const uint64_t *counters, uint32_t *truncated) {      \
+  vec##lanes s[5], o[5], W[16];                                               \
+  uint32_t digest[5][lanes];                                                  \
+                                                                              \
+  for (int l = 0; l < (lanes); ++l) {                                         \
+    for (int j = 0; j < 5; ++j) {                                             \
+      s[j][l] = ctx[l]->inner.sha1.digest[j];                                      \
+      o[j][l] = ctx[l]->outer.sha1.digest[j];                                      \
+    }                                                                         \
+    W[0][l] = (uint32_t) (counters[l] >> 32);                                 \
+    W[1][l] = (uint32_t) counters[l];                                         \
+  }                                                                           \
+                                                                              \
+  /* Inner block: counter, padding and message length */                      \
+  W[2] = (vec##lanes) {} + 0x80000000u;                                       \
+  for (int j = 3; j < 15; ++j) W[j] = (vec##lanes) {};                        \
+  W[15] = (vec##lanes) {} + HMAC_INNER_BITS;                                  \
+  sha1_lanes_##lanes(s, W);                                                   \
+                                                                              \
+  /* Outer block: inner digest, padding and message length */                 \
+  for (int j = 0; j < 5; ++j) W[j] = s[j];                                    \
+  W[5] = (vec##lanes) {} + 0x80000000u;                                       \
+  for (int j = 6; j < 15; ++j) W[j] = (vec##lanes) {};                        \
+  W[15] = (vec##lanes) {} + HMAC_OUTER_BITS;                                  \
+  sha1_lanes_##lanes(o, W);                                                   \
+                                                                              \
+  for (int j = 0; j < 5; ++j) {                                               \
+    memcpy(digest[j], &o[j], sizeof(digest[j]));                              \
+  }                                                                           \
+  for (int l = 0; l < (lanes); ++l) {                                         \
+    uint8_t hash[SHA1_DIGEST_LENGTH];                                         \
+    for (int j = 0; j < 5; ++j) {                                             \
+      hash[4 * j    ] = digest[j][l] >> 24;                                   \
+      hash[4 * j + 1] = digest[j][l] >> 16;                                   \
+      hash[4 * j + 2] = digest[j][l] >> 8;                                    \
+      hash[4 * j + 3] = digest[j][l];                                         \
+    }                                                                         \
+    const int offset = hash[SHA1_DIGEST_LENGTH - 1] & 0xF;                    \
+    truncated[l] = ((uint32_t) (hash[offset] & 0x7F) << 24) |                 \
+                   ((uint32_t) hash[offset + 1] << 16) |                      \
+                   ((uint32_t) hash[offset + 2] << 8) |                       \
+                   hash[offset + 3];                                          \
+    secure_wipe(hash, sizeof(hash));                                          \
+  }                                                                           \
+                                                                              \
+  secure_wipe(s, sizeof(s));                                                  \
+  secure_wipe(o, sizeof(o));                                                  \
+  secure_wipe(W, sizeof(W));                                                  \
+  secure_wipe(digest, sizeof(digest));                                        \
+}
+
+typedef void (*hmac_lanes_fn)(const HMAC_CTX *const *ctx,
+                              const uint64_t *counters, uint32_t *truncated);
+
+HMAC_BATCH_KERNEL(4, )
+
+#if defined(__x86_64__) || defined(__i386__)
+HMAC_BATCH_KERNEL(8, __attribute__((target("avx2"))))
+HMAC_BATCH_KERNEL(16, __attribute__((target("avx512f"))))
+#endif
+
+static int batch_lanes = 0;
+static hmac_lanes_fn batch_kernel = NULL;
+static pthread_once_t batch_once = PTHREAD_ONCE_INIT;
+
+// Runs once, codes are also computed on the database worker thread
+static void hmac_sha1_batch_select(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    batch_kernel = hmac_sha1_lanes_16;
+    batch_lanes = 16;
+    return;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    batch_kernel = hmac_sha1_lanes_8;
+    batch_lanes = 8;
+    return;
+  }
+#endif
+  batch_kernel = hmac_sha1_lanes_4;
+  batch_lanes = 4;
+}
+
+int hmac_sha1_batch_lanes(void) {
+  pthread_once(&batch_once, hmac_sha1_batch_select);
+  return batch_lanes;
+}
+
+void hmac_sha1_batch_truncated(const HMAC_CTX *const *ctx,
+                               const uint64_t *counters,
+                               uint32_t *truncated, int count) {
+  const int lanes = hmac_sha1_batch_lanes();
+  int i = 0;
+
+  for (; i + lanes <= count; i += lanes) {
+    batch_kernel(ctx + i, counters + i, truncated + i);
+  }
+
+  if (i < count) {
+    // Fill the unused lanes of the last group with copies of the last
+    // message and drop their results.
+    const HMAC_CTX *tail_ctx[16];
+    uint64_t tail_counters[16];
+    uint32_t tail_truncated[16];
+
+    for (int l = 0; l < lanes; ++l) {
+      const int src = i + l < count ? i + l : count - 1;
+      tail_ctx[l] = ctx[src];
+      tail_counters[l] = counters[src];
+    }
+    batch_kernel(tail_ctx, tail_counters, tail_truncated);
+    memcpy(truncated + i, tail_truncated, (count - i) * sizeof(uint32_t));
+    secure_wipe(tail_truncated, sizeof(tail_truncated));
+  }
+}
@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <time.h>
+
+#include "util/latency.h"
+
+int64_t latency_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void latency_record(latency_hist_s *hist, int64_t us) {
+  int bucket = 0;
+
+  if (us < 0) {
+    us = 0;
+  }
+  while (bucket < LATENCY_BUCKETS - 1 && ((uint64_t) 1 << bucket) <= (uint64_t) us) {
+    ++bucket;
+  }
+
+  hist->buckets[bucket]++;
+  hist->count++;
+  hist->total_us += us;
+  if ((uint64_t) us > hist->max_us) {
+    hist->max_us = us;
+  }
+}
+
+void latency_record_since(latency_hist_s *hist, int64_t start) {
+  latency_record(hist, latency_now_us() - start);
+}
+
+size_t latency_format(const latency_hist_s *hist, char *out, size_t size) {
+  int n = snprintf(out, size, "%s: n=%u mean=%lluus max=%lluus", hist->name, hist->count,
+                   (unsigned long long) (hist->count ? hist->total_us / hist->count : 0),
+                   (unsigned long long) hist->max_us);
+  size_t len = n < 0 ? 0 : (size_t) n;
+
+  for (int i = 0; i < LATENCY_BUCKETS && len < size; ++i) {
+    if (hist->buckets[i] == 0) {
+      continue;
+    }
+    if (i == LATENCY_BUCKETS - 1) {
+      n = snprintf(out + len, size - len, " >=%lluus:%u", 1ULL << (i - 1), hist->buckets[i]);
+    } else {
+      n = snprintf(out + len, size - len, " <%lluus:%u", 1ULL << i, hist->buckets[i]);
+    }
+    len += n < 0 ? 0 : (size_t) n;
+  }
+
+  return len < size ? len : size - 1;
+}
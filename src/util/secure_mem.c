@@ -0,0 +1,110 @@
+#define _DEFAULT_SOURCE
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "util/secure_mem.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// Slots are aligned to cache lines, so two keys never share one
+#define SECURE_SLOT_ALIGN 64
+// Pages mapped at once when the arena runs out of free slots
+#define SECURE_CHUNK_PAGES 8
+
+struct secure_chunk {
+  secure_chunk_s *next;
+  size_t         size;
+};
+
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+void secure_wipe(void *buf, size_t len) {
+  if (buf != NULL && len > 0) {
+    secure_memset(buf, 0, len);
+  }
+}
+
+static size_t secure_slot_size(const secure_arena_s *arena) {
+  return (arena->slot_size + SECURE_SLOT_ALIGN - 1) & ~(size_t) (SECURE_SLOT_ALIGN - 1);
+}
+
+static int secure_arena_grow(secure_arena_s *arena) {
+  const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  const size_t slot = secure_slot_size(arena);
+  size_t size = page * SECURE_CHUNK_PAGES;
+
+  if (size < SECURE_SLOT_ALIGN + slot) {
+    size = (SECURE_SLOT_ALIGN + slot + page - 1) / page * page;
+  }
+
+  uint8_t *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return 0;
+  }
+
+  // Both are best effort: locking fails above RLIMIT_MEMLOCK and the
+  // keys are still wiped on release.
+  mlock(mem, size);
+#if defined(MADV_DONTDUMP)
+  madvise(mem, size, MADV_DONTDUMP);
+#endif
+
+  secure_chunk_s *chunk = (secure_chunk_s *) mem;
+  chunk->size = size;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+
+  // The first cache line holds the chunk header, the rest is split into
+  // slots threaded onto the free list.
+  for (uint8_t *p = mem + SECURE_SLOT_ALIGN; p + slot <= mem + size; p += slot) {
+    *(void **) p = arena->free_list;
+    arena->free_list = p;
+  }
+
+  return 1;
+}
+
+void *secure_arena_alloc(secure_arena_s *arena) {
+  void *slot = NULL;
+
+  pthread_mutex_lock(&arena->lock);
+  if (arena->free_list != NULL || secure_arena_grow(arena)) {
+    slot = arena->free_list;
+    arena->free_list = *(void **) slot;
+    *(void **) slot = NULL;
+  }
+  pthread_mutex_unlock(&arena->lock);
+
+  return slot;
+}
+
+void secure_arena_free(secure_arena_s *arena, void *slot) {
+  if (slot == NULL) {
+    return;
+  }
+
+  secure_wipe(slot, secure_slot_size(arena));
+
+  pthread_mutex_lock(&arena->lock);
+  *(void **) slot = arena->free_list;
+  arena->free_list = slot;
+  pthread_mutex_unlock(&arena->lock);
+}
+
+void secure_arena_destroy(secure_arena_s *arena) {
+  pthread_mutex_lock(&arena->lock);
+  while (arena->chunks != NULL) {
+    secure_chunk_s *chunk = arena->chunks;
+    const size_t size = chunk->size;
+    arena->chunks = chunk->next;
+    secure_wipe(chunk, size);
+    munlock(chunk, size);
+    munmap(chunk, size);
+  }
+  arena->free_list = NULL;
+  pthread_mutex_unlock(&arena->lock);
+}
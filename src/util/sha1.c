@@ -43,9 +43,11 @@
 #define _BSD_SOURCE
 #define _DEFAULT_SOURCE
 #include <sys/types.h> // Defines BYTE_ORDER, iff _BSD_SOURCE is defined
+#include <pthread.h>
 #include <string.h>
 
 #include "util/sha1.h"
+#include "util/secure_mem.h"
 
 #if !defined(BYTE_ORDER)
 #if defined(_BIG_ENDIAN)
@@ -105,20 +107,17 @@
 
 
 static void
-sha1_transform(SHA1_INFO *sha1_info)
+sha1_compress_block(uint32_t digest[5], const uint8_t *dp, uint32_t W[80])
 {
     int i;
-    uint8_t *dp;
-    uint32_t T, A, B, C, D, E, W[80], *WP;
-
-    dp = sha1_info->data;
+    uint32_t T, A, B, C, D, E, *WP;
 
 #undef SWAP_DONE
 
 #if BYTE_ORDER == 1234
 #define SWAP_DONE
     for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
+        memcpy(&T, dp, sizeof(T));
         dp += 4;
         W[i] = 
             ((T << 24) & 0xff000000) |
@@ -130,7 +129,7 @@ sha1_transform(SHA1_INFO *sha1_info)
 #if BYTE_ORDER == 4321
 #define SWAP_DONE
     for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
+        memcpy(&T, dp, sizeof(T));
         dp += 4;
         W[i] = TRUNC32(T);
     }
@@ -139,7 +138,7 @@ sha1_transform(SHA1_INFO *sha1_info)
 #if BYTE_ORDER == 12345678
 #define SWAP_DONE
     for (i = 0; i < 16; i += 2) {
-        T = *((uint32_t *) dp);
+        memcpy(&T, dp, sizeof(T));
         dp += 8;
         W[i] =  ((T << 24) & 0xff000000) | ((T <<  8) & 0x00ff0000) |
             ((T >>  8) & 0x0000ff00) | ((T >> 24) & 0x000000ff);
@@ -152,7 +151,7 @@ sha1_transform(SHA1_INFO *sha1_info)
 #if BYTE_ORDER == 87654321
 #define SWAP_DONE
     for (i = 0; i < 16; i += 2) {
-        T = *((uint32_t *) dp);
+        memcpy(&T, dp, sizeof(T));
         dp += 8;
         W[i] = TRUNC32(T >> 32);
         W[i+1] = TRUNC32(T);
@@ -162,7 +161,7 @@ sha1_transform(SHA1_INFO *sha1_info)
 #ifndef SWAP_DONE
 #define SWAP_DONE
     for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
+        memcpy(&T, dp, sizeof(T));
         dp += 4;
         W[i] = TRUNC32(T);
     }
@@ -172,11 +171,11 @@ sha1_transform(SHA1_INFO *sha1_info)
     W[i] = W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16];
     W[i] = R32(W[i], 1);
     }
-    A = sha1_info->digest[0];
-    B = sha1_info->digest[1];
-    C = sha1_info->digest[2];
-    D = sha1_info->digest[3];
-    E = sha1_info->digest[4];
+    A = digest[0];
+    B = digest[1];
+    C = digest[2];
+    D = digest[3];
+    E = digest[4];
     WP = W;
 #ifdef UNRAVEL
     FA(1); FB(1); FC(1); FD(1); FE(1); FT(1); FA(1); FB(1); FC(1); FD(1);
@@ -187,11 +186,11 @@ sha1_transform(SHA1_INFO *sha1_info)
     FC(3); FD(3); FE(3); FT(3); FA(3); FB(3); FC(3); FD(3); FE(3); FT(3);
     FA(4); FB(4); FC(4); FD(4); FE(4); FT(4); FA(4); FB(4); FC(4); FD(4);
     FE(4); FT(4); FA(4); FB(4); FC(4); FD(4); FE(4); FT(4); FA(4); FB(4);
-    sha1_info->digest[0] = T32(sha1_info->digest[0] + E);
-    sha1_info->digest[1] = T32(sha1_info->digest[1] + T);
-    sha1_info->digest[2] = T32(sha1_info->digest[2] + A);
-    sha1_info->digest[3] = T32(sha1_info->digest[3] + B);
-    sha1_info->digest[4] = T32(sha1_info->digest[4] + C);
+    digest[0] = T32(digest[0] + E);
+    digest[1] = T32(digest[1] + T);
+    digest[2] = T32(digest[2] + A);
+    digest[3] = T32(digest[3] + B);
+    digest[4] = T32(digest[4] + C);
 #else /* !UNRAVEL */
 #ifdef UNROLL_LOOPS
     FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1);
@@ -208,14 +207,97 @@ sha1_transform(SHA1_INFO *sha1_info)
     for (i = 40; i < 60; ++i) { FG(3); }
     for (i = 60; i < 80; ++i) { FG(4); }
 #endif /* !UNROLL_LOOPS */
-    sha1_info->digest[0] = T32(sha1_info->digest[0] + A);
-    sha1_info->digest[1] = T32(sha1_info->digest[1] + B);
-    sha1_info->digest[2] = T32(sha1_info->digest[2] + C);
-    sha1_info->digest[3] = T32(sha1_info->digest[3] + D);
-    sha1_info->digest[4] = T32(sha1_info->digest[4] + E);
+    digest[0] = T32(digest[0] + A);
+    digest[1] = T32(digest[1] + B);
+    digest[2] = T32(digest[2] + C);
+    digest[3] = T32(digest[3] + D);
+    digest[4] = T32(digest[4] + E);
 #endif /* !UNRAVEL */
 }
 
+/* portable backend, one block after another */
+
+void
+sha1_compress_generic(uint32_t digest[5], const uint8_t *data, size_t blocks)
+{
+    uint32_t W[80];
+
+    while (blocks--) {
+        sha1_compress_block(digest, data, W);
+        data += SHA1_BLOCKSIZE;
+    }
+    secure_wipe(W, sizeof(W));
+}
+
+/* runtime dispatch between the compiled in backends */
+
+static const sha1_backend_s sha1_backends[] = {
+#if defined(SHA1_HAVE_X86)
+    { "sha-ni", sha1_compress_shani, sha1_shani_supported },
+    { "ssse3",  sha1_compress_ssse3, sha1_ssse3_supported },
+#endif
+#if defined(SHA1_HAVE_ARMV8)
+    { "armv8",  sha1_compress_armv8, sha1_armv8_supported },
+#endif
+    { "generic", sha1_compress_generic, NULL },
+};
+
+#define SHA1_BACKEND_COUNT (sizeof(sha1_backends) / sizeof(sha1_backends[0]))
+
+static const sha1_backend_s *sha1_backend = NULL;
+static pthread_once_t sha1_backend_once = PTHREAD_ONCE_INIT;
+
+/* Runs once, codes are also computed on the database worker thread */
+static void
+sha1_backend_init(void)
+{
+    size_t i;
+
+    for (i = 0; i < SHA1_BACKEND_COUNT; ++i) {
+        if (sha1_backends[i].supported == NULL || sha1_backends[i].supported()) {
+            sha1_backend = &sha1_backends[i];
+            break;
+        }
+    }
+}
+
+static const sha1_backend_s *
+sha1_backend_get(void)
+{
+    pthread_once(&sha1_backend_once, sha1_backend_init);
+    return sha1_backend;
+}
+
+void
+sha1_compress(uint32_t digest[5], const uint8_t *data, size_t blocks)
+{
+    sha1_backend_get()->compress(digest, data, blocks);
+}
+
+const char *
+sha1_backend_name(void)
+{
+    return sha1_backend_get()->name;
+}
+
+int
+sha1_backend_select(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < SHA1_BACKEND_COUNT; ++i) {
+        if (strcmp(sha1_backends[i].name, name) == 0) {
+            if (sha1_backends[i].supported != NULL && !sha1_backends[i].supported()) {
+                return 0;
+            }
+            pthread_once(&sha1_backend_once, sha1_backend_init);
+            sha1_backend = &sha1_backends[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /* initialize the SHA digest */
 
 void
@@ -255,16 +337,16 @@ sha1_update(SHA1_INFO *sha1_info, const uint8_t *buffer, int count)
     buffer += i;
     sha1_info->local += i;
     if (sha1_info->local == SHA1_BLOCKSIZE) {
-        sha1_transform(sha1_info);
+        sha1_compress(sha1_info->digest, sha1_info->data, 1);
     } else {
         return;
     }
     }
-    while (count >= SHA1_BLOCKSIZE) {
-    memcpy(sha1_info->data, buffer, SHA1_BLOCKSIZE);
-    buffer += SHA1_BLOCKSIZE;
-    count -= SHA1_BLOCKSIZE;
-    sha1_transform(sha1_info);
+    if (count >= SHA1_BLOCKSIZE) {
+    i = count / SHA1_BLOCKSIZE;
+    sha1_compress(sha1_info->digest, buffer, i);
+    buffer += i * SHA1_BLOCKSIZE;
+    count -= i * SHA1_BLOCKSIZE;
     }
     memcpy(sha1_info->data, buffer, count);
     sha1_info->local = count;
@@ -274,7 +356,7 @@ sha1_update(SHA1_INFO *sha1_info, const uint8_t *buffer, int count)
 static void
 sha1_transform_and_copy(unsigned char digest[20], SHA1_INFO *sha1_info)
 {
-    sha1_transform(sha1_info);
+    sha1_compress(sha1_info->digest, sha1_info->data, 1);
     digest[ 0] = (unsigned char) ((sha1_info->digest[0] >> 24) & 0xff);
     digest[ 1] = (unsigned char) ((sha1_info->digest[0] >> 16) & 0xff);
     digest[ 2] = (unsigned char) ((sha1_info->digest[0] >>  8) & 0xff);
@@ -310,7 +392,7 @@ sha1_final(SHA1_INFO *sha1_info, uint8_t digest[20])
     ((uint8_t *) sha1_info->data)[count++] = 0x80;
     if (count > SHA1_BLOCKSIZE - 8) {
     memset(((uint8_t *) sha1_info->data) + count, 0, SHA1_BLOCKSIZE - count);
-    sha1_transform(sha1_info);
+    sha1_compress(sha1_info->digest, sha1_info->data, 1);
     memset((uint8_t *) sha1_info->data, 0, SHA1_BLOCKSIZE - 8);
     } else {
     memset(((uint8_t *) sha1_info->data) + count, 0,
@@ -0,0 +1,83 @@
+// SHA1 compression backend for the ARMv8 cryptography extension.
+//
+// Only compiled when the toolchain targets the crypto extension
+// (e.g. -march=armv8-a+crypto or -mfpu=crypto-neon-fp-armv8) and only used
+// by sha1_compress() when the kernel reports SHA1 support.
+
+#include "util/sha1.h"
+
+#if defined(SHA1_HAVE_ARMV8)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#define SHA1_HWCAP_TYPE AT_HWCAP
+#define SHA1_HWCAP_BIT  HWCAP_SHA1
+#else
+#define SHA1_HWCAP_TYPE AT_HWCAP2
+#define SHA1_HWCAP_BIT  (1 << 2) /* HWCAP2_SHA1 */
+#endif
+
+int sha1_armv8_supported(void) {
+  return (getauxval(SHA1_HWCAP_TYPE) & SHA1_HWCAP_BIT) != 0;
+}
+
+// Four rounds of group g using operation op (c, p or m) and constant k.
+// M holds the last four message schedule groups, groups from 4 onwards are
+// derived in place from the previous ones.
+#define ARMV8_ROUNDS(g, op, k)                                                \
+  do {                                                                        \
+    if ((g) >= 4) {                                                           \
+      M[(g) & 3] = vsha1su1q_u32(                                             \
+          vsha1su0q_u32(M[(g) & 3], M[((g) + 1) & 3], M[((g) + 2) & 3]),      \
+          M[((g) + 3) & 3]);                                                  \
+    }                                                                         \
+    uint32_t next = vsha1h_u32(vgetq_lane_u32(ABCD, 0));                      \
+    ABCD = op(ABCD, E, vaddq_u32(M[(g) & 3], vdupq_n_u32(k)));                \
+    E = next;                                                                 \
+  } while (0)
+
+#define K1 0x5a827999
+#define K2 0x6ed9eba1
+#define K3 0x8f1bbcdc
+#define K4 0xca62c1d6
+
+void sha1_compress_armv8(uint32_t digest[5], const uint8_t *data,
+                         size_t blocks) {
+  uint32x4_t ABCD, ABCD_SAVE, M[4];
+  uint32_t E, E_SAVE;
+
+  ABCD = vld1q_u32(digest);
+  E = digest[4];
+
+  while (blocks--) {
+    ABCD_SAVE = ABCD;
+    E_SAVE = E;
+
+    for (int i = 0; i < 4; ++i) {
+      M[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+
+    ARMV8_ROUNDS( 0, vsha1cq_u32, K1); ARMV8_ROUNDS( 1, vsha1cq_u32, K1);
+    ARMV8_ROUNDS( 2, vsha1cq_u32, K1); ARMV8_ROUNDS( 3, vsha1cq_u32, K1);
+    ARMV8_ROUNDS( 4, vsha1cq_u32, K1); ARMV8_ROUNDS( 5, vsha1pq_u32, K2);
+    ARMV8_ROUNDS( 6, vsha1pq_u32, K2); ARMV8_ROUNDS( 7, vsha1pq_u32, K2);
+    ARMV8_ROUNDS( 8, vsha1pq_u32, K2); ARMV8_ROUNDS( 9, vsha1pq_u32, K2);
+    ARMV8_ROUNDS(10, vsha1mq_u32, K3); ARMV8_ROUNDS(11, vsha1mq_u32, K3);
+    ARMV8_ROUNDS(12, vsha1mq_u32, K3); ARMV8_ROUNDS(13, vsha1mq_u32, K3);
+    ARMV8_ROUNDS(14, vsha1mq_u32, K3); ARMV8_ROUNDS(15, vsha1pq_u32, K4);
+    ARMV8_ROUNDS(16, vsha1pq_u32, K4); ARMV8_ROUNDS(17, vsha1pq_u32, K4);
+    ARMV8_ROUNDS(18, vsha1pq_u32, K4); ARMV8_ROUNDS(19, vsha1pq_u32, K4);
+
+    ABCD = vaddq_u32(ABCD, ABCD_SAVE);
+    E += E_SAVE;
+    data += SHA1_BLOCKSIZE;
+  }
+
+  vst1q_u32(digest, ABCD);
+  digest[4] = E;
+}
+
+#endif /* SHA1_HAVE_ARMV8 */
@@ -0,0 +1,170 @@
+// SHA1 compression backends for x86: SHA-NI and SSSE3.
+//
+// Both are compiled with function level target attributes and only picked
+// by sha1_compress() after CPUID confirms the instructions are available,
+// so the rest of the project keeps building for the baseline ISA.
+
+#include "util/sha1.h"
+#include "util/secure_mem.h"
+
+#if defined(SHA1_HAVE_X86)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SHA1_TARGET_SHANI __attribute__((target("sha,ssse3")))
+#define SHA1_TARGET_SSSE3 __attribute__((target("ssse3")))
+
+int sha1_shani_supported(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3)) {
+    return 0;
+  }
+  if (__get_cpuid_max(0, 0) < 7) {
+    return 0;
+  }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1u << 29)) != 0;
+}
+
+int sha1_ssse3_supported(void) {
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+}
+
+// Four rounds of group g. M holds the last four message schedule groups,
+// groups from 4 onwards are derived in place from the previous ones.
+#define SHANI_ROUNDS(g, f)                                                    \
+  do {                                                                        \
+    if ((g) >= 4) {                                                           \
+      M[(g) & 3] = _mm_sha1msg2_epu32(                                        \
+          _mm_xor_si128(_mm_sha1msg1_epu32(M[(g) & 3], M[((g) + 1) & 3]),     \
+                        M[((g) + 2) & 3]),                                    \
+          M[((g) + 3) & 3]);                                                  \
+    }                                                                         \
+    E = _mm_sha1nexte_epu32(PREV, M[(g) & 3]);                                \
+    PREV = ABCD;                                                              \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E, f);                                   \
+  } while (0)
+
+SHA1_TARGET_SHANI
+void sha1_compress_shani(uint32_t digest[5], const uint8_t *data,
+                         size_t blocks) {
+  const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL,
+                                      0x08090a0b0c0d0e0fULL);
+  __m128i ABCD, ABCD_SAVE, E0, E, PREV, M[4];
+
+  ABCD = _mm_loadu_si128((const __m128i *) digest);
+  ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+  E0 = _mm_set_epi32(digest[4], 0, 0, 0);
+
+  while (blocks--) {
+    ABCD_SAVE = ABCD;
+
+    for (int i = 0; i < 4; ++i) {
+      M[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *) (data + 16 * i)), MASK);
+    }
+
+    // Rounds 0-3 add E directly, the following ones derive it from the
+    // previous A with sha1nexte.
+    E = _mm_add_epi32(E0, M[0]);
+    PREV = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E, 0);
+
+    SHANI_ROUNDS( 1, 0); SHANI_ROUNDS( 2, 0); SHANI_ROUNDS( 3, 0);
+    SHANI_ROUNDS( 4, 0); SHANI_ROUNDS( 5, 1); SHANI_ROUNDS( 6, 1);
+    SHANI_ROUNDS( 7, 1); SHANI_ROUNDS( 8, 1); SHANI_ROUNDS( 9, 1);
+    SHANI_ROUNDS(10, 2); SHANI_ROUNDS(11, 2); SHANI_ROUNDS(12, 2);
+    SHANI_ROUNDS(13, 2); SHANI_ROUNDS(14, 2); SHANI_ROUNDS(15, 3);
+    SHANI_ROUNDS(16, 3); SHANI_ROUNDS(17, 3); SHANI_ROUNDS(18, 3);
+    SHANI_ROUNDS(19, 3);
+
+    E0 = _mm_sha1nexte_epu32(PREV, E0);
+    ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    data += SHA1_BLOCKSIZE;
+  }
+
+  ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+  _mm_storeu_si128((__m128i *) digest, ABCD);
+  digest[4] = _mm_extract_epi16(E0, 6) | ((uint32_t) _mm_extract_epi16(E0, 7) << 16);
+}
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define F1(b, c, d) (((b) & (c)) | (~(b) & (d)))
+#define F2(b, c, d) ((b) ^ (c) ^ (d))
+#define F3(b, c, d) (((b) & (c)) | ((b) & (d)) | ((c) & (d)))
+
+#define ROUND(f, i)                                                           \
+  do {                                                                        \
+    uint32_t t = ROL(a, 5) + f(b, c, d) + e + WK[i];                          \
+    e = d; d = c; c = ROL(b, 30); b = a; a = t;                               \
+  } while (0)
+
+SHA1_TARGET_SSSE3
+static inline __m128i sha1_ssse3_rol1(__m128i x) {
+  return _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+}
+
+// The rounds stay scalar, the message schedule and the W + K additions are
+// computed four words at a time. W[i + 3] depends on W[i] from the same
+// vector, which is patched up after the rotate.
+SHA1_TARGET_SSSE3
+void sha1_compress_ssse3(uint32_t digest[5], const uint8_t *data,
+                         size_t blocks) {
+  const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                      0x0405060700010203ULL);
+  static const uint32_t K[4] = {
+    0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+  };
+  uint32_t W[80] __attribute__((aligned(16)));
+  uint32_t WK[80] __attribute__((aligned(16)));
+
+  while (blocks--) {
+    for (int i = 0; i < 16; i += 4) {
+      __m128i w = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *) (data + 4 * i)), MASK);
+      _mm_store_si128((__m128i *) &W[i], w);
+    }
+
+    for (int i = 16; i < 80; i += 4) {
+      __m128i w3 = _mm_srli_si128(_mm_loadu_si128((const __m128i *) &W[i - 4]), 4);
+      __m128i w = _mm_xor_si128(
+          _mm_xor_si128(w3, _mm_load_si128((const __m128i *) &W[i - 8])),
+          _mm_xor_si128(_mm_loadu_si128((const __m128i *) &W[i - 14]),
+                        _mm_load_si128((const __m128i *) &W[i - 16])));
+      w = sha1_ssse3_rol1(w);
+      // lane 3 still misses the rotated W[i] term
+      __m128i fix = sha1_ssse3_rol1(_mm_slli_si128(w, 12));
+      w = _mm_xor_si128(w, fix);
+      _mm_store_si128((__m128i *) &W[i], w);
+    }
+
+    for (int i = 0; i < 80; i += 4) {
+      __m128i k = _mm_set1_epi32((int) K[i / 20]);
+      _mm_store_si128((__m128i *) &WK[i],
+                      _mm_add_epi32(_mm_load_si128((const __m128i *) &W[i]), k));
+    }
+
+    uint32_t a = digest[0], b = digest[1], c = digest[2], d = digest[3],
+             e = digest[4];
+    int i = 0;
+    for (; i < 20; ++i) ROUND(F1, i);
+    for (; i < 40; ++i) ROUND(F2, i);
+    for (; i < 60; ++i) ROUND(F3, i);
+    for (; i < 80; ++i) ROUND(F2, i);
+
+    digest[0] += a;
+    digest[1] += b;
+    digest[2] += c;
+    digest[3] += d;
+    digest[4] += e;
+    data += SHA1_BLOCKSIZE;
+  }
+
+  secure_wipe(W, sizeof(W));
+  secure_wipe(WK, sizeof(WK));
+}
+
+#endif /* SHA1_HAVE_X86 */
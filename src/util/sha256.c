@@ -0,0 +1,171 @@
+// SHA-256 (FIPS 180-4)
+
+#include <pthread.h>
+#include <string.h>
+
+#include "util/sha256.h"
+#include "util/secure_mem.h"
+
+const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x) (ROR(x,  2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S1(x) (ROR(x,  6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define s0(x) (ROR(x,  7) ^ ROR(x, 18) ^ ((x) >>  3))
+#define s1(x) (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+
+static inline uint32_t load_be32(const uint8_t *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+         ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+void sha256_compress_generic(uint32_t digest[8], const uint8_t *data,
+                             size_t blocks) {
+  uint32_t W[64];
+
+  while (blocks--) {
+    for (int i = 0; i < 16; ++i) {
+      W[i] = load_be32(data + 4 * i);
+    }
+    for (int i = 16; i < 64; ++i) {
+      W[i] = s1(W[i - 2]) + W[i - 7] + s0(W[i - 15]) + W[i - 16];
+    }
+
+    uint32_t a = digest[0], b = digest[1], c = digest[2], d = digest[3];
+    uint32_t e = digest[4], f = digest[5], g = digest[6], h = digest[7];
+
+    for (int i = 0; i < 64; ++i) {
+      uint32_t t1 = h + S1(e) + CH(e, f, g) + sha256_k[i] + W[i];
+      uint32_t t2 = S0(a) + MAJ(a, b, c);
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    digest[0] += a; digest[1] += b; digest[2] += c; digest[3] += d;
+    digest[4] += e; digest[5] += f; digest[6] += g; digest[7] += h;
+    data += SHA256_BLOCKSIZE;
+  }
+
+  secure_wipe(W, sizeof(W));
+}
+
+typedef struct {
+  const char         *name;
+  sha256_compress_fn compress;
+  int                (*supported)(void);
+} sha256_backend_s;
+
+static const sha256_backend_s sha256_backends[] = {
+#if defined(SHA256_HAVE_X86)
+  { "sha-ni", sha256_compress_shani, sha256_shani_supported },
+#endif
+#if defined(SHA256_HAVE_ARMV8)
+  { "armv8", sha256_compress_armv8, sha256_armv8_supported },
+#endif
+  { "generic", sha256_compress_generic, NULL },
+};
+
+static const sha256_backend_s *sha256_backend = NULL;
+static pthread_once_t sha256_backend_once = PTHREAD_ONCE_INIT;
+
+// Runs once, codes are also computed on the database worker thread
+static void sha256_backend_init(void) {
+  for (size_t i = 0; i < sizeof(sha256_backends) / sizeof(sha256_backends[0]); ++i) {
+    if (sha256_backends[i].supported == NULL || sha256_backends[i].supported()) {
+      sha256_backend = &sha256_backends[i];
+      break;
+    }
+  }
+}
+
+static const sha256_backend_s *sha256_backend_get(void) {
+  pthread_once(&sha256_backend_once, sha256_backend_init);
+  return sha256_backend;
+}
+
+void sha256_compress(uint32_t digest[8], const uint8_t *data, size_t blocks) {
+  sha256_backend_get()->compress(digest, data, blocks);
+}
+
+const char *sha256_backend_name(void) {
+  return sha256_backend_get()->name;
+}
+
+void sha256_init(SHA256_INFO *sha256_info) {
+  static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(sha256_info->digest, iv, sizeof(iv));
+  sha256_info->count = 0;
+  sha256_info->local = 0;
+}
+
+void sha256_update(SHA256_INFO *sha256_info, const uint8_t *buffer, int count) {
+  sha256_info->count += (uint64_t) count;
+
+  if (sha256_info->local) {
+    int i = SHA256_BLOCKSIZE - sha256_info->local;
+    if (i > count) {
+      i = count;
+    }
+    memcpy(sha256_info->data + sha256_info->local, buffer, i);
+    count -= i;
+    buffer += i;
+    sha256_info->local += i;
+    if (sha256_info->local < SHA256_BLOCKSIZE) {
+      return;
+    }
+    sha256_compress(sha256_info->digest, sha256_info->data, 1);
+  }
+  if (count >= SHA256_BLOCKSIZE) {
+    int blocks = count / SHA256_BLOCKSIZE;
+    sha256_compress(sha256_info->digest, buffer, blocks);
+    buffer += blocks * SHA256_BLOCKSIZE;
+    count -= blocks * SHA256_BLOCKSIZE;
+  }
+  memcpy(sha256_info->data, buffer, count);
+  sha256_info->local = count;
+}
+
+void sha256_final(SHA256_INFO *sha256_info, uint8_t digest[32]) {
+  const uint64_t bits = sha256_info->count << 3;
+  int count = sha256_info->local;
+
+  sha256_info->data[count++] = 0x80;
+  if (count > SHA256_BLOCKSIZE - 8) {
+    memset(sha256_info->data + count, 0, SHA256_BLOCKSIZE - count);
+    sha256_compress(sha256_info->digest, sha256_info->data, 1);
+    count = 0;
+  }
+  memset(sha256_info->data + count, 0, SHA256_BLOCKSIZE - 8 - count);
+  store_be32(sha256_info->data + 56, (uint32_t) (bits >> 32));
+  store_be32(sha256_info->data + 60, (uint32_t) bits);
+  sha256_compress(sha256_info->digest, sha256_info->data, 1);
+
+  for (int i = 0; i < 8; ++i) {
+    store_be32(digest + 4 * i, sha256_info->digest[i]);
+  }
+}
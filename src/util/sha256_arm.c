@@ -0,0 +1,67 @@
+// SHA-256 compression backend for the ARMv8 cryptography extension.
+//
+// Built under the same conditions as the SHA1 one in sha1_arm.c.
+
+#include "util/sha256.h"
+
+#if defined(SHA256_HAVE_ARMV8)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#if defined(__aarch64__)
+#include <asm/hwcap.h>
+#define SHA256_HWCAP_TYPE AT_HWCAP
+#define SHA256_HWCAP_BIT  HWCAP_SHA2
+#else
+#define SHA256_HWCAP_TYPE AT_HWCAP2
+#define SHA256_HWCAP_BIT  (1 << 3) /* HWCAP2_SHA2 */
+#endif
+
+int sha256_armv8_supported(void) {
+  return (getauxval(SHA256_HWCAP_TYPE) & SHA256_HWCAP_BIT) != 0;
+}
+
+#define ARMV8_ROUNDS(g)                                                       \
+  do {                                                                        \
+    if ((g) >= 4) {                                                           \
+      M[(g) & 3] = vsha256su1q_u32(                                           \
+          vsha256su0q_u32(M[(g) & 3], M[((g) + 1) & 3]),                      \
+          M[((g) + 2) & 3], M[((g) + 3) & 3]);                                \
+    }                                                                         \
+    uint32x4_t wk = vaddq_u32(M[(g) & 3], vld1q_u32(&sha256_k[4 * (g)]));     \
+    uint32x4_t abcd = STATE0;                                                 \
+    STATE0 = vsha256hq_u32(STATE0, STATE1, wk);                               \
+    STATE1 = vsha256h2q_u32(STATE1, abcd, wk);                                \
+  } while (0)
+
+void sha256_compress_armv8(uint32_t digest[8], const uint8_t *data,
+                           size_t blocks) {
+  uint32x4_t STATE0, STATE1, SAVE0, SAVE1, M[4];
+
+  STATE0 = vld1q_u32(&digest[0]);
+  STATE1 = vld1q_u32(&digest[4]);
+
+  while (blocks--) {
+    SAVE0 = STATE0;
+    SAVE1 = STATE1;
+
+    for (int i = 0; i < 4; ++i) {
+      M[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+
+    ARMV8_ROUNDS( 0); ARMV8_ROUNDS( 1); ARMV8_ROUNDS( 2); ARMV8_ROUNDS( 3);
+    ARMV8_ROUNDS( 4); ARMV8_ROUNDS( 5); ARMV8_ROUNDS( 6); ARMV8_ROUNDS( 7);
+    ARMV8_ROUNDS( 8); ARMV8_ROUNDS( 9); ARMV8_ROUNDS(10); ARMV8_ROUNDS(11);
+    ARMV8_ROUNDS(12); ARMV8_ROUNDS(13); ARMV8_ROUNDS(14); ARMV8_ROUNDS(15);
+
+    STATE0 = vaddq_u32(STATE0, SAVE0);
+    STATE1 = vaddq_u32(STATE1, SAVE1);
+    data += SHA256_BLOCKSIZE;
+  }
+
+  vst1q_u32(&digest[0], STATE0);
+  vst1q_u32(&digest[4], STATE1);
+}
+
+#endif /* SHA256_HAVE_ARMV8 */
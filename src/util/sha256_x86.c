@@ -0,0 +1,77 @@
+// SHA-256 compression backend for the x86 SHA extensions.
+
+#include "util/sha256.h"
+
+#if defined(SHA256_HAVE_X86)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+int sha256_shani_supported(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+    return 0;
+  }
+  if (__get_cpuid_max(0, 0) < 7) {
+    return 0;
+  }
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx & (1u << 29)) != 0;
+}
+
+// Four rounds of group g. M holds the last four message schedule groups,
+// groups from 4 onwards are derived in place from the previous ones.
+#define SHANI_ROUNDS(g)                                                       \
+  do {                                                                        \
+    if ((g) >= 4) {                                                           \
+      __m128i w7 = _mm_alignr_epi8(M[((g) + 3) & 3], M[((g) + 2) & 3], 4);    \
+      M[(g) & 3] = _mm_sha256msg2_epu32(                                      \
+          _mm_add_epi32(_mm_sha256msg1_epu32(M[(g) & 3], M[((g) + 1) & 3]),   \
+                        w7),                                                  \
+          M[((g) + 3) & 3]);                                                  \
+    }                                                                         \
+    __m128i wk = _mm_add_epi32(                                               \
+        M[(g) & 3], _mm_loadu_si128((const __m128i *) &sha256_k[4 * (g)]));   \
+    CDGH = _mm_sha256rnds2_epu32(CDGH, ABEF, wk);                             \
+    ABEF = _mm_sha256rnds2_epu32(ABEF, CDGH, _mm_shuffle_epi32(wk, 0x0E));    \
+  } while (0)
+
+__attribute__((target("sha,sse4.1")))
+void sha256_compress_shani(uint32_t digest[8], const uint8_t *data,
+                           size_t blocks) {
+  const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                      0x0405060700010203ULL);
+  __m128i ABEF, CDGH, ABEF_SAVE, CDGH_SAVE, TMP, M[4];
+
+  // The instructions want the state as ABEF/CDGH
+  TMP = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &digest[0]), 0xB1);
+  CDGH = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &digest[4]), 0x1B);
+  ABEF = _mm_alignr_epi8(TMP, CDGH, 8);
+  CDGH = _mm_blend_epi16(CDGH, TMP, 0xF0);
+
+  while (blocks--) {
+    ABEF_SAVE = ABEF;
+    CDGH_SAVE = CDGH;
+
+    for (int i = 0; i < 4; ++i) {
+      M[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *) (data + 16 * i)), MASK);
+    }
+
+    SHANI_ROUNDS( 0); SHANI_ROUNDS( 1); SHANI_ROUNDS( 2); SHANI_ROUNDS( 3);
+    SHANI_ROUNDS( 4); SHANI_ROUNDS( 5); SHANI_ROUNDS( 6); SHANI_ROUNDS( 7);
+    SHANI_ROUNDS( 8); SHANI_ROUNDS( 9); SHANI_ROUNDS(10); SHANI_ROUNDS(11);
+    SHANI_ROUNDS(12); SHANI_ROUNDS(13); SHANI_ROUNDS(14); SHANI_ROUNDS(15);
+
+    ABEF = _mm_add_epi32(ABEF, ABEF_SAVE);
+    CDGH = _mm_add_epi32(CDGH, CDGH_SAVE);
+    data += SHA256_BLOCKSIZE;
+  }
+
+  TMP = _mm_shuffle_epi32(ABEF, 0x1B);
+  CDGH = _mm_shuffle_epi32(CDGH, 0xB1);
+  _mm_storeu_si128((__m128i *) &digest[0], _mm_blend_epi16(TMP, CDGH, 0xF0));
+  _mm_storeu_si128((__m128i *) &digest[4], _mm_alignr_epi8(CDGH, TMP, 8));
+}
+
+#endif /* SHA256_HAVE_X86 */
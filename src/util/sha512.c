@@ -0,0 +1,156 @@
+// SHA-512 (FIPS 180-4)
+
+#include <string.h>
+
+#include "util/sha512.h"
+#include "util/secure_mem.h"
+
+static const uint64_t sha512_k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x) (ROR(x, 28) ^ ROR(x, 34) ^ ROR(x, 39))
+#define S1(x) (ROR(x, 14) ^ ROR(x, 18) ^ ROR(x, 41))
+#define s0(x) (ROR(x,  1) ^ ROR(x,  8) ^ ((x) >> 7))
+#define s1(x) (ROR(x, 19) ^ ROR(x, 61) ^ ((x) >> 6))
+
+static inline uint64_t load_be64(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v) {
+  for (int i = 7; i >= 0; --i, v >>= 8) {
+    p[i] = (uint8_t) v;
+  }
+}
+
+// The schedule is kept in a 16 word ring instead of 80 words, which keeps
+// the working set in registers on 64 bit targets.
+void sha512_compress(uint64_t digest[8], const uint8_t *data, size_t blocks) {
+  uint64_t W[16];
+
+  while (blocks--) {
+    uint64_t a = digest[0], b = digest[1], c = digest[2], d = digest[3];
+    uint64_t e = digest[4], f = digest[5], g = digest[6], h = digest[7];
+
+    for (int i = 0; i < 80; ++i) {
+      uint64_t w;
+      if (i < 16) {
+        w = W[i] = load_be64(data + 8 * i);
+      } else {
+        w = W[i & 15] += s1(W[(i - 2) & 15]) + W[(i - 7) & 15] +
+                         s0(W[(i - 15) & 15]);
+      }
+      uint64_t t1 = h + S1(e) + CH(e, f, g) + sha512_k[i] + w;
+      uint64_t t2 = S0(a) + MAJ(a, b, c);
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    digest[0] += a; digest[1] += b; digest[2] += c; digest[3] += d;
+    digest[4] += e; digest[5] += f; digest[6] += g; digest[7] += h;
+    data += SHA512_BLOCKSIZE;
+  }
+
+  secure_wipe(W, sizeof(W));
+}
+
+void sha512_init(SHA512_INFO *sha512_info) {
+  static const uint64_t iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+  memcpy(sha512_info->digest, iv, sizeof(iv));
+  sha512_info->count_lo = 0;
+  sha512_info->count_hi = 0;
+  sha512_info->local = 0;
+}
+
+void sha512_update(SHA512_INFO *sha512_info, const uint8_t *buffer, int count) {
+  const uint64_t lo = sha512_info->count_lo + (uint64_t) count;
+  if (lo < sha512_info->count_lo) {
+    ++sha512_info->count_hi;
+  }
+  sha512_info->count_lo = lo;
+
+  if (sha512_info->local) {
+    int i = SHA512_BLOCKSIZE - sha512_info->local;
+    if (i > count) {
+      i = count;
+    }
+    memcpy(sha512_info->data + sha512_info->local, buffer, i);
+    count -= i;
+    buffer += i;
+    sha512_info->local += i;
+    if (sha512_info->local < SHA512_BLOCKSIZE) {
+      return;
+    }
+    sha512_compress(sha512_info->digest, sha512_info->data, 1);
+  }
+  if (count >= SHA512_BLOCKSIZE) {
+    int blocks = count / SHA512_BLOCKSIZE;
+    sha512_compress(sha512_info->digest, buffer, blocks);
+    buffer += blocks * SHA512_BLOCKSIZE;
+    count -= blocks * SHA512_BLOCKSIZE;
+  }
+  memcpy(sha512_info->data, buffer, count);
+  sha512_info->local = count;
+}
+
+void sha512_final(SHA512_INFO *sha512_info, uint8_t digest[64]) {
+  // count_lo/hi hold bytes, the trailer wants a 128 bit count of bits
+  const uint64_t bits_hi = (sha512_info->count_hi << 3) |
+                           (sha512_info->count_lo >> 61);
+  const uint64_t bits_lo = sha512_info->count_lo << 3;
+  int count = sha512_info->local;
+
+  sha512_info->data[count++] = 0x80;
+  if (count > SHA512_BLOCKSIZE - 16) {
+    memset(sha512_info->data + count, 0, SHA512_BLOCKSIZE - count);
+    sha512_compress(sha512_info->digest, sha512_info->data, 1);
+    count = 0;
+  }
+  memset(sha512_info->data + count, 0, SHA512_BLOCKSIZE - 16 - count);
+  store_be64(sha512_info->data + 112, bits_hi);
+  store_be64(sha512_info->data + 120, bits_lo);
+  sha512_compress(sha512_info->digest, sha512_info->data, 1);
+
+  for (int i = 0; i < 8; ++i) {
+    store_be64(digest + 8 * i, sha512_info->digest[i]);
+  }
+}
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/strpool.h"
+
+// Bytes of string storage allocated at once
+#define STRPOOL_CHUNK_SIZE 4096
+
+struct strpool_chunk {
+  strpool_chunk_s *next;
+  size_t          size;
+  size_t          used;
+  // Keeps the strings after the header aligned for their length prefix
+  uint16_t        data[];
+};
+
+static uint32_t strpool_hash(const char *s, size_t len) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ (uint8_t) s[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static strpool_str_s *strpool_store(strpool_s *pool, const char *s, size_t len) {
+  const size_t need = (sizeof(strpool_str_s) + len + 1 + 1) & ~(size_t) 1;
+  strpool_chunk_s *chunk = pool->chunks;
+
+  if (chunk == NULL || chunk->size - chunk->used < need) {
+    const size_t size = need > STRPOOL_CHUNK_SIZE ? need : STRPOOL_CHUNK_SIZE;
+
+    chunk = malloc(sizeof(strpool_chunk_s) + size);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    // Large strings get a chunk of their own, the current one stays open
+    if (size > STRPOOL_CHUNK_SIZE && pool->chunks != NULL) {
+      chunk->next = pool->chunks->next;
+      pool->chunks->next = chunk;
+    } else {
+      chunk->next = pool->chunks;
+      pool->chunks = chunk;
+    }
+  }
+
+  strpool_str_s *str = (strpool_str_s *) ((uint8_t *) chunk->data + chunk->used);
+  chunk->used += need;
+
+  str->len = len;
+  memcpy(str->data, s, len);
+  str->data[len] = '\0';
+
+  return str;
+}
+
+// Open addressing with linear probing, kept below 3/4 full
+static int strpool_grow(strpool_s *pool) {
+  const size_t capacity = pool->capacity ? pool->capacity * 2 : 64;
+  strpool_str_s **slots = calloc(capacity, sizeof(*slots));
+
+  if (slots == NULL) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < pool->capacity; ++i) {
+    strpool_str_s *str = pool->slots[i];
+    if (str == NULL) {
+      continue;
+    }
+    size_t j = strpool_hash(str->data, str->len) & (capacity - 1);
+    while (slots[j] != NULL) {
+      j = (j + 1) & (capacity - 1);
+    }
+    slots[j] = str;
+  }
+
+  free(pool->slots);
+  pool->slots = slots;
+  pool->capacity = capacity;
+
+  return 1;
+}
+
+const strpool_str_s *strpool_intern(strpool_s *pool, const char *s, size_t len) {
+  strpool_str_s *str = NULL;
+
+  if (len > STRPOOL_MAX_LEN) {
+    len = STRPOOL_MAX_LEN;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+
+  if ((pool->count + 1) * 4 > pool->capacity * 3 && !strpool_grow(pool)) {
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+  }
+
+  size_t i = strpool_hash(s, len) & (pool->capacity - 1);
+  while ((str = pool->slots[i]) != NULL) {
+    if (str->len == len && memcmp(str->data, s, len) == 0) {
+      break;
+    }
+    i = (i + 1) & (pool->capacity - 1);
+  }
+
+  if (str == NULL) {
+    str = strpool_store(pool, s, len);
+    if (str != NULL) {
+      pool->slots[i] = str;
+      pool->count++;
+    }
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return str;
+}
+
+void strpool_destroy(strpool_s *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->chunks != NULL) {
+    strpool_chunk_s *chunk = pool->chunks;
+    pool->chunks = chunk->next;
+    free(chunk);
+  }
+  free(pool->slots);
+  pool->slots = NULL;
+  pool->capacity = 0;
+  pool->count = 0;
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/trace.h"
+
+static int64_t trace_origin_us;
+
+// The start time in /proc is counted in clock ticks since boot.
+static int64_t _boottime_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_BOOTTIME, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Returns the start of the process, field 22 of /proc/self/stat, or 0.
+static int64_t _process_start_us(void) {
+  char stat[512];
+  unsigned long long ticks;
+  FILE *file = fopen("/proc/self/stat", "r");
+
+  if (file == NULL) {
+    return 0;
+  }
+  const size_t length = fread(stat, 1, sizeof(stat) - 1, file);
+  fclose(file);
+  stat[length] = '\0';
+
+  // The command name may contain spaces, fields are counted after it.
+  const char *fields = strrchr(stat, ')');
+  if (fields == NULL ||
+      sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+             "%*d %*d %*d %*d %*d %*d %llu", &ticks) != 1) {
+    return 0;
+  }
+
+  const long hz = sysconf(_SC_CLK_TCK);
+  return hz > 0 ? (int64_t) (ticks * 1000000 / hz) : 0;
+}
+
+void trace_start(void) {
+  trace_origin_us = _process_start_us();
+  if (trace_origin_us == 0) {
+    trace_origin_us = _boottime_us();
+  }
+}
+
+size_t trace_mark(const char *phase, char *out, size_t size) {
+  const int64_t us = _boottime_us() - trace_origin_us;
+  const int length = snprintf(out, size, "{\"trace\":\"startup\",\"phase\":\"%s\",\"us\":%lld}",
+                              phase, (long long) us);
+  return length < 0 ? 0 : (size_t) length;
+}
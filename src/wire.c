@@ -0,0 +1,320 @@
+#include <stdbool.h>
+#include <string.h>
+#include "util/hash.h"
+#include "util/secure_mem.h"
+#include "wire.h"
+
+typedef enum decoder_state {
+  STATE_HEADER,
+  STATE_RECORD,   /* fixed part of a record */
+  STATE_LABEL,    /* label and key length */
+  STATE_KEY,
+  STATE_DONE,
+  STATE_ERROR
+} decoder_state_e;
+
+/* Size of the records of the sync frames */
+static const size_t record_size[WIRE_TYPE_COUNT] = {
+  [WIRE_SYNC_SUMMARY] = 8,
+  [WIRE_SYNC_DIGEST]  = 21,
+  [WIRE_SYNC_REQUEST] = 8,
+  [WIRE_SYNC_COUNTER] = 12,
+};
+
+static uint32_t crc_table[256];
+
+uint32_t wire_crc32(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *p = data;
+
+  if (crc_table[1] == 0) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      crc_table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  while (length--) {
+    crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void _put16(uint8_t *out, uint16_t v) {
+  out[0] = v >> 8;
+  out[1] = v;
+}
+
+static void _put32(uint8_t *out, uint32_t v) {
+  out[0] = v >> 24;
+  out[1] = v >> 16;
+  out[2] = v >> 8;
+  out[3] = v;
+}
+
+static uint16_t _get16(const uint8_t *in) {
+  return (uint16_t) (in[0] << 8 | in[1]);
+}
+
+static uint32_t _get32(const uint8_t *in) {
+  return (uint32_t) in[0] << 24 | (uint32_t) in[1] << 16 | (uint32_t) in[2] << 8 | in[3];
+}
+
+static uint64_t _get64(const uint8_t *in) {
+  return (uint64_t) _get32(in) << 32 | _get32(in + 4);
+}
+
+void wire_write_header(uint8_t *out, const wire_header_s *header) {
+  out[0] = WIRE_MAGIC_0;
+  out[1] = WIRE_MAGIC_1;
+  out[2] = header->version;
+  out[3] = header->type;
+  _put16(out + 4, header->seq);
+  _put32(out + 6, header->length);
+  _put32(out + 10, header->crc);
+}
+
+int wire_read_header(const uint8_t *in, wire_header_s *header) {
+  if (in[0] != WIRE_MAGIC_0 || in[1] != WIRE_MAGIC_1 || in[2] < 1 || in[2] > WIRE_VERSION) {
+    return false;
+  }
+
+  header->version = in[2];
+  header->type    = in[3];
+  header->seq     = _get16(in + 4);
+  header->length  = _get32(in + 6);
+  header->crc     = _get32(in + 10);
+
+  return true;
+}
+
+size_t wire_encode_entry(uint8_t *out, size_t size, const otp_info_s *entry) {
+  const size_t label_len = otp_label_len(entry);
+  const size_t key_len = entry->key ? entry->key->len : 0;
+  const size_t length = WIRE_RECORD_FIXED + label_len + 1 + key_len;
+
+  if (length > size) {
+    return 0;
+  }
+
+  out[0] = entry->type;
+  out[1] = entry->algorithm;
+  out[2] = entry->digits;
+  out[3] = entry->deleted ? WIRE_FLAG_DELETED : 0;
+  _put16(out + 4, entry->period);
+  _put32(out + 6, entry->counter);
+  _put32(out + 10, entry->uid >> 32);
+  _put32(out + 14, entry->uid);
+  _put32(out + 18, entry->rev);
+  out[22] = label_len;
+  memcpy(out + 23, otp_label(entry), label_len);
+  out[23 + label_len] = key_len;
+  if (key_len) {
+    memcpy(out + 24 + label_len, entry->key->bytes, key_len);
+  }
+
+  return length;
+}
+
+void wire_seal(uint8_t *out, wire_type_e type, uint16_t seq, size_t length) {
+  wire_header_s header = {
+    .version = WIRE_VERSION,
+    .type    = type,
+    .seq     = seq,
+    .length  = length,
+    .crc     = wire_crc32(0, out + WIRE_HEADER_SIZE, length)
+  };
+  wire_write_header(out, &header);
+}
+
+size_t wire_encode_ack(uint8_t *out, size_t size, const wire_header_s *request,
+                       const uint8_t *status, uint32_t count) {
+  const size_t length = 8 + (size_t) count;
+  uint32_t stored = 0;
+
+  if (WIRE_HEADER_SIZE + length > size) {
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    stored += status[i] == WIRE_STATUS_OK;
+  }
+
+  uint8_t *payload = out + WIRE_HEADER_SIZE;
+  _put32(payload, count);
+  _put32(payload + 4, stored);
+  memcpy(payload + 8, status, count);
+
+  /* Acks are understood by senders of any version */
+  wire_header_s header = {
+    .version = request->version ? request->version : WIRE_VERSION,
+    .type    = WIRE_ACK,
+    .seq     = request->seq,
+    .length  = length,
+    .crc     = wire_crc32(0, payload, length)
+  };
+  wire_write_header(out, &header);
+
+  return WIRE_HEADER_SIZE + length;
+}
+
+static size_t _fixed_size(const wire_decoder_s *d) {
+  return d->header.version < 2 ? WIRE_RECORD_FIXED_V1 : WIRE_RECORD_FIXED;
+}
+
+/* Turns a complete record into an entry and hands it to the callback */
+static void _decode_record(wire_decoder_s *d) {
+  otp_info_s *entry = &d->entry;
+  const uint8_t *rec = d->buf;
+  const size_t fixed = _fixed_size(d);
+  const size_t label_len = rec[fixed - 1];
+  const size_t key_len = rec[fixed + label_len];
+  const char *error = NULL;
+
+  memset(entry, 0, sizeof(*entry));
+  entry->type      = rec[0] == HOTP ? HOTP : TOTP;
+  entry->algorithm = rec[1];
+  entry->digits    = rec[2];
+  entry->deleted   = (rec[3] & WIRE_FLAG_DELETED) != 0;
+  entry->period    = _get16(rec + 4);
+  entry->counter   = _get32(rec + 6);
+  if (fixed == WIRE_RECORD_FIXED) {
+    entry->uid     = _get64(rec + 10);
+    entry->rev     = _get32(rec + 18);
+  }
+  otp_set_label(entry, (const char *) rec + fixed, strnlen((const char *) rec + fixed, label_len));
+
+  if (entry->deleted) {
+    /* Tombstones carry only their identity */
+    if (entry->uid == 0) error = "missing uid";
+  } else if (hash_backend(entry->algorithm) == NULL) {
+    error = "unsupported algorithm";
+  } else if (entry->digits && (entry->digits < OTP_MIN_DIGITS || entry->digits > OTP_MAX_DIGITS)) {
+    error = "unsupported number of digits";
+  } else if (!otp_set_key(entry, rec + fixed + 1 + label_len, key_len)) {
+    error = "invalid secret";
+  } else if (otp_label_len(entry) == 0) {
+    error = "missing label or secret";
+  }
+
+  d->cb(d->data, entry, error);
+
+  otp_info_clear(entry);
+  secure_wipe(d->buf, d->have);
+}
+
+/* Decodes a complete record and waits for the next one */
+static void _end_record(wire_decoder_s *d) {
+  _decode_record(d);
+  d->have = 0;
+  d->need = _fixed_size(d);
+  d->state = STATE_RECORD;
+}
+
+/* Moves on once the current part of the frame has been read */
+static void _advance(wire_decoder_s *d) {
+  switch (d->state) {
+  case STATE_HEADER:
+    if (!wire_read_header(d->buf, &d->header) || d->header.type >= WIRE_TYPE_COUNT ||
+        (d->header.type != WIRE_ENTRIES && (record_size[d->header.type] == 0 || d->record_cb == NULL)) ||
+        d->header.length > WIRE_MAX_PAYLOAD) {
+      d->state = STATE_ERROR;
+      return;
+    }
+    d->remaining = d->header.length;
+    d->crc = 0;
+    d->have = 0;
+    d->need = d->header.type == WIRE_ENTRIES ? _fixed_size(d) : record_size[d->header.type];
+    d->state = STATE_RECORD;
+    break;
+
+  case STATE_RECORD:
+    if (d->header.type != WIRE_ENTRIES) {
+      d->record_cb(d->data, d->header.type, d->buf, d->have);
+      d->have = 0;
+      break;
+    }
+    d->need = _fixed_size(d) + d->buf[d->need - 1] + 1;
+    d->state = STATE_LABEL;
+    return;
+
+  case STATE_LABEL:
+    d->need += d->buf[d->need - 1];
+    if (d->need > d->have) {
+      d->state = STATE_KEY;
+      return;
+    }
+    /* An empty key ends the record right away */
+    _end_record(d);
+    break;
+
+  case STATE_KEY:
+    _end_record(d);
+    break;
+
+  default:
+    return;
+  }
+
+  /* The frame ends between two records */
+  if (d->remaining == 0) {
+    d->crc_ok = d->crc == d->header.crc;
+    d->state = STATE_DONE;
+  }
+}
+
+void wire_decoder_init(wire_decoder_s *decoder, entry_parser_cb cb, wire_record_cb record_cb, void *data) {
+  memset(decoder, 0, sizeof(*decoder));
+  decoder->need = WIRE_HEADER_SIZE;
+  decoder->cb = cb;
+  decoder->record_cb = record_cb;
+  decoder->data = data;
+}
+
+void wire_decoder_reset(wire_decoder_s *decoder) {
+  secure_wipe(decoder->buf, sizeof(decoder->buf));
+  wire_decoder_init(decoder, decoder->cb, decoder->record_cb, decoder->data);
+}
+
+wire_decoder_status_e wire_decoder_feed(wire_decoder_s *decoder, const uint8_t *data, size_t length, size_t *consumed) {
+  wire_decoder_s *d = decoder;
+  size_t used = 0;
+
+  if (d->state == STATE_DONE) {
+    wire_decoder_reset(d);
+  }
+
+  while (d->state != STATE_DONE && d->state != STATE_ERROR && (used < length || d->have == d->need)) {
+    if (d->have < d->need) {
+      size_t n = d->need - d->have;
+      if (n > length - used) n = length - used;
+
+      if (d->state != STATE_HEADER) {
+        /* A record can't run past the end of the payload */
+        if (d->need - d->have > d->remaining) {
+          d->state = STATE_ERROR;
+          break;
+        }
+        d->remaining -= n;
+        d->crc = wire_crc32(d->crc, data + used, n);
+      }
+
+      memcpy(d->buf + d->have, data + used, n);
+      d->have += n;
+      used += n;
+    }
+
+    if (d->have == d->need) {
+      _advance(d);
+    }
+  }
+
+  if (consumed) *consumed = used;
+
+  if (d->state == STATE_ERROR) return WIRE_DECODER_ERROR;
+  if (d->state == STATE_DONE) return WIRE_DECODER_IDLE;
+  return WIRE_DECODER_MORE;
+}
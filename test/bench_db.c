@@ -0,0 +1,161 @@
+/* Latency of one database operation on a local file, before and after the
+ * connection was kept open. Before, every call opened the file, built its
+ * SQL text with sqlite3_mprintf() and ran it with sqlite3_exec() on the
+ * original schema and journal. After, the db_* API runs its prepared
+ * statements on the connection opened by db_init(). A HOTP renew is a
+ * select of the entry and a counter increment. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "database.h"
+
+#define BENCH_ENTRIES 200
+#define BENCH_OPS     2000
+
+#define SECRET "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"
+
+static char before_path[64];
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(const char *name, double before, double after) {
+  printf("%-16s %10.1f us/op before %8.1f us/op after %6.1fx\n", name, before * 1e6 / BENCH_OPS,
+         after * 1e6 / BENCH_OPS, before / after);
+}
+
+/* What every call of the old database.c did */
+static int _before_exec(const char *sql, sqlite3_callback callback, void *data) {
+  sqlite3 *otp_db;
+
+  if (sqlite3_open_v2(before_path, &otp_db, SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+    sqlite3_close(otp_db);
+    return SQLITE_ERROR;
+  }
+  const int ret = sqlite3_exec(otp_db, sql, callback, data, NULL);
+  sqlite3_close(otp_db);
+
+  return ret;
+}
+
+static int _before_insert(int counter) {
+  char *sql = sqlite3_mprintf("INSERT INTO entries VALUES(%d, %Q, %d, %Q, NULL);", HOTP, "Bench:before", counter,
+                              SECRET);
+  const int ret = _before_exec(sql, NULL, NULL);
+
+  sqlite3_free(sql);
+  return ret;
+}
+
+static int _before_row_cb(void *data, int count, char **values, char **columns) {
+  otp_info_s *entry = data;
+
+  entry->type = atoi(values[0]);
+  otp_set_label(entry, values[1], strlen(values[1]));
+  entry->counter = atoi(values[2]);
+  otp_set_secret(entry, values[3]);
+  entry->id = atoi(values[4]);
+
+  return SQLITE_OK;
+}
+
+static int _before_select_id(int id) {
+  otp_info_s entry = { 0 };
+  char *sql = sqlite3_mprintf("SELECT * FROM entries WHERE ID=%d;", id);
+  const int ret = _before_exec(sql, _before_row_cb, &entry);
+
+  sqlite3_free(sql);
+  otp_info_clear(&entry);
+  return ret;
+}
+
+static int _before_inc_counter(int id) {
+  char *sql = sqlite3_mprintf("UPDATE entries SET COUNTER = COUNTER + 1 WHERE ID=%d;", id);
+  const int ret = _before_exec(sql, NULL, NULL);
+
+  sqlite3_free(sql);
+  return ret;
+}
+
+static int _after_select_id(int id) {
+  otp_list_s list = { 0 };
+  const int ret = db_select_id(&list, id);
+
+  otp_list_clear(&list);
+  return ret;
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_bench_db_XXXXXX";
+  char path[sizeof(dir) + 1];
+  otp_info_s entry = { .type = HOTP };
+  int failed = 0;
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  snprintf(before_path, sizeof(before_path), "%s/before.db", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+
+  failed |= _before_exec("CREATE TABLE entries (TYPE INTEGER NOT NULL, LABEL TEXT NOT NULL, \
+                          COUNTER INTEGET NOT NULL, SECRET TEXT NOT NULL, ID INTEGER PRIMARY KEY AUTOINCREMENT);",
+                         NULL, NULL);
+  failed |= db_init();
+  otp_set_label(&entry, "Bench:after", 11);
+  otp_set_secret(&entry, SECRET);
+
+  /* Both tables start with the same rows */
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    failed |= _before_insert(i);
+    failed |= db_insert(&entry);
+  }
+
+  double start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= _before_insert(i);
+  double before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= db_insert(&entry);
+  _report("insert", before, _now() - start);
+
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= _before_select_id(1 + i % BENCH_ENTRIES);
+  before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= _after_select_id(1 + i % BENCH_ENTRIES);
+  _report("select id", before, _now() - start);
+
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= _before_inc_counter(1 + i % BENCH_ENTRIES);
+  before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= db_inc_counter(1 + i % BENCH_ENTRIES);
+  _report("inc counter", before, _now() - start);
+
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    failed |= _before_select_id(1 + i % BENCH_ENTRIES);
+    failed |= _before_inc_counter(1 + i % BENCH_ENTRIES);
+  }
+  before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    failed |= _after_select_id(1 + i % BENCH_ENTRIES);
+    failed |= db_inc_counter(1 + i % BENCH_ENTRIES);
+  }
+  _report("renew", before, _now() - start);
+
+  otp_info_clear(&entry);
+  db_close();
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  if (failed) fprintf(stderr, "bench_db: an operation failed\n");
+  return failed != 0;
+}
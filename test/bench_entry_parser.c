@@ -0,0 +1,169 @@
+/* Entry message parsing: the incremental parser against the json-glib DOM
+ * walk of the first releases, which is only built if json-glib is found.
+ * Allocations are counted by wrapping malloc and friends. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "entry_parser.h"
+#ifdef HAVE_JSON_GLIB
+#include <json-glib/json-glib.h>
+#endif
+
+#define BULK_ENTRIES 1000
+#define BENCH_BYTES  (64 << 20)
+
+static long allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocs++;
+  return __real_realloc(ptr, size);
+}
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(const char *name, size_t bytes, long entries, double seconds, long allocated) {
+  printf("%-22s %8.1f MB/s %9.1f ns/entry %8.2f allocs/entry\n",
+         name, bytes / seconds / 1e6, seconds * 1e9 / entries, (double) allocated / entries);
+}
+
+static void _entry_cb(void *data, otp_info_s *entry, const char *error) {
+  if (error == NULL) (*(long *) data)++;
+}
+
+static long _parse(const char *message, size_t length) {
+  entry_parser_s parser;
+  long entries = 0;
+
+  entry_parser_init(&parser, _entry_cb, &entries);
+  entry_parser_feed(&parser, message, length);
+
+  return entries;
+}
+
+#ifdef HAVE_JSON_GLIB
+/* An object is walked as add_entry() did, member and value lists side by
+ * side with strcmp on every key */
+static long _json_glib_entry(JsonNode *node) {
+  otp_info_s entry = { 0 };
+  const char *label = NULL, *secret = NULL;
+
+  if (JSON_NODE_TYPE(node) != JSON_NODE_OBJECT) return 0;
+
+  JsonObject *object = json_node_get_object(node);
+  GList *keys = json_object_get_members(object);
+  GList *values = json_object_get_values(object);
+
+  for (GList *k = keys, *v = values; k != NULL && v != NULL; k = k->next, v = v->next) {
+    const gchar *key = k->data;
+    JsonNode *value = v->data;
+
+    if (JSON_NODE_TYPE(value) != JSON_NODE_VALUE) continue;
+
+    if (strcmp(key, "type") == 0) entry.type = strcmp(json_node_get_string(value), "HOTP") == 0 ? HOTP : TOTP;
+    else if (strcmp(key, "counter") == 0) entry.counter = json_node_get_int(value);
+    else if (strcmp(key, "digits") == 0) entry.digits = json_node_get_int(value);
+    else if (strcmp(key, "period") == 0) entry.period = json_node_get_int(value);
+    else if (strcmp(key, "label") == 0) label = json_node_get_string(value);
+    else if (strcmp(key, "secret") == 0) secret = json_node_get_string(value);
+  }
+
+  const long valid = label != NULL && secret != NULL &&
+                     otp_set_label(&entry, label, strlen(label)) && otp_set_secret(&entry, secret);
+  otp_info_clear(&entry);
+  g_list_free(keys);
+  g_list_free(values);
+
+  return valid;
+}
+
+static long _json_glib_parse(const char *message, size_t length) {
+  JsonParser *parser = json_parser_new();
+  GError *error = NULL;
+  long entries = 0;
+
+  if (json_parser_load_from_data(parser, message, length, &error)) {
+    JsonNode *root = json_parser_get_root(parser);
+
+    if (JSON_NODE_TYPE(root) == JSON_NODE_ARRAY) {
+      JsonArray *array = json_node_get_array(root);
+      for (guint i = 0; i < json_array_get_length(array); i++) {
+        entries += _json_glib_entry(json_array_get_element(array, i));
+      }
+    } else {
+      entries += _json_glib_entry(root);
+    }
+  } else {
+    g_error_free(error);
+  }
+  g_object_unref(parser);
+
+  return entries;
+}
+#endif
+
+static void _bench(const char *name, long (*parse)(const char *, size_t), const char *message, long expected) {
+  const size_t length = strlen(message);
+  const long rounds = BENCH_BYTES / length + 1;
+  long entries = 0;
+
+  if (parse(message, length) != expected) {
+    printf("%-22s parsed a wrong number of entries\n", name);
+    return;
+  }
+
+  const long before = allocs;
+  const double start = _now();
+  for (long i = 0; i < rounds; i++) {
+    entries += parse(message, length);
+  }
+  _report(name, length * rounds, entries, _now() - start, allocs - before);
+}
+
+int main(void) {
+  static const char single[] =
+    "{\"type\":\"TOTP\",\"label\":\"Example:alice@example.com\",\"secret\":\"GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ\","
+    "\"counter\":0,\"digits\":6,\"period\":30}";
+  char *bulk = malloc(BULK_ENTRIES * sizeof(single) + 2);
+  size_t length = 0;
+
+  bulk[length++] = '[';
+  for (int i = 0; i < BULK_ENTRIES; i++) {
+    length += sprintf(bulk + length, "%s{\"type\":\"%s\",\"label\":\"Issuer%d:user%d@example.com\","
+                      "\"secret\":\"GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ\",\"counter\":%d}",
+                      i ? "," : "", i % 3 ? "TOTP" : "HOTP", i % 50, i, i);
+  }
+  bulk[length++] = ']';
+  bulk[length] = '\0';
+
+  _bench("parser single", _parse, single, 1);
+  _bench("parser bulk", _parse, bulk, BULK_ENTRIES);
+#ifdef HAVE_JSON_GLIB
+  _bench("json-glib single", _json_glib_parse, single, 1);
+  _bench("json-glib bulk", _json_glib_parse, bulk, BULK_ENTRIES);
+#else
+  printf("json-glib not found, its path isn't measured\n");
+#endif
+
+  free(bulk);
+  return 0;
+}
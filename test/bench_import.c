@@ -0,0 +1,162 @@
+/* Import of 1k entries through add_entries() and the db worker, into a
+ * database in a temporary directory. Before bulk imports every entry came
+ * as its own message stored in its own transaction, now a JSON array or
+ * a binary frame is stored in a single one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Ecore.h>
+#include "database.h"
+#include "db_worker.h"
+#include "import.h"
+#include "wire.h"
+
+#define BENCH_ENTRIES 1000
+
+#define SECRET "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"
+
+typedef struct main_call {
+  Ecore_Cb func;
+  void     *data;
+} main_call_s;
+
+static GAsyncQueue *main_calls;
+static int replies;
+static int failed;
+
+void ecore_main_loop_thread_safe_call_async(Ecore_Cb callback, void *data) {
+  main_call_s *call = g_new(main_call_s, 1);
+
+  call->func = callback;
+  call->data = data;
+  g_async_queue_push(main_calls, call);
+}
+
+/* Runs the calls posted to the main loop until *counter reaches target */
+static void _run_until(const int *counter, int target) {
+  while (*counter < target) {
+    main_call_s *call = g_async_queue_timeout_pop(main_calls, 10 * G_USEC_PER_SEC);
+
+    if (call == NULL) {
+      failed = 1;
+      return;
+    }
+    call->func(call->data);
+    g_free(call);
+  }
+}
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _init_done(void *data, int ret) {
+  failed |= ret != SQLITE_OK;
+  replies++;
+}
+
+static void _replied(void *data, const gchar *reply, gsize reply_length, const GArray *changed) {
+  failed |= changed == NULL;
+  replies++;
+}
+
+static int _object(char *out, size_t size, const char *prefix, int i) {
+  return snprintf(out, size, "{\"label\":\"%s:user%d@example.com\",\"secret\":\""SECRET"\"}", prefix, i);
+}
+
+/* Every entry a message of its own */
+static double _separate(void) {
+  char object[128];
+  const double start = _now();
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    const int length = _object(object, sizeof(object), "Separate", i);
+    add_entries(object, length, _replied, NULL);
+    _run_until(&replies, replies + 1);
+  }
+  return _now() - start;
+}
+
+static double _array(void) {
+  GString *message = g_string_new("[");
+  char object[128];
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    _object(object, sizeof(object), "Array", i);
+    g_string_append_printf(message, "%s%s", i ? "," : "", object);
+  }
+  g_string_append(message, "]");
+
+  const double start = _now();
+  add_entries(message->str, message->len, _replied, NULL);
+  _run_until(&replies, replies + 1);
+  const double seconds = _now() - start;
+
+  g_string_free(message, TRUE);
+  return seconds;
+}
+
+static double _frame(void) {
+  uint8_t *frame = malloc(WIRE_HEADER_SIZE + BENCH_ENTRIES * WIRE_RECORD_MAX);
+  size_t length = 0;
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    otp_info_s entry = { .type = TOTP };
+    char label[64];
+
+    otp_set_label(&entry, label, snprintf(label, sizeof(label), "Frame:user%d@example.com", i));
+    otp_set_secret(&entry, SECRET);
+    length += wire_encode_entry(frame + WIRE_HEADER_SIZE + length, BENCH_ENTRIES * WIRE_RECORD_MAX - length, &entry);
+    otp_info_clear(&entry);
+  }
+  wire_seal(frame, WIRE_ENTRIES, 1, length);
+
+  const double start = _now();
+  add_entries((const char *) frame, WIRE_HEADER_SIZE + length, _replied, NULL);
+  _run_until(&replies, replies + 1);
+  const double seconds = _now() - start;
+
+  free(frame);
+  return seconds;
+}
+
+static void _report(const char *name, double seconds) {
+  printf("%-20s %10.1f ms for %d entries %8.1f us/entry\n", name, seconds * 1e3, BENCH_ENTRIES,
+         seconds * 1e6 / BENCH_ENTRIES);
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_bench_import_XXXXXX";
+  char path[sizeof(dir) + 1];
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+
+  main_calls = g_async_queue_new();
+  db_init_async(_init_done, NULL);
+  _run_until(&replies, 1);
+
+  _report("message per entry", _separate());
+  _report("json array", _array());
+  _report("binary frame", _frame());
+
+  otp_list_s list = { 0 };
+  failed |= db_select_all(&list) != SQLITE_OK || list.count != 3 * BENCH_ENTRIES;
+  otp_list_clear(&list);
+
+  db_worker_stop();
+  db_close();
+  g_async_queue_unref(main_calls);
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  if (failed) fprintf(stderr, "bench_import: an import failed\n");
+  return failed;
+}
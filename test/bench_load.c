@@ -0,0 +1,179 @@
+/* Load time and peak RSS of reading 5k entries. Before, sqlite3_exec()
+ * called back for every row, which was copied into a malloc'ed 780 byte
+ * otp_info_s appended to a GList, and the menu then copied every entry
+ * again into a block of its own. Now db_select_all() steps its prepared
+ * statement into one contiguous otp_list_s, key schedules included, and
+ * the menu refers to the entries in place. Every load runs in a child of
+ * its own, whose peak RSS is reported by wait4() next to that of a child
+ * which only opens the database. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+#include "database.h"
+
+#define BENCH_ENTRIES 5000
+
+#define SECRET "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"
+
+/* otp_info_s as it was */
+typedef struct legacy_info {
+  otp_type_e type;
+  char label[255];
+  char alias[255];
+  char secret[255];
+  int  counter;
+  int  id;
+} legacy_info_s;
+
+typedef double (*load_fn)(void);
+
+static char db_file[64];
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _legacy_row_cb(void *list, int count, char **data, char **columns) {
+  GList **head = list;
+  legacy_info_s *entry = malloc(sizeof(legacy_info_s));
+
+  memset(entry, 0, sizeof(legacy_info_s));
+  entry->type = atoi(data[0]);
+  strncpy(entry->label, data[1], 254);
+  entry->counter = atoi(data[2]);
+  strncpy(entry->secret, data[3], 254);
+  entry->id = atoi(data[4]);
+
+  *head = g_list_append(*head, entry);
+  return SQLITE_OK;
+}
+
+static sqlite3 *_legacy_open(void) {
+  sqlite3 *otp_db;
+
+  if (sqlite3_open_v2(db_file, &otp_db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) _exit(2);
+  return otp_db;
+}
+
+static double _legacy_open_only(void) {
+  sqlite3_close(_legacy_open());
+  return 0;
+}
+
+static double _legacy_load(void) {
+  const double start = _now();
+  sqlite3 *otp_db = _legacy_open();
+  GList *entries = NULL;
+
+  if (sqlite3_exec(otp_db, "SELECT TYPE, LABEL, COUNTER, SECRET, ID FROM entries ORDER BY ID DESC;",
+                   _legacy_row_cb, &entries, NULL) != SQLITE_OK) _exit(3);
+  sqlite3_close(otp_db);
+
+  /* The genlist items got copies, the list was freed */
+  legacy_info_s **items = malloc(BENCH_ENTRIES * sizeof(*items));
+  int count = 0;
+  for (GList *entry = entries; entry != NULL; entry = entry->next) {
+    items[count] = malloc(sizeof(legacy_info_s));
+    memcpy(items[count++], entry->data, sizeof(legacy_info_s));
+  }
+  g_list_free_full(entries, free);
+
+  if (count != BENCH_ENTRIES) _exit(4);
+  return _now() - start;
+}
+
+static double _open_only(void) {
+  if (db_init() != SQLITE_OK) _exit(2);
+  db_close();
+  return 0;
+}
+
+static double _load(void) {
+  const double start = _now();
+  otp_list_s list = { 0 };
+
+  if (db_init() != SQLITE_OK || db_select_all(&list) != SQLITE_OK) _exit(3);
+  if (list.count != BENCH_ENTRIES) _exit(4);
+
+  return _now() - start;
+}
+
+/* Runs load in a child, returns its time and sets its peak RSS in KiB */
+static double _run(load_fn load, long *rss) {
+  struct rusage usage;
+  double seconds = -1;
+  int fds[2], status;
+
+  if (pipe(fds) != 0) return -1;
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    seconds = load();
+    _exit(write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds));
+  }
+
+  close(fds[1]);
+  if (read(fds[0], &seconds, sizeof(seconds)) != sizeof(seconds)) seconds = -1;
+  close(fds[0]);
+
+  if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+  *rss = usage.ru_maxrss;
+
+  return seconds;
+}
+
+static int _report(const char *name, load_fn open_only, load_fn load) {
+  long base = 0, peak = 0;
+
+  const double opened = _run(open_only, &base);
+  const double seconds = _run(load, &peak);
+  if (opened < 0 || seconds < 0) return 1;
+
+  printf("%-8s %10.1f ms for %d entries %8ld KiB peak RSS %8ld KiB over open\n", name, seconds * 1e3,
+         BENCH_ENTRIES, peak, peak - base);
+  return 0;
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_bench_load_XXXXXX";
+  char path[sizeof(dir) + 1];
+  int failed = 0;
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  snprintf(db_file, sizeof(db_file), "%s/otp.db", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+
+  failed |= db_init();
+  failed |= db_begin();
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    otp_info_s entry = { .type = i & 1 ? HOTP : TOTP };
+    char label[64];
+
+    otp_set_label(&entry, label, snprintf(label, sizeof(label), "Issuer%d:user%d@example.com", i % 50, i));
+    otp_set_secret(&entry, SECRET);
+    failed |= db_insert(&entry);
+    otp_info_clear(&entry);
+  }
+  failed |= db_commit();
+  db_close();
+
+  failed |= _report("before", _legacy_open_only, _legacy_load);
+  failed |= _report("after", _open_only, _load);
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  if (failed) fprintf(stderr, "bench_load: a load failed\n");
+  return failed != 0;
+}
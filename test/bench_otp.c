@@ -0,0 +1,99 @@
+/* Code generation throughput of the OTP core, one entry at a time and in
+ * batches. Allocations are counted by wrapping malloc and friends. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "otp_core.h"
+
+#define BENCH_ENTRIES 64
+#define BENCH_ROUNDS  20000
+
+static long allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocs++;
+  return __real_realloc(ptr, size);
+}
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(const char *name, long ops, double seconds, long allocated) {
+  printf("%-14s %10.0f codes/sec %8.1f ns/op %6.3f allocs/op\n",
+         name, ops / seconds, seconds * 1e9 / ops, (double) allocated / ops);
+}
+
+static volatile int sink;
+
+int main(void) {
+  static const uint8_t key[] = "12345678901234567890123456789012";
+  otp_info_s entries[BENCH_ENTRIES];
+  otp_info_s *pointers[BENCH_ENTRIES];
+  uint64_t values[BENCH_ENTRIES];
+  int codes[BENCH_ENTRIES];
+
+  memset(entries, 0, sizeof(entries));
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    entries[i].algorithm = HASH_SHA1;
+    if (!otp_set_key(&entries[i], key, 20)) return 1;
+    pointers[i] = &entries[i];
+  }
+
+  for (hash_algo_e algo = HASH_SHA1; algo < HASH_ALGO_COUNT; algo++) {
+    static const char *names[HASH_ALGO_COUNT] = { "hotp sha1", "hotp sha256", "hotp sha512" };
+    otp_info_s *entry = &entries[0];
+
+    otp_set_algorithm(entry, algo);
+
+    const long before = allocs;
+    const double start = _now();
+    for (long i = 0; i < BENCH_ROUNDS * 4; i++) {
+      sink = otp_hotp_code(entry, i);
+    }
+    _report(names[algo], BENCH_ROUNDS * 4, _now() - start, allocs - before);
+  }
+  otp_set_algorithm(&entries[0], HASH_SHA1);
+
+  {
+    const long before = allocs;
+    const double start = _now();
+    for (long i = 0; i < BENCH_ROUNDS; i++) {
+      for (int j = 0; j < BENCH_ENTRIES; j++) values[j] = i + j;
+      otp_compute_codes(pointers, values, codes, BENCH_ENTRIES);
+      sink = codes[0];
+    }
+    _report("batch sha1", (long) BENCH_ROUNDS * BENCH_ENTRIES, _now() - start, allocs - before);
+  }
+
+  {
+    const long before = allocs;
+    const double start = _now();
+    for (long i = 0; i < BENCH_ROUNDS * 4; i++) {
+      int expires;
+      sink = otp_totp_code(&entries[i % BENCH_ENTRIES], 1111111109 + i * 30, 0, &expires);
+    }
+    _report("totp sha1", BENCH_ROUNDS * 4, _now() - start, allocs - before);
+  }
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) otp_info_clear(&entries[i]);
+  return 0;
+}
@@ -0,0 +1,70 @@
+/* Search over 10k labels: building the index, queries as they are typed
+ * and an entry renamed by the sync followed by the next query. */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "search_index.h"
+
+#define BENCH_LABELS  10000
+#define BENCH_QUERIES 2000
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _label(char *label, size_t size, int id, int rename) {
+  static const char *issuers[] = { "Example", "GitHub", "Google", "Bank", "Mail", "Work" };
+  return snprintf(label, size, "%s%d:user%d%s@example.com", issuers[id % 6], id % 97, id,
+                  rename ? "renamed" : "");
+}
+
+static search_index_s *_build(void) {
+  search_index_s *index = search_index_new();
+  char label[64];
+
+  for (int id = 1; id <= BENCH_LABELS; id++) {
+    search_index_add(index, id, label, _label(label, sizeof(label), id, 0));
+  }
+  return index;
+}
+
+int main(void) {
+  static const char *queries[] = { "g", "gi", "github", "github user12", "example com", "nothing" };
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(int));
+  char label[64];
+
+  double start = _now();
+  search_index_s *index = _build();
+  /* The first query sorts the words */
+  search_index_query(index, "g", ids);
+  printf("%-20s %10.1f ms for %d labels\n", "build", (_now() - start) * 1e3, BENCH_LABELS);
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    start = _now();
+    for (int i = 0; i < BENCH_QUERIES; i++) {
+      search_index_query(index, queries[q], ids);
+    }
+    printf("%-20s %10.1f us/query %6u found\n", queries[q], (_now() - start) * 1e6 / BENCH_QUERIES, ids->len);
+  }
+
+  start = _now();
+  for (int i = 0; i < BENCH_QUERIES; i++) {
+    const int id = 1 + i * 7 % BENCH_LABELS;
+    search_index_update(index, id, label, _label(label, sizeof(label), id, i & 1));
+    search_index_query(index, "github", ids);
+  }
+  printf("%-20s %10.1f us/update\n", "rename and query", (_now() - start) * 1e6 / BENCH_QUERIES);
+
+  start = _now();
+  for (int id = 1; id <= BENCH_QUERIES; id++) {
+    search_index_remove(index, id);
+  }
+  printf("%-20s %10.1f us/remove\n", "remove", (_now() - start) * 1e6 / BENCH_QUERIES);
+
+  search_index_free(index);
+  g_array_free(ids, TRUE);
+  return 0;
+}
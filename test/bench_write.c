@@ -0,0 +1,105 @@
+/* Write latency on a local file with the rollback journal and
+ * synchronous=FULL, the SQLite defaults the database used to run with,
+ * against WAL with synchronous=NORMAL as db_init() configures it. Both
+ * sides keep their connection and prepared statements, so only the
+ * journal differs. A HOTP renew used to increment the counter after the
+ * code was shown, it now reserves the counter in a transaction synced
+ * with FULL before it is. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "database.h"
+
+#define BENCH_ENTRIES 100
+#define BENCH_OPS     1000
+
+#define SECRET "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"
+
+static double _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(const char *name, double before, double after) {
+  printf("%-16s %10.1f us/write rollback %8.1f us/write wal %6.1fx\n", name, before * 1e6 / BENCH_OPS,
+         after * 1e6 / BENCH_OPS, before / after);
+}
+
+static int _step(sqlite3_stmt *stmt) {
+  const int ret = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  return ret == SQLITE_DONE ? SQLITE_OK : ret;
+}
+
+int main(void) {
+  char dir[] = "otp_bench_write_XXXXXX";
+  char path[sizeof(dir) + 16];
+  otp_info_s entry = { .type = HOTP };
+  sqlite3_stmt *insert, *inc;
+  sqlite3 *rollback;
+  int counter, failed = 0;
+
+  /* In the working directory, /tmp may not sync to a disk */
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+  snprintf(path, sizeof(path), "%s/rollback.db", dir);
+
+  failed |= sqlite3_open(path, &rollback);
+  failed |= sqlite3_exec(rollback, "CREATE TABLE entries (TYPE INTEGER NOT NULL, LABEL TEXT NOT NULL, \
+                                    COUNTER INTEGER NOT NULL, SECRET TEXT NOT NULL, ID INTEGER PRIMARY KEY);",
+                         NULL, NULL, NULL);
+  failed |= sqlite3_prepare_v2(rollback, "INSERT INTO entries VALUES(?, ?, 0, ?, NULL);", -1, &insert, NULL);
+  failed |= sqlite3_prepare_v2(rollback, "UPDATE entries SET COUNTER = COUNTER + 1 WHERE ID=?;", -1, &inc, NULL);
+  sqlite3_bind_int(insert, 1, HOTP);
+  sqlite3_bind_text(insert, 2, "Bench:rollback", -1, SQLITE_STATIC);
+  sqlite3_bind_text(insert, 3, SECRET, -1, SQLITE_STATIC);
+
+  failed |= db_init();
+  otp_set_label(&entry, "Bench:wal", 9);
+  otp_set_secret(&entry, SECRET);
+
+  for (int i = 0; i < BENCH_ENTRIES; i++) {
+    failed |= _step(insert);
+    failed |= db_insert(&entry);
+  }
+
+  double start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= _step(insert);
+  double before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= db_insert(&entry);
+  _report("insert", before, _now() - start);
+
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    sqlite3_bind_int(inc, 1, 1 + i % BENCH_ENTRIES);
+    failed |= _step(inc);
+  }
+  before = _now() - start;
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= db_inc_counter(1 + i % BENCH_ENTRIES);
+  _report("inc counter", before, _now() - start);
+
+  /* The increment after the code was shown against the reservation */
+  start = _now();
+  for (int i = 0; i < BENCH_OPS; i++) failed |= db_reserve_counter(1 + i % BENCH_ENTRIES, &counter);
+  _report("renew", before, _now() - start);
+
+  sqlite3_finalize(insert);
+  sqlite3_finalize(inc);
+  sqlite3_close(rollback);
+  otp_info_clear(&entry);
+  db_close();
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  if (failed) fprintf(stderr, "bench_write: a write failed\n");
+  return failed != 0;
+}
@@ -0,0 +1,176 @@
+/* Fuzz target of the entry parser. Each input is parsed at once, in two
+ * chunks split at a position taken from the input and, if short, a byte at
+ * a time. Every way has to give the same entries and accepted entries have
+ * to be usable.
+ *
+ * Built with -DFUZZ_LIBFUZZER (make fuzz CC=clang) this is a libFuzzer
+ * target. Otherwise main() mutates a few seed messages with a fixed seed,
+ * which is what make check runs. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "entry_parser.h"
+#include "test.h"
+
+#define FUZZ_ITERATIONS 100000
+#define FUZZ_MAX_INPUT  4096
+/* Inputs up to this size are also fed a byte at a time */
+#define FUZZ_BYTEWISE   512
+
+/* What was seen of the entries of an input */
+typedef struct outcome {
+  int      entries;
+  int      accepted;
+  uint64_t hash;
+} outcome_s;
+
+static uint64_t _hash(uint64_t hash, const void *data, size_t length) {
+  const uint8_t *bytes = data;
+
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+static void _entry_cb(void *data, otp_info_s *entry, const char *error) {
+  outcome_s *out = data;
+  const int fields[] = { entry->type, entry->algorithm, entry->counter, entry->digits, entry->period };
+
+  out->entries++;
+  out->hash = _hash(out->hash, &error, sizeof(error));
+  out->hash = _hash(out->hash, fields, sizeof(fields));
+  out->hash = _hash(out->hash, otp_label(entry), otp_label_len(entry));
+  if (entry->key != NULL) out->hash = _hash(out->hash, entry->key->bytes, entry->key->len);
+
+  if (error != NULL) return;
+
+  out->accepted++;
+  CHECK(otp_label_len(entry) > 0 && entry->key != NULL && entry->key->len > 0);
+  CHECK(entry->digits == 0 || (entry->digits >= OTP_MIN_DIGITS && entry->digits <= OTP_MAX_DIGITS));
+  CHECK(entry->algorithm >= 0 && entry->algorithm < HASH_ALGO_COUNT);
+  /* A code can be computed from whatever was accepted */
+  const int code = otp_hotp_code(entry, 0);
+  CHECK(code >= 0);
+}
+
+static entry_parser_status_e _run(const uint8_t *data, size_t size, size_t split, outcome_s *out) {
+  entry_parser_s parser;
+  entry_parser_status_e status = ENTRY_PARSER_IDLE;
+
+  memset(out, 0, sizeof(*out));
+  entry_parser_init(&parser, _entry_cb, out);
+
+  for (size_t offset = 0; offset < size; offset += split) {
+    const size_t chunk = size - offset < split ? size - offset : split;
+    const entry_parser_status_e next = entry_parser_feed(&parser, (const char *) data + offset, chunk);
+
+    /* Once failed it stays failed */
+    CHECK(status != ENTRY_PARSER_ERROR || next == ENTRY_PARSER_ERROR);
+    status = next;
+  }
+  entry_parser_reset(&parser);
+
+  return status;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  outcome_s whole, split;
+
+  const entry_parser_status_e status = _run(data, size, size ? size : 1, &whole);
+
+  if (size > 1) {
+    CHECK_INT(_run(data, size, 1 + data[0] % (size - 1), &split), status);
+    CHECK_INT(split.entries, whole.entries);
+    CHECK(split.hash == whole.hash);
+  }
+  if (size <= FUZZ_BYTEWISE) {
+    CHECK_INT(_run(data, size, 1, &split), status);
+    CHECK(split.hash == whole.hash);
+  }
+
+#ifdef FUZZ_LIBFUZZER
+  if (test_failures) abort();
+#endif
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static const char *seeds[] = {
+  "{\"type\":\"HOTP\",\"label\":\"Example:alice\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"counter\":5}",
+  "[{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"algorithm\":\"SHA512\",\"digits\":8,\"period\":60},"
+  "{\"label\":\"b\\u00e9\\ud83d\\ude00\",\"secret\":\"gezdgnbvgy3tqojq\",\"counter\":\"7\",\"x\":[{\"y\":null}]}]",
+  "{\"label\":\"c\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"counter\":1.5e1,\"flag\":true}\n{\"label\":\"d\"}\n",
+};
+
+/* Pieces spliced into the seeds */
+static const char *tokens[] = {
+  "{", "}", "[", "]", ",", ":", "\"", "\\", "\\u", "\\ud83d", "e", ".", "-", "0", "9", "true", "null",
+  "\"label\"", "\"secret\"", "\"counter\"", "\"digits\"", "\"period\"", "\"algorithm\"", "\"type\"",
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t _rand(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* Applies a few random edits to input */
+static size_t _mutate(uint8_t *input, size_t size) {
+  for (int edits = 1 + _rand() % 4; edits > 0; edits--) {
+    const size_t at = size ? _rand() % size : 0;
+
+    switch (_rand() % 5) {
+    case 0:
+      if (size) input[at] = _rand();
+      break;
+    case 1:
+      if (size) input[at] ^= 1 << (_rand() % 8);
+      break;
+    case 2: {
+      const size_t length = size ? _rand() % (size - at) : 0;
+      memmove(input + at, input + at + length, size - at - length);
+      size -= length;
+      break;
+    }
+    case 3: {
+      const char *token = tokens[_rand() % (sizeof(tokens) / sizeof(tokens[0]))];
+      const size_t length = strlen(token);
+      if (size + length > FUZZ_MAX_INPUT) break;
+      memmove(input + at + length, input + at, size - at);
+      memcpy(input + at, token, length);
+      size += length;
+      break;
+    }
+    case 4: {
+      /* Repeats a piece of the input */
+      const size_t length = size ? _rand() % (size - at) : 0;
+      if (size + length > FUZZ_MAX_INPUT) break;
+      memmove(input + at + length, input + at, size - at);
+      size += length;
+      break;
+    }
+    }
+  }
+
+  return size;
+}
+
+int main(void) {
+  static uint8_t input[FUZZ_MAX_INPUT];
+
+  for (int i = 0; i < FUZZ_ITERATIONS && !test_failures; i++) {
+    const char *seed = seeds[_rand() % (sizeof(seeds) / sizeof(seeds[0]))];
+    size_t size = strlen(seed);
+
+    memcpy(input, seed, size);
+    size = _mutate(input, size);
+    LLVMFuzzerTestOneInput(input, size);
+  }
+
+  return test_result("fuzz_entry_parser");
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef __OTP_TEST_ECORE_H__
+#define __OTP_TEST_ECORE_H__
+
+/* Host stand-in for the Ecore fd handlers and calls into the main loop.
+ * The test using them provides ecore_main_fd_handler_add() and
+ * ecore_main_fd_handler_del(), or ecore_main_loop_thread_safe_call_async(),
+ * and runs its own loop. */
+
+typedef unsigned char Eina_Bool;
+
+#define EINA_FALSE ((Eina_Bool) 0)
+#define EINA_TRUE  ((Eina_Bool) 1)
+
+#define ECORE_CALLBACK_CANCEL EINA_FALSE
+#define ECORE_CALLBACK_RENEW  EINA_TRUE
+
+typedef struct _Ecore_Fd_Handler Ecore_Fd_Handler;
+
+typedef enum {
+  ECORE_FD_READ  = 1,
+  ECORE_FD_WRITE = 2,
+  ECORE_FD_ERROR = 4
+} Ecore_Fd_Handler_Flags;
+
+typedef Eina_Bool (*Ecore_Fd_Cb)(void *data, Ecore_Fd_Handler *fd_handler);
+
+Ecore_Fd_Handler *ecore_main_fd_handler_add(int fd, Ecore_Fd_Handler_Flags flags, Ecore_Fd_Cb func,
+                                            const void *data, Ecore_Fd_Cb buf_func, const void *buf_data);
+void *ecore_main_fd_handler_del(Ecore_Fd_Handler *fd_handler);
+
+typedef void (*Ecore_Cb)(void *data);
+
+void ecore_main_loop_thread_safe_call_async(Ecore_Cb callback, void *data);
+
+#endif /* __OTP_TEST_ECORE_H__ */
@@ -0,0 +1,16 @@
+#ifndef __OTP_TEST_ELEMENTARY_H__
+#define __OTP_TEST_ELEMENTARY_H__
+
+/* Host stand-in for the EFL types the app headers refer to. The UI isn't
+ * built on the host, so they are only declared. */
+
+#include <Ecore.h>
+
+typedef struct _Evas_Object Evas_Object;
+typedef struct _Ecore_Timer Ecore_Timer;
+typedef struct _Ecore_Idler Ecore_Idler;
+typedef struct _Ecore_Animator Ecore_Animator;
+typedef struct _Elm_Object_Item Elm_Object_Item;
+typedef struct _Elm_Genlist_Item_Class Elm_Genlist_Item_Class;
+
+#endif /* __OTP_TEST_ELEMENTARY_H__ */
@@ -0,0 +1,15 @@
+#ifndef __OTP_TEST_APP_COMMON_H__
+#define __OTP_TEST_APP_COMMON_H__
+
+/* Host stand-in for the app paths, the data directory is taken from
+ * OTP_DATA_PATH and has to end with a slash */
+
+#include <stdlib.h>
+#include <string.h>
+
+static inline char *app_get_data_path(void) {
+  const char *path = getenv("OTP_DATA_PATH");
+  return strdup(path ? path : "./");
+}
+
+#endif /* __OTP_TEST_APP_COMMON_H__ */
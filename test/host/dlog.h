@@ -0,0 +1,27 @@
+#ifndef __OTP_TEST_DLOG_H__
+#define __OTP_TEST_DLOG_H__
+
+/* Host stand-in for the Tizen log, warnings and errors go to stderr */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+typedef enum {
+  DLOG_UNKNOWN, DLOG_DEFAULT, DLOG_VERBOSE, DLOG_DEBUG, DLOG_INFO, DLOG_WARN, DLOG_ERROR, DLOG_FATAL, DLOG_SILENT
+} log_priority;
+
+static inline int dlog_print(log_priority prio, const char *tag, const char *fmt, ...) {
+  va_list args;
+
+  if (prio < DLOG_WARN) return 0;
+
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+
+  return 0;
+}
+
+#endif /* __OTP_TEST_DLOG_H__ */
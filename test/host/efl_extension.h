@@ -0,0 +1,8 @@
+#ifndef __OTP_TEST_EFL_EXTENSION_H__
+#define __OTP_TEST_EFL_EXTENSION_H__
+
+/* Host stand-in for the EFL extension types the app headers refer to */
+
+typedef struct _Eext_Circle_Surface Eext_Circle_Surface;
+
+#endif /* __OTP_TEST_EFL_EXTENSION_H__ */
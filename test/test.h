@@ -0,0 +1,35 @@
+#ifndef __OTP_TEST_H__
+#define __OTP_TEST_H__
+
+/* Checks of the host tests. A failed check is reported and the test goes
+ * on, main() returns test_result(). */
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_INT(actual, expected) do { \
+    const long long _a = (actual), _e = (expected); \
+    if (_a != _e) { \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+      test_failures++; \
+    } \
+  } while (0)
+
+static inline int test_result(const char *name) {
+  if (test_failures) {
+    fprintf(stderr, "%s: %d failed\n", name, test_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif /* __OTP_TEST_H__ */
@@ -0,0 +1,121 @@
+/* Crash injection for HOTP counters: a child process reserves counters and
+ * reports each one as shown, and is killed at random points, in the middle
+ * of transactions included. No counter shown may come back after a restart
+ * and the stored counter never goes backwards. */
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "database.h"
+#include "test.h"
+
+#define CRASHES 40
+
+static int _entry_id(void) {
+  otp_list_s list = { 0 };
+  int id = -1;
+
+  if (db_select_all(&list) == SQLITE_OK && list.count == 1) id = list.entries[0].id;
+  otp_list_clear(&list);
+
+  return id;
+}
+
+static int _stored_counter(int id) {
+  otp_list_s list = { 0 };
+  int counter = -1;
+
+  if (db_init() == SQLITE_OK && db_select_id(&list, id) == SQLITE_OK && list.count == 1) {
+    counter = list.entries[0].counter;
+  }
+  otp_list_clear(&list);
+  db_close();
+
+  return counter;
+}
+
+/* Reserves counters until killed, writing each one once it is reserved */
+static void _child(int id, int fd) {
+  int counter;
+
+  if (db_init() != SQLITE_OK) _exit(2);
+
+  for (;;) {
+    if (db_reserve_counter(id, &counter) != SQLITE_OK) _exit(3);
+    if (write(fd, &counter, sizeof(counter)) != sizeof(counter)) _exit(4);
+  }
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_counter_XXXXXX";
+  char path[sizeof(dir) + 1];
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+  srand(time(NULL));
+
+  otp_info_s entry = { .type = HOTP, .counter = 0 };
+  CHECK(otp_set_label(&entry, "Crash:test", 10));
+  CHECK(otp_set_secret(&entry, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"));
+  CHECK_INT(db_init(), SQLITE_OK);
+  CHECK_INT(db_insert(&entry), SQLITE_OK);
+  const int id = _entry_id();
+  CHECK(id > 0);
+  db_close();
+  otp_info_clear(&entry);
+
+  int stored = 0, shown = -1, total = 0;
+
+  for (int crash = 0; crash < CRASHES; crash++) {
+    int fds[2];
+    if (pipe(fds) != 0) return 1;
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      _child(id, fds[1]);
+    }
+    close(fds[1]);
+
+    /* Let it get some counters out, then kill it wherever it is */
+    const int wanted = 1 + rand() % 20;
+    int counter, count = 0;
+    while (count < wanted && read(fds[0], &counter, sizeof(counter)) == sizeof(counter)) {
+      /* Counters shown are increasing across restarts */
+      CHECK(counter > shown);
+      shown = counter;
+      count++;
+    }
+    usleep(rand() % 2000);
+    kill(pid, SIGKILL);
+
+    /* Counters written before the kill were shown as well */
+    while (read(fds[0], &counter, sizeof(counter)) == sizeof(counter)) {
+      CHECK(counter > shown);
+      shown = counter;
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+    const int now = _stored_counter(id);
+    CHECK(now >= stored);
+    CHECK(now > shown);
+    stored = now;
+    total += count;
+  }
+
+  CHECK(total >= CRASHES);
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  return test_result("test_counter");
+}
@@ -0,0 +1,266 @@
+/* Entry messages of the companion app through the incremental parser, fed
+ * whole and split at every position */
+
+#include <string.h>
+#include "entry_parser.h"
+#include "test.h"
+
+#define MAX_RESULTS 16
+
+typedef struct result {
+  const char *error;
+  char       label[OTP_LABEL_MAX_LEN + 1];
+  char       secret[OTP_SECRET_MAX_LEN + 1];
+  int        type;
+  int        algorithm;
+  int        counter;
+  int        digits;
+  int        period;
+} result_s;
+
+typedef struct results {
+  result_s items[MAX_RESULTS];
+  int      count;
+} results_s;
+
+static void _result_cb(void *data, otp_info_s *entry, const char *error) {
+  results_s *results = data;
+
+  CHECK(results->count < MAX_RESULTS);
+  if (results->count >= MAX_RESULTS) return;
+
+  result_s *r = &results->items[results->count++];
+  memset(r, 0, sizeof(*r));
+  r->error = error;
+  r->type = entry->type;
+  r->algorithm = entry->algorithm;
+  r->counter = entry->counter;
+  r->digits = entry->digits;
+  r->period = entry->period;
+  memcpy(r->label, otp_label(entry), otp_label_len(entry));
+  if (entry->key != NULL) otp_get_secret(entry, r->secret, sizeof(r->secret));
+}
+
+/* Feeds message in chunks of chunk bytes, all at once if chunk is 0 */
+static entry_parser_status_e _parse(results_s *results, const char *message, size_t chunk) {
+  entry_parser_s parser;
+  entry_parser_status_e status = ENTRY_PARSER_IDLE;
+  const size_t length = strlen(message);
+
+  memset(results, 0, sizeof(*results));
+  entry_parser_init(&parser, _result_cb, results);
+
+  if (chunk == 0) chunk = length;
+  for (size_t offset = 0; offset < length; offset += chunk) {
+    status = entry_parser_feed(&parser, message + offset, length - offset < chunk ? length - offset : chunk);
+  }
+  entry_parser_reset(&parser);
+
+  return status;
+}
+
+/* Parses a message with a single entry whose counter is value, returns
+ * the error of the entry */
+static const char *_parse_counter(const char *value, int *counter) {
+  char message[128];
+  results_s results;
+
+  snprintf(message, sizeof(message), "{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"counter\":%s}", value);
+  CHECK_INT(_parse(&results, message, 0), ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 1);
+  *counter = results.items[0].counter;
+
+  return results.items[0].error;
+}
+
+static void test_single(void) {
+  results_s results;
+
+  CHECK_INT(_parse(&results, "{\"type\":\"HOTP\",\"label\":\"Example:alice\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"counter\":5}", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 1);
+
+  const result_s *r = &results.items[0];
+  CHECK(r->error == NULL);
+  CHECK_INT(r->type, HOTP);
+  CHECK_INT(r->counter, 5);
+  CHECK(strcmp(r->label, "Example:alice") == 0);
+  CHECK(strncmp(r->secret, "GEZDGNBVGY3TQOJQ", 16) == 0);
+}
+
+static void test_fields(void) {
+  results_s results;
+
+  CHECK_INT(_parse(&results, " { \"label\" : \"b\" , \"algorithm\":\"SHA256\", \"digits\":8, \"period\":60,"
+                             " \"extra\":{\"a\":[1,2,{\"b\":\"}]\\\"\"}]}, \"flag\":true, \"none\":null, \"f\":-1.5e3,"
+                             " \"secret\":\"GEZDGNBVGY3TQOJQ\" } ", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 1);
+
+  const result_s *r = &results.items[0];
+  CHECK(r->error == NULL);
+  CHECK_INT(r->type, TOTP);
+  CHECK_INT(r->algorithm, HASH_SHA256);
+  CHECK_INT(r->digits, 8);
+  CHECK_INT(r->period, 60);
+}
+
+static void test_bulk(void) {
+  results_s results;
+
+  CHECK_INT(_parse(&results, "[{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\"},"
+                             " {\"label\":\"b\"},"
+                             " {\"label\":\"c\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"digits\":5}]", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 3);
+  CHECK(results.items[0].error == NULL);
+  CHECK(results.items[1].error != NULL && strcmp(results.items[1].error, "missing label or secret") == 0);
+  CHECK(results.items[2].error != NULL && strcmp(results.items[2].error, "unsupported number of digits") == 0);
+
+  /* One object per line */
+  CHECK_INT(_parse(&results, "{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\"}\n"
+                             "{\"label\":\"b\",\"secret\":\"GEZDGNBVGY3TQOJQ\"}\n", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 2);
+  CHECK(strcmp(results.items[1].label, "b") == 0);
+
+  CHECK_INT(_parse(&results, "[]", 0), ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 0);
+  CHECK_INT(_parse(&results, "[{\"label\":\"a\"", 0), ENTRY_PARSER_MORE);
+  CHECK_INT(results.count, 0);
+}
+
+static void test_numbers(void) {
+  static const struct {
+    const char *value;
+    int        counter;
+  } valid[] = {
+    { "5", 5 }, { "\"5\"", 5 }, { "5.0", 5 }, { "\"5.00\"", 5 }, { "2.5e1", 25 }, { "1E2", 100 },
+    { "1200e-2", 12 }, { "0.0", 0 }, { "-0", 0 }, { "0e5", 0 }, { "2147483647", 2147483647 },
+    { "-2147483648", -2147483647 - 1 }, { "21474836.47e2", 2147483647 }, { "7.000000000000000000000", 7 },
+  };
+  static const char *invalid[] = {
+    "5.5", "1e-1", "2147483648", "1e10", "\"abc\"", "\"\"", "1.", "1e", "-", "\"5 \"",
+    "99999999999999999999", "1e99999",
+  };
+  int counter;
+
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+    const char *error = _parse_counter(valid[i].value, &counter);
+    CHECK(error == NULL);
+    CHECK_INT(counter, valid[i].counter);
+  }
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    const char *error = _parse_counter(invalid[i], &counter);
+    CHECK(error != NULL && strcmp(error, "wrong json object") == 0);
+  }
+
+  results_s results;
+  CHECK_INT(_parse(&results, "{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"digits\":\"8\",\"period\":30.0}", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error == NULL);
+  CHECK_INT(results.items[0].digits, 8);
+  CHECK_INT(results.items[0].period, 30);
+
+  CHECK_INT(_parse(&results, "{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"period\":0}", 0), ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error != NULL && strcmp(results.items[0].error, "wrong period") == 0);
+}
+
+static void test_strings(void) {
+  results_s results;
+
+  CHECK_INT(_parse(&results, "{\"label\":\"Caf\\u00e9:\\\"x\\\"\\/\\ud83d\\ude00\\ud800!\",\"secret\":\"GEZDGNBVGY3TQOJQ\"}", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 1);
+  CHECK(strcmp(results.items[0].label, "Caf\xc3\xa9:\"x\"/\xf0\x9f\x98\x80\xef\xbf\xbd!") == 0);
+
+  /* Keys are matched whole, also when escaped */
+  CHECK_INT(_parse(&results, "{\"labels\":\"x\",\"\\u006cabel\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\"}", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error == NULL);
+  CHECK(strcmp(results.items[0].label, "a") == 0);
+}
+
+static void test_errors(void) {
+  results_s results;
+  char secret[OTP_SECRET_MAX_LEN + 64];
+
+  CHECK_INT(_parse(&results, "{\"label\":\"a\",\"secret\":\"not base32!\"}", 0), ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error != NULL && strcmp(results.items[0].error, "invalid secret") == 0);
+
+  CHECK_INT(_parse(&results, "{\"label\":1,\"secret\":\"GEZDGNBVGY3TQOJQ\"}", 0), ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error != NULL && strcmp(results.items[0].error, "wrong json object") == 0);
+
+  CHECK_INT(_parse(&results, "{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"algorithm\":\"MD5\"}", 0),
+            ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error != NULL && strcmp(results.items[0].error, "unsupported algorithm") == 0);
+
+  /* Secrets which don't fit the buffer are rejected, not truncated */
+  memset(secret, 'A', sizeof(secret));
+  memcpy(secret, "{\"label\":\"a\",\"secret\":\"", 23);
+  strcpy(secret + sizeof(secret) - 3, "\"}");
+  CHECK_INT(_parse(&results, secret, 0), ENTRY_PARSER_IDLE);
+  CHECK(results.items[0].error != NULL && strcmp(results.items[0].error, "invalid secret") == 0);
+
+  /* A syntax error ends the message, the broken entry is reported */
+  CHECK_INT(_parse(&results, "[{\"label\":\"a\",\"secret\":\"GEZDGNBVGY3TQOJQ\"},{\"label\" \"b\"}", 0),
+            ENTRY_PARSER_ERROR);
+  CHECK_INT(results.count, 2);
+  CHECK(results.items[0].error == NULL);
+  CHECK(results.items[1].error != NULL && strcmp(results.items[1].error, "wrong json") == 0);
+
+  CHECK_INT(_parse(&results, "{\"label\":tru}", 0), ENTRY_PARSER_ERROR);
+  CHECK_INT(_parse(&results, "\"label\"", 0), ENTRY_PARSER_ERROR);
+  CHECK_INT(_parse(&results, "{\"label\":\"a\x01\"}", 0), ENTRY_PARSER_ERROR);
+  CHECK_INT(_parse(&results, "{\"label\":\"\\x\"}", 0), ENTRY_PARSER_ERROR);
+  CHECK_INT(results.count, 1);
+
+  /* Nothing is parsed after an error until the parser is reset */
+  entry_parser_s parser;
+  entry_parser_init(&parser, _result_cb, &results);
+  memset(&results, 0, sizeof(results));
+  CHECK_INT(entry_parser_feed(&parser, "x", 1), ENTRY_PARSER_ERROR);
+  CHECK_INT(entry_parser_feed(&parser, "{}", 2), ENTRY_PARSER_ERROR);
+  entry_parser_reset(&parser);
+  CHECK_INT(entry_parser_feed(&parser, "{}", 2), ENTRY_PARSER_IDLE);
+  CHECK_INT(results.count, 1);
+}
+
+/* Every split of a message gives the same entries */
+static void test_chunks(void) {
+  static const char *message =
+    "[{\"type\":\"HOTP\",\"label\":\"Issuer:\\u00e9\\ud83d\\ude00\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"counter\":1.2e1,"
+    "\"extra\":[{\"a\":\"]}\"}],\"digits\":\"7\"},{\"label\":\"x\",\"secret\":\"GEZDGNBVGY3TQOJQ\",\"flag\":false},"
+    "{\"label\":\"y\"}]";
+  results_s whole, split;
+
+  CHECK_INT(_parse(&whole, message, 0), ENTRY_PARSER_IDLE);
+  CHECK_INT(whole.count, 3);
+  CHECK_INT(whole.items[0].counter, 12);
+  CHECK_INT(whole.items[0].digits, 7);
+
+  for (size_t chunk = 1; chunk < strlen(message); chunk++) {
+    CHECK_INT(_parse(&split, message, chunk), ENTRY_PARSER_IDLE);
+    CHECK_INT(split.count, whole.count);
+    for (int i = 0; i < whole.count && i < split.count; i++) {
+      const result_s *a = &whole.items[i], *b = &split.items[i];
+      CHECK(a->error == b->error);
+      CHECK(strcmp(a->label, b->label) == 0);
+      CHECK(strcmp(a->secret, b->secret) == 0);
+      CHECK_INT(b->counter, a->counter);
+      CHECK_INT(b->digits, a->digits);
+    }
+  }
+}
+
+int main(void) {
+  test_single();
+  test_fields();
+  test_bulk();
+  test_numbers();
+  test_strings();
+  test_errors();
+  test_chunks();
+
+  return test_result("test_entry_parser");
+}
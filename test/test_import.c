@@ -0,0 +1,269 @@
+/* Messages from the companion app through add_entries(), stored by the db
+ * worker in a database in a temporary directory. The calls the worker
+ * posts to the main loop are run by a stand-in loop. Covers the summary
+ * of a bulk import with rejected entries, the echo of a single entry, the
+ * ack of a binary frame, a database locked by another connection which
+ * stores nothing and reports every entry as a database error, a
+ * transaction rolled back by its last entry and a frame failing its CRC. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <Ecore.h>
+#include "database.h"
+#include "db_worker.h"
+#include "import.h"
+#include "wire.h"
+#include "test.h"
+
+#define SECRET "GEZDGNBVGY3TQOJQ"
+
+typedef struct main_call {
+  Ecore_Cb func;
+  void     *data;
+} main_call_s;
+
+/* What the owner of the transport got back */
+typedef struct replies {
+  int     count;
+  gchar   *reply;
+  gsize   reply_length;
+  guint   changed;
+} replies_s;
+
+static GAsyncQueue *main_calls;
+static replies_s replies;
+static char db_path[64];
+
+void ecore_main_loop_thread_safe_call_async(Ecore_Cb callback, void *data) {
+  main_call_s *call = g_new(main_call_s, 1);
+
+  call->func = callback;
+  call->data = data;
+  g_async_queue_push(main_calls, call);
+}
+
+/* Runs the calls posted to the main loop until *counter reaches target,
+ * fails after a second idle */
+static void _run_until(const int *counter, int target) {
+  while (*counter < target) {
+    main_call_s *call = g_async_queue_timeout_pop(main_calls, G_USEC_PER_SEC);
+
+    if (call == NULL) {
+      CHECK_INT(*counter, target);
+      return;
+    }
+    call->func(call->data);
+    g_free(call);
+  }
+}
+
+static void _init_done(void *data, int ret) {
+  CHECK_INT(ret, SQLITE_OK);
+  (*(int *) data)++;
+}
+
+static void _replied(void *data, const gchar *reply, gsize reply_length, const GArray *changed) {
+  replies_s *r = data;
+
+  /* Acks are binary, JSON replies are compared as strings */
+  g_free(r->reply);
+  r->reply = NULL;
+  if (reply != NULL) {
+    r->reply = g_malloc(reply_length + 1);
+    memcpy(r->reply, reply, reply_length);
+    r->reply[reply_length] = '\0';
+  }
+  r->reply_length = reply_length;
+  r->changed = changed ? changed->len : 0;
+  r->count++;
+}
+
+/* Feeds a message in chunks of chunk bytes and waits for its reply */
+static void _import(const char *message, size_t length, size_t chunk) {
+  const int count = replies.count;
+
+  for (size_t offset = 0; offset < length; offset += chunk) {
+    const size_t size = length - offset < chunk ? length - offset : chunk;
+    CHECK_INT(add_entries(message + offset, size, _replied, &replies), offset + size == length);
+  }
+  _run_until(&replies.count, count + 1);
+}
+
+static int _stored(void) {
+  otp_list_s list = { 0 };
+
+  CHECK_INT(db_select_all(&list), SQLITE_OK);
+  const int count = list.count;
+  otp_list_clear(&list);
+
+  return count;
+}
+
+static uint32_t _get32(const gchar *p) {
+  const uint8_t *b = (const uint8_t *) p;
+  return (uint32_t) b[0] << 24 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 8 | b[3];
+}
+
+/* Entries frame of count entries, labels are prefix and their number */
+static size_t _frame(uint8_t *frame, size_t size, const char *prefix, int count) {
+  size_t length = 0;
+
+  for (int i = 0; i < count; i++) {
+    otp_info_s entry = { .type = TOTP };
+    char label[32];
+
+    otp_set_label(&entry, label, snprintf(label, sizeof(label), "%s:%d", prefix, i));
+    otp_set_secret(&entry, SECRET);
+    length += wire_encode_entry(frame + WIRE_HEADER_SIZE + length, size - WIRE_HEADER_SIZE - length, &entry);
+    otp_info_clear(&entry);
+  }
+  wire_seal(frame, WIRE_ENTRIES, 7, length);
+
+  return WIRE_HEADER_SIZE + length;
+}
+
+/* Checks an ack frame: records, stored records and every status */
+static void _check_ack(uint32_t count, uint32_t stored, wire_status_e status) {
+  CHECK_INT(replies.reply_length, WIRE_HEADER_SIZE + 8 + count);
+  if (replies.reply_length != WIRE_HEADER_SIZE + 8 + count) return;
+
+  const gchar *payload = replies.reply + WIRE_HEADER_SIZE;
+  CHECK_INT(replies.reply[3], WIRE_ACK);
+  CHECK_INT(_get32(payload), count);
+  CHECK_INT(_get32(payload + 4), stored);
+  for (uint32_t i = 0; i < count; i++) CHECK_INT(payload[8 + i], status);
+}
+
+static void test_bulk(void) {
+  static const char bulk[] =
+    "[{\"label\":\"Bulk:a\",\"secret\":\""SECRET"\"},"
+    " {\"label\":\"Bulk:b\"},"
+    " {\"type\":\"HOTP\",\"label\":\"Bulk:c\",\"secret\":\""SECRET"\",\"counter\":5}]";
+
+  _import(bulk, sizeof(bulk) - 1, 16);
+  CHECK(replies.reply != NULL &&
+        strcmp(replies.reply, "{\"results\":[\"ok\",\"missing label or secret\",\"ok\"],\"imported\":2,\"failed\":1}") == 0);
+  CHECK_INT(replies.changed, 2);
+  CHECK_INT(_stored(), 2);
+}
+
+static void test_single(void) {
+  static const char single[] = "{\"label\":\"Single:a\",\"secret\":\""SECRET"\"}";
+
+  /* The old format is acknowledged by echoing the entry */
+  _import(single, sizeof(single) - 1, 5);
+  CHECK_INT(replies.reply_length, sizeof(single) - 1);
+  CHECK(replies.reply != NULL && strcmp(replies.reply, single) == 0);
+  CHECK_INT(replies.changed, 1);
+  CHECK_INT(_stored(), 3);
+}
+
+static void test_binary(void) {
+  uint8_t frame[4096];
+  const size_t length = _frame(frame, sizeof(frame), "Binary", 4);
+
+  _import((const char *) frame, length, 64);
+  _check_ack(4, 4, WIRE_STATUS_OK);
+  CHECK_INT(replies.changed, 4);
+  CHECK_INT(_stored(), 7);
+}
+
+/* Another connection holds the write lock, no entry of the message is
+ * stored and each is reported, then the same message goes through */
+static void test_locked(void) {
+  static const char bulk[] =
+    "[{\"label\":\"Locked:a\",\"secret\":\""SECRET"\"},{\"label\":\"Locked:b\",\"secret\":\""SECRET"\"}]";
+  char path[sizeof(db_path) + 8];
+  uint8_t frame[4096];
+  sqlite3 *other;
+
+  snprintf(path, sizeof(path), "%sotp.db", db_path);
+  CHECK_INT(sqlite3_open(path, &other), SQLITE_OK);
+  CHECK_INT(sqlite3_exec(other, "BEGIN IMMEDIATE;", NULL, NULL, NULL), SQLITE_OK);
+
+  _import(bulk, sizeof(bulk) - 1, sizeof(bulk));
+  CHECK(replies.reply != NULL &&
+        strcmp(replies.reply, "{\"results\":[\"database error\",\"database error\"],\"imported\":0,\"failed\":2}") == 0);
+  CHECK_INT(replies.changed, 0);
+
+  const size_t length = _frame(frame, sizeof(frame), "Locked", 3);
+  _import((const char *) frame, length, length);
+  _check_ack(3, 0, WIRE_STATUS_DATABASE);
+
+  CHECK_INT(sqlite3_exec(other, "ROLLBACK;", NULL, NULL, NULL), SQLITE_OK);
+  sqlite3_close(other);
+  CHECK_INT(_stored(), 7);
+
+  _import(bulk, sizeof(bulk) - 1, sizeof(bulk));
+  CHECK(replies.reply != NULL && strstr(replies.reply, "\"imported\":2,\"failed\":0") != NULL);
+  CHECK_INT(_stored(), 9);
+}
+
+/* A trigger rolls the transaction back on the last entry, the commit fails
+ * and the entries written before it are undone */
+static void test_rollback(void) {
+  static const char bulk[] =
+    "[{\"label\":\"Rollback:a\",\"secret\":\""SECRET"\"},{\"label\":\"Rollback:b\",\"secret\":\""SECRET"\"},"
+    " {\"label\":\"Rollback:c\",\"secret\":\""SECRET"\"}]";
+  char path[sizeof(db_path) + 8];
+  sqlite3 *other;
+
+  snprintf(path, sizeof(path), "%sotp.db", db_path);
+  CHECK_INT(sqlite3_open(path, &other), SQLITE_OK);
+  CHECK_INT(sqlite3_exec(other, "CREATE TRIGGER fail BEFORE INSERT ON entries WHEN NEW.LABEL = 'Rollback:c' \
+                                 BEGIN SELECT RAISE(ROLLBACK, 'injected'); END;", NULL, NULL, NULL), SQLITE_OK);
+
+  _import(bulk, sizeof(bulk) - 1, sizeof(bulk));
+  CHECK(replies.reply != NULL &&
+        strcmp(replies.reply, "{\"results\":[\"database error\",\"database error\",\"database error\"],"
+                              "\"imported\":0,\"failed\":3}") == 0);
+  CHECK_INT(replies.changed, 0);
+  CHECK_INT(_stored(), 9);
+
+  CHECK_INT(sqlite3_exec(other, "DROP TRIGGER fail;", NULL, NULL, NULL), SQLITE_OK);
+  sqlite3_close(other);
+}
+
+/* Nothing of a frame failing its CRC is stored */
+static void test_corrupt(void) {
+  uint8_t frame[4096];
+  const size_t length = _frame(frame, sizeof(frame), "Corrupt", 2);
+
+  frame[length - 1] ^= 0x55;
+  _import((const char *) frame, length, 100);
+  _check_ack(2, 0, WIRE_STATUS_CORRUPT);
+  CHECK_INT(replies.changed, 0);
+  CHECK_INT(_stored(), 9);
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_import_XXXXXX";
+  int ready = 0;
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(db_path, sizeof(db_path), "%s/", dir);
+  setenv("OTP_DATA_PATH", db_path, 1);
+
+  main_calls = g_async_queue_new();
+  db_init_async(_init_done, &ready);
+  _run_until(&ready, 1);
+
+  test_bulk();
+  test_single();
+  test_binary();
+  test_locked();
+  test_rollback();
+  test_corrupt();
+
+  db_worker_stop();
+  db_close();
+  g_free(replies.reply);
+  g_async_queue_unref(main_calls);
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  return test_result("test_import");
+}
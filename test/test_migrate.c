@@ -0,0 +1,158 @@
+/* Migration of a database written by the first releases: over 10k rows in the
+ * unversioned table with the INTEGET column, ids with gaps. db_init() has
+ * to bring it to the current schema without losing or reordering rows. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "database.h"
+#include "test.h"
+
+#define FIXTURE_ROWS 12000
+/* Every DELETE_EVERY-th row and the DELETE_LAST newest ones were deleted */
+#define DELETE_EVERY 7
+#define DELETE_LAST  10
+
+static const char *legacy_schema =
+  "CREATE TABLE IF NOT EXISTS entries \
+   (TYPE    INTEGER NOT NULL, \
+    LABEL    TEXT    NOT NULL, \
+    COUNTER INTEGET NOT NULL, \
+    SECRET  TEXT    NOT NULL, \
+    ID      INTEGER PRIMARY KEY AUTOINCREMENT);";
+
+static int _kept(int id) {
+  return id % DELETE_EVERY != 0 && id <= FIXTURE_ROWS - DELETE_LAST;
+}
+
+/* Number of rows and highest id left in the fixture */
+static int _fixture_rows(int *last) {
+  int rows = 0;
+
+  for (int id = 1; id <= FIXTURE_ROWS; id++) {
+    if (_kept(id)) {
+      rows++;
+      *last = id;
+    }
+  }
+
+  return rows;
+}
+
+static void _make_fixture(const char *path) {
+  sqlite3 *db;
+  sqlite3_stmt *insert;
+  char label[64];
+
+  CHECK_INT(sqlite3_open(path, &db), SQLITE_OK);
+  CHECK_INT(sqlite3_exec(db, legacy_schema, NULL, NULL, NULL), SQLITE_OK);
+  CHECK_INT(sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL), SQLITE_OK);
+  CHECK_INT(sqlite3_prepare_v2(db, "INSERT INTO entries VALUES(?, ?, ?, ?, NULL);", -1, &insert, NULL), SQLITE_OK);
+
+  for (int i = 1; i <= FIXTURE_ROWS; i++) {
+    /* Half of the labels have an issuer */
+    const int len = i % 2 ? snprintf(label, sizeof(label), "Issuer%d:user%d", i % 50, i)
+                          : snprintf(label, sizeof(label), "user%d", i);
+    sqlite3_bind_int(insert, 1, i % 3 == 0 ? HOTP : TOTP);
+    sqlite3_bind_text(insert, 2, label, len, SQLITE_TRANSIENT);
+    sqlite3_bind_int(insert, 3, i);
+    sqlite3_bind_text(insert, 4, "GEZDGNBVGY3TQOJQ", -1, SQLITE_STATIC);
+    CHECK_INT(sqlite3_step(insert), SQLITE_DONE);
+    sqlite3_reset(insert);
+  }
+  sqlite3_finalize(insert);
+
+  char *sql = sqlite3_mprintf("DELETE FROM entries WHERE ID %% %d = 0 OR ID > %d; COMMIT;",
+                              DELETE_EVERY, FIXTURE_ROWS - DELETE_LAST);
+  CHECK_INT(sqlite3_exec(db, sql, NULL, NULL, NULL), SQLITE_OK);
+  sqlite3_free(sql);
+  sqlite3_close(db);
+}
+
+static int _get_int(sqlite3 *db, const char *sql) {
+  sqlite3_stmt *stmt;
+  int value = -1;
+
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) return -1;
+  if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return value;
+}
+
+static void _check_schema(const char *path, int rows) {
+  sqlite3 *db;
+
+  CHECK_INT(sqlite3_open(path, &db), SQLITE_OK);
+  CHECK_INT(_get_int(db, "PRAGMA user_version;"), 2);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM entries;"), rows);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM sqlite_master WHERE name='entries_new';"), 0);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM pragma_table_info('entries') WHERE name='COUNTER' AND type='INTEGER';"), 1);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM sqlite_master WHERE type='index' AND tbl_name='entries' \
+                          AND name IN ('entries_uid', 'entries_sort');"), 2);
+
+  /* Rows keep their content and order and get the new columns */
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM entries WHERE COUNTER <> ID OR SORT_ORDER <> ID \
+                          OR ALGORITHM <> 0 OR DIGITS <> 6 OR PERIOD <> 30 OR REV <> 0 OR DELETED <> 0 \
+                          OR SECRET <> 'GEZDGNBVGY3TQOJQ';"), 0);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM entries WHERE ID % 2 = 1 AND ISSUER <> 'Issuer' || (ID % 50);"), 0);
+  CHECK_INT(_get_int(db, "SELECT COUNT(*) FROM entries WHERE ID % 2 = 0 AND ISSUER <> '';"), 0);
+  CHECK_INT(_get_int(db, "SELECT COUNT(DISTINCT UID) FROM entries WHERE UID <> 0;"), rows);
+
+  sqlite3_close(db);
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_migrate_XXXXXX";
+  char path[sizeof(dir) + 16];
+  int last = 0;
+  const int rows = _fixture_rows(&last);
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/", dir);
+  setenv("OTP_DATA_PATH", path, 1);
+  snprintf(path, sizeof(path), "%s/otp.db", dir);
+
+  _make_fixture(path);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  CHECK_INT(db_init(), SQLITE_OK);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("test_migrate: %d rows migrated in %.1f ms\n", rows,
+         (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+
+  /* The list reads every row through the new statements, newest first */
+  GArray *list_rows = g_array_new(FALSE, FALSE, sizeof(db_row_s));
+  CHECK_INT(db_select_rows(list_rows), SQLITE_OK);
+  CHECK_INT(list_rows->len, rows);
+  if (list_rows->len > 0) CHECK_INT(g_array_index(list_rows, db_row_s, 0).id, last);
+  g_array_free(list_rows, TRUE);
+  db_close();
+
+  _check_schema(path, rows);
+
+  /* A migrated database opens as is and ids of the deleted newest rows
+   * aren't reused */
+  otp_info_s entry = { .type = TOTP };
+  otp_list_s list = { 0 };
+  CHECK_INT(db_init(), SQLITE_OK);
+  CHECK(otp_set_label(&entry, "New:entry", 9));
+  CHECK(otp_set_secret(&entry, "GEZDGNBVGY3TQOJQ"));
+  CHECK_INT(db_insert(&entry), SQLITE_OK);
+  CHECK_INT(db_select_all(&list), SQLITE_OK);
+  CHECK_INT(list.count, rows + 1);
+  if (list.count > 0) {
+    CHECK(strcmp(otp_label(&list.entries[0]), "New:entry") == 0);
+    CHECK_INT(list.entries[0].id, FIXTURE_ROWS + 1);
+  }
+  otp_list_clear(&list);
+  otp_info_clear(&entry);
+  db_close();
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  return test_result("test_migrate");
+}
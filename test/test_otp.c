@@ -0,0 +1,139 @@
+/* RFC 4226 and RFC 6238 test vectors against the OTP core */
+
+#include <string.h>
+#include "otp_core.h"
+#include "test.h"
+
+/* RFC 4226 appendix D */
+static const int hotp_codes[] = {
+  755224, 287082, 359152, 969429, 338314, 254676, 287922, 162583, 399871, 520489
+};
+
+/* RFC 6238 appendix B, eight digits for SHA1, SHA256 and SHA512 */
+static const struct {
+  time_t time;
+  int    codes[HASH_ALGO_COUNT];
+} totp_vectors[] = {
+  { 59,          { 94287082, 46119246, 90693936 } },
+  { 1111111109,  {  7081804, 68084774, 25091201 } },
+  { 1111111111,  { 14050471, 67062674, 99943326 } },
+  { 1234567890,  { 89005924, 91819424, 93441116 } },
+  { 2000000000,  { 69279037, 90698825, 38618901 } },
+  { 20000000000, { 65353130, 77737706, 47863826 } },
+};
+
+/* The seeds of RFC 6238 repeat "1234567890" to the digest length */
+static const char *totp_seeds[HASH_ALGO_COUNT] = {
+  "12345678901234567890",
+  "12345678901234567890123456789012",
+  "1234567890123456789012345678901234567890123456789012345678901234",
+};
+
+static void test_hotp(void) {
+  otp_info_s entry = { .type = HOTP };
+
+  CHECK(otp_set_key(&entry, (const uint8_t *) totp_seeds[HASH_SHA1], 20));
+  for (int i = 0; i < 10; i++) {
+    CHECK_INT(otp_hotp_code(&entry, i), hotp_codes[i]);
+  }
+
+  uint64_t next = 0;
+  CHECK(otp_hotp_verify(&entry, hotp_codes[7], 3, 10, &next));
+  CHECK_INT(next, 8);
+  CHECK(!otp_hotp_verify(&entry, hotp_codes[7], 0, 5, NULL));
+
+  otp_info_clear(&entry);
+}
+
+static void test_totp(void) {
+  for (int algo = 0; algo < HASH_ALGO_COUNT; algo++) {
+    otp_info_s entry = { .type = TOTP, .algorithm = algo, .digits = 8 };
+
+    CHECK(otp_set_key(&entry, (const uint8_t *) totp_seeds[algo], strlen(totp_seeds[algo])));
+    for (size_t i = 0; i < sizeof(totp_vectors) / sizeof(totp_vectors[0]); i++) {
+      int expires = 0;
+      CHECK_INT(otp_totp_code(&entry, totp_vectors[i].time, 0, &expires), totp_vectors[i].codes[algo]);
+      CHECK_INT(expires, 30 - totp_vectors[i].time % 30);
+    }
+
+    int offset = 0;
+    CHECK(otp_totp_verify(&entry, totp_vectors[1].codes[algo], totp_vectors[1].time + 30, 1, 1, &offset));
+    CHECK_INT(offset, -1);
+
+    otp_info_clear(&entry);
+  }
+}
+
+/* The batch path must give the same codes as one entry at a time */
+/* The key schedule follows a hash set after the key, as the parser may
+ * see the algorithm last */
+static void test_algorithm(void) {
+  otp_info_s entry = { .type = TOTP, .digits = 8 };
+
+  CHECK(otp_set_key(&entry, (const uint8_t *) totp_seeds[HASH_SHA256], strlen(totp_seeds[HASH_SHA256])));
+  otp_set_algorithm(&entry, HASH_SHA256);
+  CHECK_INT(otp_totp_code(&entry, totp_vectors[0].time, 0, NULL), totp_vectors[0].codes[HASH_SHA256]);
+
+  otp_set_algorithm(&entry, HASH_ALGO_COUNT);
+  CHECK_INT(entry.algorithm, HASH_SHA1);
+  otp_info_clear(&entry);
+}
+
+static void test_batch(void) {
+  enum { COUNT = 70 };
+  otp_info_s entries[COUNT] = { { 0 } };
+  otp_info_s *pointers[COUNT];
+  uint64_t values[COUNT];
+  int codes[COUNT];
+
+  for (int i = 0; i < COUNT; i++) {
+    entries[i].algorithm = i % 5 == 0 ? HASH_SHA256 : HASH_SHA1;
+    entries[i].digits = 6 + i % 3;
+    CHECK(otp_set_key(&entries[i], (const uint8_t *) totp_seeds[HASH_SHA512], 10 + i % 40));
+    pointers[i] = &entries[i];
+    values[i] = i * 7919;
+  }
+
+  otp_compute_codes(pointers, values, codes, COUNT);
+  for (int i = 0; i < COUNT; i++) {
+    CHECK_INT(codes[i], otp_hotp_code(&entries[i], values[i]));
+    otp_info_clear(&entries[i]);
+  }
+}
+
+static void test_secret(void) {
+  otp_info_s entry = { 0 };
+  char secret[OTP_SECRET_MAX_LEN + 1];
+
+  /* "12345678901234567890" in base32 */
+  CHECK(otp_set_secret(&entry, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"));
+  CHECK_INT(otp_hotp_code(&entry, 0), hotp_codes[0]);
+  CHECK(otp_get_secret(&entry, secret, sizeof(secret)) > 0);
+  CHECK(strncmp(secret, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ", 32) == 0);
+
+  CHECK(!otp_set_secret(&entry, "not base32!"));
+  CHECK(entry.key == NULL);
+}
+
+static void test_label(void) {
+  otp_info_s entry = { 0 };
+
+  CHECK(otp_set_label(&entry, "Example:alice@example.com", 25));
+  CHECK(strcmp(otp_issuer(&entry), "Example") == 0);
+  CHECK(strcmp(otp_account(&entry), "alice@example.com") == 0);
+
+  CHECK(otp_set_label(&entry, "bob", 3));
+  CHECK(entry.issuer == NULL);
+  CHECK(strcmp(otp_account(&entry), "bob") == 0);
+}
+
+int main(void) {
+  test_hotp();
+  test_totp();
+  test_algorithm();
+  test_batch();
+  test_secret();
+  test_label();
+
+  return test_result("test_otp");
+}
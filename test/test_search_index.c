@@ -0,0 +1,135 @@
+/* Search over the labels: word splitting, prefixes, queries of several
+ * words and the index kept up to date as entries are renamed and deleted. */
+
+#include <string.h>
+#include "search_index.h"
+#include "test.h"
+
+static search_index_s *search;
+static GArray *ids;
+
+/* Queries and compares the ids found with the -1 terminated expected ones */
+static void _expect(const char *query, const int *expected) {
+  guint count = 0;
+
+  search_index_query(search, query, ids);
+  while (expected[count] >= 0) count++;
+
+  CHECK_INT(ids->len, count);
+  for (guint i = 0; i < ids->len && i < count; i++) {
+    CHECK_INT(g_array_index(ids, int, i), expected[i]);
+  }
+}
+
+static void _add(int id, const char *label) {
+  CHECK(search_index_add(search, id, label, strlen(label)));
+}
+
+static void test_query(void) {
+  _add(3, "Example:alice@mail.example.com");
+  _add(1, "GitHub:bob");
+  _add(7, "Example:Bob@work.org");
+  _add(4, "bank");
+
+  _expect("example", (const int[]) { 3, 7, -1 });
+  _expect("EXAM", (const int[]) { 3, 7, -1 });
+  _expect("b", (const int[]) { 1, 4, 7, -1 });
+  _expect("bo", (const int[]) { 1, 7, -1 });
+  _expect("example bob", (const int[]) { 7, -1 });
+  _expect("bob example", (const int[]) { 7, -1 });
+  _expect("com", (const int[]) { 3, -1 });
+  _expect("example carol", (const int[]) { -1 });
+  _expect("", (const int[]) { -1 });
+  _expect(" :@ ", (const int[]) { -1 });
+}
+
+static void test_update(void) {
+  /* Renamed after the index was sorted by a query */
+  CHECK(search_index_update(search, 7, "Work:carol", 10));
+  _expect("bob", (const int[]) { 1, -1 });
+  _expect("carol", (const int[]) { 7, -1 });
+  _expect("example", (const int[]) { 3, -1 });
+
+  search_index_remove(search, 3);
+  _expect("example", (const int[]) { -1 });
+  _expect("com", (const int[]) { -1 });
+  _expect("b", (const int[]) { 1, 4, -1 });
+
+  /* Unknown ids are ignored, removed ids may come back */
+  search_index_remove(search, 42);
+  _add(3, "Example:dave");
+  _expect("example", (const int[]) { 3, -1 });
+  _expect("w", (const int[]) { 7, -1 });
+
+  search_index_remove(search, 1);
+  search_index_remove(search, 3);
+  search_index_remove(search, 4);
+  search_index_remove(search, 7);
+  _expect("b", (const int[]) { -1 });
+}
+
+#define MERGE_LABELS 300
+
+/* Words of a label as the index splits them, a match for word prefix */
+static gboolean _has_word(const char *label, const char *prefix) {
+  const size_t length = strlen(prefix);
+
+  for (const char *p = label; *p; p++) {
+    const gboolean start = p == label || !g_ascii_isalnum(p[-1]);
+    if (start && g_ascii_strncasecmp(p, prefix, length) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+/* Renames and removes between queries, which merge the words added since
+ * the last query into the sorted ones. Every query is checked against a
+ * scan of the labels. */
+static void test_merge(void) {
+  static const char *prefixes[] = { "a", "ab", "b", "c", "x1", "x" };
+  char labels[MERGE_LABELS + 1][32] = { { 0 } };
+  uint32_t seed = 1;
+
+  search_index_free(search);
+  search = search_index_new();
+
+  for (int round = 0; round < 2000; round++) {
+    seed = seed * 1103515245 + 12345;
+    const int id = 1 + (seed >> 8) % MERGE_LABELS;
+
+    if ((seed >> 4) % 4 == 0) {
+      search_index_remove(search, id);
+      labels[id][0] = '\0';
+    } else {
+      snprintf(labels[id], sizeof(labels[id]), "%c%c:x%u", 'a' + (seed >> 12) % 3, 'a' + (seed >> 16) % 3,
+               (seed >> 20) % 20);
+      CHECK(search_index_update(search, id, labels[id], strlen(labels[id])));
+    }
+
+    if (round % 7 != 0) continue;
+
+    const char *prefix = prefixes[round % (sizeof(prefixes) / sizeof(prefixes[0]))];
+    guint expected = 0;
+
+    search_index_query(search, prefix, ids);
+    for (int i = 1; i <= MERGE_LABELS; i++) {
+      if (labels[i][0] == '\0' || !_has_word(labels[i], prefix)) continue;
+      CHECK(expected < ids->len && g_array_index(ids, int, expected) == i);
+      expected++;
+    }
+    CHECK_INT(ids->len, expected);
+  }
+}
+
+int main(void) {
+  search = search_index_new();
+  ids = g_array_new(FALSE, FALSE, sizeof(int));
+
+  test_query();
+  test_update();
+  test_merge();
+
+  g_array_free(ids, TRUE);
+  search_index_free(search);
+
+  return test_result("test_search_index");
+}
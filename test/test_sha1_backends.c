@@ -0,0 +1,123 @@
+/* Every SHA1 backend compiled in and supported by the CPU is forced with
+ * sha1_backend_select() and checked against the FIPS 180 and RFC 2202
+ * vectors and against the generic backend. Unsupported ones are skipped. */
+
+#include <string.h>
+#include "util/hmac.h"
+#include "util/sha1.h"
+#include "otp_core.h"
+#include "test.h"
+
+static const char *backends[] = { "generic", "ssse3", "sha-ni", "armv8" };
+
+/* FIPS 180-2 appendix A and the empty message */
+static const struct {
+  const char *message;
+  int        repeat;
+  const char *digest;
+} sha1_vectors[] = {
+  { "", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+  { "abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d" },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+    "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+  { "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", 10000,
+    "34aa973cd4c4daa4f61eeb2bdbad27316534016f" },
+};
+
+/* RFC 2202 section 3, test cases 2 and 6 */
+static const struct {
+  const char *key;
+  int        key_length;
+  const char *data;
+  const char *mac;
+} hmac_vectors[] = {
+  { "Jefe", 4, "what do ya want for nothing?", "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79" },
+  { NULL, 80, "Test Using Larger Than Block-Size Key - Hash Key First",
+    "aa4ae5e15272d00e95705637ce8a3b55ed402112" },
+};
+
+/* RFC 4226 appendix D */
+static const int hotp_codes[] = {
+  755224, 287082, 359152, 969429, 338314, 254676, 287922, 162583, 399871, 520489
+};
+
+static void _hex(const uint8_t *bytes, int length, char *hex) {
+  for (int i = 0; i < length; i++) {
+    sprintf(hex + 2 * i, "%02x", bytes[i]);
+  }
+}
+
+static void test_vectors(void) {
+  uint8_t digest[SHA1_DIGEST_LENGTH];
+  char hex[2 * SHA1_DIGEST_LENGTH + 1];
+
+  for (size_t i = 0; i < sizeof(sha1_vectors) / sizeof(sha1_vectors[0]); i++) {
+    SHA1_INFO info;
+
+    sha1_init(&info);
+    for (int r = 0; r < sha1_vectors[i].repeat; r++) {
+      sha1_update(&info, (const uint8_t *) sha1_vectors[i].message, strlen(sha1_vectors[i].message));
+    }
+    sha1_final(&info, digest);
+    _hex(digest, sizeof(digest), hex);
+    CHECK(strcmp(hex, sha1_vectors[i].digest) == 0);
+  }
+
+  for (size_t i = 0; i < sizeof(hmac_vectors) / sizeof(hmac_vectors[0]); i++) {
+    uint8_t key[80];
+
+    if (hmac_vectors[i].key != NULL) memcpy(key, hmac_vectors[i].key, hmac_vectors[i].key_length);
+    else memset(key, 0xaa, sizeof(key));
+
+    hmac_sha1(key, hmac_vectors[i].key_length, (const uint8_t *) hmac_vectors[i].data,
+              strlen(hmac_vectors[i].data), digest, sizeof(digest));
+    _hex(digest, sizeof(digest), hex);
+    CHECK(strcmp(hex, hmac_vectors[i].mac) == 0);
+  }
+
+  /* The key schedule is built with the selected backend too */
+  otp_info_s entry = { .type = HOTP };
+  CHECK(otp_set_key(&entry, (const uint8_t *) "12345678901234567890", 20));
+  for (int i = 0; i < 10; i++) {
+    CHECK_INT(otp_hotp_code(&entry, i), hotp_codes[i]);
+  }
+  otp_info_clear(&entry);
+}
+
+/* Runs of up to 16 blocks from a chaining state which isn't the IV */
+static void test_blocks(void) {
+  uint8_t data[16 * SHA1_BLOCKSIZE];
+  uint32_t seed = 0x12345678;
+
+  for (size_t i = 0; i < sizeof(data); i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = seed >> 16;
+  }
+
+  for (size_t blocks = 1; blocks <= 16; blocks++) {
+    uint32_t expected[5] = { 0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210, 0xf0e1d2c3 };
+    uint32_t digest[5];
+
+    memcpy(digest, expected, sizeof(digest));
+    sha1_compress_generic(expected, data, blocks);
+    sha1_compress(digest, data, blocks);
+    CHECK(memcmp(digest, expected, sizeof(digest)) == 0);
+  }
+}
+
+int main(void) {
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if (!sha1_backend_select(backends[i])) {
+      printf("test_sha1_backends: %s not supported, skipped\n", backends[i]);
+      continue;
+    }
+    CHECK(strcmp(sha1_backend_name(), backends[i]) == 0);
+
+    const int failures = test_failures;
+    test_vectors();
+    test_blocks();
+    if (test_failures != failures) fprintf(stderr, "test_sha1_backends: %s failed\n", backends[i]);
+  }
+
+  return test_result("test_sha1_backends");
+}
@@ -0,0 +1,455 @@
+/* Two replicas diverge through independent edits, deletes, additions and
+ * counter bumps, then sync over a stand-in transport until their roots
+ * match. The phone is an in-memory replica, the watch is the entries table
+ * of a database in a temporary directory answered by sync_session.c, and
+ * the entries it receives are stored with db_sync_put() as imports are. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "database.h"
+#include "sync_session.h"
+#include "wire.h"
+#include "test.h"
+
+#define INITIAL_ENTRIES 60
+#define MUTATIONS       40
+#define LINK_SIZE       (1 << 18)
+#define MAX_ROUNDS      4
+/* Most entries a replica can end up with */
+#define REPLICA_MAX     (INITIAL_ENTRIES + 2 * MUTATIONS)
+
+typedef struct replica {
+  otp_list_s list;
+} replica_s;
+
+/* Frames in flight in one direction */
+typedef struct link {
+  uint8_t buf[LINK_SIZE];
+  size_t  len;
+} link_s;
+
+/* What a replica collects from the frames it receives, the watch keeps
+ * the entries in received until they're stored */
+typedef struct inbox {
+  replica_s     *replica;
+  otp_list_s    received;
+  sync_digest_s digests[REPLICA_MAX];
+  size_t        digest_count;
+  uint64_t      requests[REPLICA_MAX];
+  size_t        request_count;
+  uint32_t      root;
+  int           summaries;
+  int           entries;
+  int           counters;
+} inbox_s;
+
+static uint64_t rng_state;
+static char db_path[64];
+
+static uint64_t _rand(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static otp_info_s *_find(replica_s *r, uint64_t uid) {
+  for (int i = 0; i < r->list.count; i++) {
+    if (r->list.entries[i].uid == uid) return &r->list.entries[i];
+  }
+  return NULL;
+}
+
+/* Copies content and identity, the key slot of dst is its own */
+static void _copy_content(otp_info_s *dst, const otp_info_s *src) {
+  dst->type      = src->type;
+  dst->algorithm = src->algorithm;
+  dst->period    = src->period;
+  dst->digits    = src->digits;
+  dst->deleted   = src->deleted;
+  dst->rev       = src->rev;
+  dst->uid       = src->uid;
+  otp_set_label(dst, otp_label(src), otp_label_len(src));
+  if (src->key != NULL) {
+    otp_set_key(dst, src->key->bytes, src->key->len);
+  } else {
+    otp_info_clear(dst);
+  }
+}
+
+static void _add(replica_s *r, uint64_t uid) {
+  otp_info_s *entry = otp_list_add(&r->list);
+  char label[48];
+  uint8_t key[20];
+
+  entry->uid = uid;
+  entry->rev = 1;
+  entry->type = uid & 1 ? HOTP : TOTP;
+  entry->counter = uid % 100;
+
+  const int len = snprintf(label, sizeof(label), "Issuer:%016llx", (unsigned long long) uid);
+  otp_set_label(entry, label, len);
+  for (int k = 0; k < 20; k++) key[k] = uid >> (k % 8) * 8;
+  otp_set_key(entry, key, sizeof(key));
+}
+
+static void _mutate(replica_s *r) {
+  otp_info_s *entry = &r->list.entries[_rand() % r->list.count];
+
+  switch (_rand() % 4) {
+  case 0:
+    if (entry->deleted) break;
+    entry->period = entry->period == 60 ? 30 : 60;
+    entry->rev++;
+    break;
+  case 1:
+    entry->deleted = 1;
+    entry->rev++;
+    otp_info_clear(entry);
+    break;
+  case 2:
+    /* Half of the uids are negative as signed numbers */
+    _add(r, _rand());
+    break;
+  case 3:
+    entry->counter += 1 + _rand() % 5;
+    break;
+  }
+}
+
+/* Digests of a replica ascending by uid */
+static size_t _digests(replica_s *r, sync_digest_s *digests) {
+  for (int i = 0; i < r->list.count; i++) {
+    sync_digest(&r->list.entries[i], &digests[i]);
+  }
+  sync_sort(digests, r->list.count);
+  return r->list.count;
+}
+
+static uint32_t _root(replica_s *r) {
+  sync_digest_s digests[REPLICA_MAX];
+  return sync_root(digests, _digests(r, digests));
+}
+
+static int _signed_compare(const void *a, const void *b) {
+  const int64_t x = ((const sync_digest_s *) a)->uid;
+  const int64_t y = ((const sync_digest_s *) b)->uid;
+  return (x > y) - (x < y);
+}
+
+static void _send(link_s *link, wire_type_e type, const uint8_t *payload, size_t length) {
+  uint8_t *frame = link->buf + link->len;
+
+  CHECK(link->len + WIRE_HEADER_SIZE + length <= LINK_SIZE);
+  memcpy(frame + WIRE_HEADER_SIZE, payload, length);
+  wire_seal(frame, type, 1, length);
+  link->len += WIRE_HEADER_SIZE + length;
+}
+
+static void _forward(link_s *link, GByteArray *frames) {
+  CHECK(link->len + frames->len <= LINK_SIZE);
+  memcpy(link->buf + link->len, frames->data, frames->len);
+  link->len += frames->len;
+  g_byte_array_set_size(frames, 0);
+}
+
+static void _send_entries(link_s *link, replica_s *r, const uint64_t *uids, size_t count) {
+  static uint8_t payload[REPLICA_MAX * WIRE_RECORD_MAX];
+  size_t length = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    length += wire_encode_entry(payload + length, sizeof(payload) - length, _find(r, uids[i]));
+  }
+  _send(link, WIRE_ENTRIES, payload, length);
+}
+
+/* Merges an entry received from the other replica */
+static void _entry_cb(void *data, otp_info_s *entry, const char *error) {
+  inbox_s *in = data;
+
+  CHECK(error == NULL);
+  in->entries++;
+
+  if (in->replica == NULL) {
+    otp_info_s *copy = otp_list_add(&in->received);
+    _copy_content(copy, entry);
+    copy->counter = entry->counter;
+    return;
+  }
+
+  otp_info_s *local = _find(in->replica, entry->uid);
+  if (local == NULL) {
+    local = otp_list_add(&in->replica->list);
+    _copy_content(local, entry);
+    local->counter = entry->counter;
+    return;
+  }
+
+  sync_digest_s a, b;
+  sync_digest(entry, &a);
+  sync_digest(local, &b);
+  if (sync_newer(&a, &b)) _copy_content(local, entry);
+  if ((uint32_t) entry->counter > (uint32_t) local->counter) local->counter = entry->counter;
+}
+
+static void _record_cb(void *data, wire_type_e type, const uint8_t *record, size_t length) {
+  inbox_s *in = data;
+
+  switch (type) {
+  case WIRE_SYNC_DIGEST:
+    sync_decode_digest(record, &in->digests[in->digest_count++]);
+    break;
+  case WIRE_SYNC_REQUEST:
+    in->requests[in->request_count++] = sync_decode_request(record);
+    break;
+  case WIRE_SYNC_COUNTER: {
+    uint64_t uid;
+    uint32_t counter;
+    sync_decode_counter(record, &uid, &counter);
+    in->counters++;
+    otp_info_s *local = _find(in->replica, uid);
+    CHECK(local != NULL);
+    if (local != NULL && counter > (uint32_t) local->counter) local->counter = counter;
+    break;
+  }
+  case WIRE_SYNC_SUMMARY: {
+    uint32_t count;
+    sync_decode_summary(record, &in->root, &count);
+    in->summaries++;
+    break;
+  }
+  default:
+    CHECK(!"unexpected frame");
+  }
+}
+
+/* Delivers everything in flight in small chunks, as a socket would */
+static void _receive(link_s *link, inbox_s *in) {
+  wire_decoder_s decoder;
+  size_t offset = 0;
+
+  memset(in->digests, 0, sizeof(in->digests));
+  in->digest_count = in->request_count = 0;
+  in->summaries = in->entries = in->counters = 0;
+  wire_decoder_init(&decoder, _entry_cb, _record_cb, in);
+
+  while (offset < link->len) {
+    size_t chunk = 1 + _rand() % 97, consumed;
+    if (chunk > link->len - offset) chunk = link->len - offset;
+
+    const wire_decoder_status_e status = wire_decoder_feed(&decoder, link->buf + offset, chunk, &consumed);
+    CHECK(status != WIRE_DECODER_ERROR);
+    if (status == WIRE_DECODER_ERROR) break;
+    if (status == WIRE_DECODER_IDLE) CHECK(decoder.crc_ok);
+    offset += consumed;
+  }
+  link->len = 0;
+}
+
+/* Starts the watch over with an empty database */
+static void _watch_reset(void) {
+  static const char *suffixes[] = { "", "-wal", "-shm" };
+  char file[sizeof(db_path) + 16];
+
+  db_close();
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+    snprintf(file, sizeof(file), "%sotp.db%s", db_path, suffixes[i]);
+    unlink(file);
+  }
+  CHECK_INT(db_init(), SQLITE_OK);
+}
+
+/* Stores entries on the watch in one transaction, as an import does */
+static void _watch_store(otp_list_s *entries) {
+  CHECK_INT(db_begin(), SQLITE_OK);
+  for (int i = 0; i < entries->count; i++) {
+    CHECK_INT(db_sync_put(&entries->entries[i]), SQLITE_OK);
+  }
+  CHECK_INT(db_commit(), SQLITE_OK);
+  otp_list_clear(entries);
+}
+
+/* The entries of the watch, tombstones included */
+static void _watch_load(replica_s *watch) {
+  otp_list_clear(&watch->list);
+  CHECK_INT(db_select_sync(&watch->list), SQLITE_OK);
+}
+
+/* One sync initiated by the phone: digests, the watch's answer, and the
+ * entries the watch requested. Returns whether the watch saw no difference. */
+static int _sync_round(replica_s *phone, link_s *to_watch, link_s *to_phone) {
+  static inbox_s phone_in, watch_in;
+  sync_digest_s digests[REPLICA_MAX];
+  uint8_t payload[REPLICA_MAX * SYNC_DIGEST_SIZE];
+  GByteArray *reply = g_byte_array_new();
+
+  phone_in.replica = phone;
+
+  /* The phone sorts its uids as signed numbers */
+  const size_t count = _digests(phone, digests);
+  qsort(digests, count, sizeof(digests[0]), _signed_compare);
+  for (size_t i = 0; i < count; i++) sync_encode_digest(payload + i * SYNC_DIGEST_SIZE, &digests[i]);
+  _send(to_watch, WIRE_SYNC_DIGEST, payload, count * SYNC_DIGEST_SIZE);
+
+  _receive(to_watch, &watch_in);
+  CHECK_INT(watch_in.digest_count, count);
+  CHECK_INT(sync_session_digest(watch_in.digests, watch_in.digest_count, 1, reply), SQLITE_OK);
+  _forward(to_phone, reply);
+
+  _receive(to_phone, &phone_in);
+  const int in_sync = phone_in.summaries > 0;
+  /* A summary is only sent when nothing differs */
+  CHECK_INT(phone_in.summaries, in_sync);
+  if (in_sync) {
+    CHECK_INT(phone_in.entries + phone_in.request_count + phone_in.counters, 0);
+    CHECK_INT(phone_in.root, _root(phone));
+  }
+
+  if (phone_in.request_count > 0) {
+    _send_entries(to_watch, phone, phone_in.requests, phone_in.request_count);
+    _receive(to_watch, &watch_in);
+    CHECK_INT(watch_in.entries, phone_in.request_count);
+    _watch_store(&watch_in.received);
+  }
+
+  g_byte_array_free(reply, TRUE);
+  return in_sync;
+}
+
+/* The phone asks for some entries and the summary once both are in sync */
+static void _check_requests(replica_s *phone, link_s *to_phone) {
+  static inbox_s phone_in;
+  uint64_t uids[REPLICA_MAX];
+  GByteArray *reply = g_byte_array_new();
+  guint count = 0;
+
+  for (int i = 0; i < phone->list.count; i += 3) uids[count++] = phone->list.entries[i].uid;
+  /* Unknown uids are skipped */
+  uids[count++] = 0;
+
+  CHECK_INT(sync_session_request(uids, count, 2, reply), SQLITE_OK);
+  CHECK_INT(sync_session_summary(2, reply), SQLITE_OK);
+  _forward(to_phone, reply);
+
+  const uint32_t root = _root(phone);
+  phone_in.replica = phone;
+  _receive(to_phone, &phone_in);
+  CHECK_INT(phone_in.entries, count - 1);
+  CHECK_INT(phone_in.summaries, 1);
+  CHECK_INT(phone_in.root, root);
+  CHECK_INT(_root(phone), root);
+
+  g_byte_array_free(reply, TRUE);
+}
+
+/* Highest counter of uid on either replica, 0 if neither has it */
+static uint32_t _max_counter(replica_s *a, replica_s *b, uint64_t uid) {
+  const otp_info_s *x = _find(a, uid), *y = _find(b, uid);
+  uint32_t counter = 0;
+
+  if (x != NULL) counter = x->counter;
+  if (y != NULL && (uint32_t) y->counter > counter) counter = y->counter;
+  return counter;
+}
+
+static void test_converge(uint64_t seed) {
+  static link_s to_watch, to_phone;
+  replica_s phone = { { 0 } }, watch = { { 0 } };
+
+  rng_state = seed;
+  for (int i = 0; i < INITIAL_ENTRIES; i++) {
+    const uint64_t uid = _rand();
+    _add(&phone, uid);
+    _add(&watch, uid);
+  }
+  CHECK_INT(_root(&phone), _root(&watch));
+
+  for (int i = 0; i < MUTATIONS; i++) {
+    _mutate(&phone);
+    _mutate(&watch);
+  }
+  CHECK(_root(&phone) != _root(&watch));
+
+  _watch_reset();
+  _watch_store(&watch.list);
+  _watch_load(&watch);
+
+  /* Counters reached on either side before the sync */
+  uint64_t uids[2 * REPLICA_MAX];
+  uint32_t counters[2 * REPLICA_MAX];
+  size_t known = 0;
+  for (int i = 0; i < phone.list.count; i++) uids[known++] = phone.list.entries[i].uid;
+  for (int i = 0; i < watch.list.count; i++) uids[known++] = watch.list.entries[i].uid;
+  for (size_t i = 0; i < known; i++) counters[i] = _max_counter(&phone, &watch, uids[i]);
+
+  int rounds = 0;
+  while (!_sync_round(&phone, &to_watch, &to_phone) && ++rounds < MAX_ROUNDS);
+
+  /* One round carries every difference, the second only confirms it */
+  CHECK_INT(rounds, 1);
+  _watch_load(&watch);
+  CHECK_INT(_root(&phone), _root(&watch));
+  CHECK_INT(phone.list.count, watch.list.count);
+
+  for (size_t i = 0; i < known; i++) {
+    const otp_info_s *p = _find(&phone, uids[i]), *w = _find(&watch, uids[i]);
+    CHECK(p != NULL && w != NULL);
+    if (p == NULL || w == NULL) continue;
+    CHECK_INT((uint32_t) p->counter, counters[i]);
+    CHECK_INT((uint32_t) w->counter, counters[i]);
+  }
+
+  _check_requests(&phone, &to_phone);
+
+  otp_list_clear(&phone.list);
+  otp_list_clear(&watch.list);
+}
+
+/* Concurrent edits of the same revision settle on the same content */
+static void test_concurrent_edit(void) {
+  static link_s to_watch, to_phone;
+  replica_s phone = { { 0 } }, watch = { { 0 } };
+
+  rng_state = 42;
+  _add(&phone, 0xF000000000000001ULL);
+  _add(&watch, 0xF000000000000001ULL);
+
+  phone.list.entries[0].period = 60;
+  phone.list.entries[0].rev++;
+  watch.list.entries[0].digits = 8;
+  watch.list.entries[0].rev++;
+
+  _watch_reset();
+  _watch_store(&watch.list);
+
+  _sync_round(&phone, &to_watch, &to_phone);
+  CHECK(_sync_round(&phone, &to_watch, &to_phone));
+  _watch_load(&watch);
+  CHECK_INT(_root(&phone), _root(&watch));
+  CHECK_INT(phone.list.entries[0].period, watch.list.entries[0].period);
+  CHECK_INT(phone.list.entries[0].digits, watch.list.entries[0].digits);
+
+  otp_list_clear(&phone.list);
+  otp_list_clear(&watch.list);
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_sync_XXXXXX";
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(db_path, sizeof(db_path), "%s/", dir);
+  setenv("OTP_DATA_PATH", db_path, 1);
+
+  for (uint64_t seed = 1; seed <= 50; seed++) {
+    test_converge(seed * 0x9E3779B97F4A7C15ULL);
+  }
+  test_concurrent_edit();
+  db_close();
+
+  char command[64];
+  snprintf(command, sizeof(command), "rm -rf %s", dir);
+  if (system(command) != 0) return 1;
+
+  return test_result("test_sync");
+}
@@ -0,0 +1,280 @@
+/* The unix SOCK_SEQPACKET transport driven by a poll loop standing in for
+ * the Ecore main loop. A client connected to its socket sends framed
+ * messages: message boundaries, order, truncation of oversized messages,
+ * the read batch per wakeup, replies, replaced and closed clients. Ends
+ * with a pipelined run reporting messages per second. */
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <Ecore.h>
+#include "transport.h"
+#include "test.h"
+
+/* Of transport_unix.c */
+#define UNIX_MESSAGE_MAX 65536
+#define UNIX_READ_BATCH  64
+
+#define MAX_HANDLERS     8
+#define HEADER_SIZE      8
+#define PIPELINE_WINDOW  64
+#define PIPELINE_TOTAL   (1600 * PIPELINE_WINDOW)
+
+struct _Ecore_Fd_Handler {
+  int         fd;
+  Ecore_Fd_Cb func;
+  void        *data;
+  gboolean    deleted;
+};
+
+static Ecore_Fd_Handler *handlers[MAX_HANDLERS];
+static int handler_count = 0;
+
+Ecore_Fd_Handler *ecore_main_fd_handler_add(int fd, Ecore_Fd_Handler_Flags flags, Ecore_Fd_Cb func,
+                                            const void *data, Ecore_Fd_Cb buf_func, const void *buf_data) {
+  Ecore_Fd_Handler *handler = calloc(1, sizeof(Ecore_Fd_Handler));
+
+  if (handler_count == MAX_HANDLERS) abort();
+
+  handler->fd = fd;
+  handler->func = func;
+  handler->data = (void *) data;
+  handlers[handler_count++] = handler;
+
+  return handler;
+}
+
+void *ecore_main_fd_handler_del(Ecore_Fd_Handler *handler) {
+  /* Freed by the loop, the handler may be the one being called */
+  handler->deleted = TRUE;
+  return handler->data;
+}
+
+/* Calls the handlers of the readable fds once, returns how many were */
+static int _loop_once(int timeout) {
+  struct pollfd fds[MAX_HANDLERS];
+  Ecore_Fd_Handler *polled[MAX_HANDLERS];
+  int count = 0;
+
+  for (int i = 0; i < handler_count; i++) {
+    if (handlers[i]->deleted) continue;
+    fds[count].fd = handlers[i]->fd;
+    fds[count].events = POLLIN;
+    polled[count++] = handlers[i];
+  }
+
+  const int ready = poll(fds, count, timeout);
+  for (int i = 0; i < count && ready > 0; i++) {
+    if (fds[i].revents == 0 || polled[i]->deleted) continue;
+    if (!polled[i]->func(polled[i]->data, polled[i])) polled[i]->deleted = TRUE;
+  }
+
+  int kept = 0;
+  for (int i = 0; i < handler_count; i++) {
+    if (handlers[i]->deleted) free(handlers[i]);
+    else handlers[kept++] = handlers[i];
+  }
+  handler_count = kept;
+
+  return ready;
+}
+
+/* What the owner of the transport has seen */
+typedef struct events {
+  int      connected;
+  int      terminated;
+  int      received;
+  uint32_t next_seq;
+  size_t   last_length;
+  /* Replies with the sequence number of every message */
+  gboolean reply;
+} events_s;
+
+static uint8_t message[UNIX_MESSAGE_MAX + 4096];
+
+static void _put32(uint8_t *p, uint32_t value) {
+  memcpy(p, &value, sizeof(value));
+}
+
+static uint32_t _get32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint8_t _byte(uint32_t seq, size_t i) {
+  return (uint8_t) (seq * 31 + i * 7);
+}
+
+static void _connected(transport_s *transport, void *data) {
+  ((events_s *) data)->connected++;
+}
+
+static void _terminated(transport_s *transport, void *data) {
+  ((events_s *) data)->terminated++;
+}
+
+/* Checks the frame: sequence number, its own length, then the payload */
+static void _received(transport_s *transport, const char *buffer, unsigned int length, void *data) {
+  events_s *events = data;
+  const uint8_t *bytes = (const uint8_t *) buffer;
+
+  events->received++;
+  events->last_length = length;
+  CHECK(length >= HEADER_SIZE);
+  if (length < HEADER_SIZE) return;
+
+  const uint32_t seq = _get32(bytes);
+  const uint32_t sent = _get32(bytes + 4);
+  CHECK_INT(seq, events->next_seq);
+  events->next_seq = seq + 1;
+
+  /* Oversized messages are cut at the buffer */
+  CHECK_INT(length, sent < UNIX_MESSAGE_MAX ? sent : UNIX_MESSAGE_MAX);
+  for (unsigned int i = HEADER_SIZE; i < length; i++) {
+    if (bytes[i] != _byte(seq, i)) {
+      CHECK(bytes[i] == _byte(seq, i));
+      break;
+    }
+  }
+
+  if (events->reply) CHECK(transport_send(transport, &seq, sizeof(seq)));
+}
+
+static int _client_connect(const char *path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  strcpy(addr.sun_path, path);
+  CHECK(fd >= 0);
+  CHECK_INT(connect(fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+
+  return fd;
+}
+
+static gboolean _client_send(int fd, uint32_t seq, size_t length, int flags) {
+  _put32(message, seq);
+  _put32(message + 4, length);
+  for (size_t i = HEADER_SIZE; i < length; i++) message[i] = _byte(seq, i);
+
+  return send(fd, message, length, MSG_NOSIGNAL | flags) == (ssize_t) length;
+}
+
+static void _client_ack(int fd, uint32_t seq) {
+  uint32_t acked = 0;
+
+  CHECK_INT(recv(fd, &acked, sizeof(acked), 0), sizeof(acked));
+  CHECK_INT(acked, seq);
+}
+
+/* Runs the loop until *counter reaches target, fails after a second idle */
+static void _run_until(const int *counter, int target) {
+  while (*counter < target) {
+    if (_loop_once(1000) == 0) {
+      CHECK_INT(*counter, target);
+      return;
+    }
+  }
+}
+
+static void test_messages(transport_s *transport, events_s *events, int client) {
+  static const size_t lengths[] = { HEADER_SIZE, 9, 100, 4096, 65535, UNIX_MESSAGE_MAX, UNIX_MESSAGE_MAX + 1000 };
+
+  events->reply = TRUE;
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    const int received = events->received;
+
+    CHECK(_client_send(client, events->next_seq, lengths[i], 0));
+    _run_until(&events->received, received + 1);
+    CHECK_INT(events->last_length, lengths[i] < UNIX_MESSAGE_MAX ? lengths[i] : UNIX_MESSAGE_MAX);
+    _client_ack(client, events->next_seq - 1);
+  }
+}
+
+/* A wakeup reads at most a batch, the rest waits for the next one */
+static void test_batch(transport_s *transport, events_s *events, int client) {
+  const int received = events->received;
+  int sent = 0;
+
+  events->reply = FALSE;
+  while (sent < 2 * UNIX_READ_BATCH && _client_send(client, events->next_seq + sent, 16, MSG_DONTWAIT)) sent++;
+  CHECK(sent > UNIX_READ_BATCH);
+
+  _loop_once(1000);
+  CHECK_INT(events->received - received, UNIX_READ_BATCH);
+  _run_until(&events->received, received + sent);
+}
+
+static void test_pipeline(transport_s *transport, events_s *events, int client) {
+  const int received = events->received;
+  struct timespec start, end;
+
+  events->reply = TRUE;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int done = 0; done < PIPELINE_TOTAL; done += PIPELINE_WINDOW) {
+    const uint32_t seq = events->next_seq;
+
+    for (int i = 0; i < PIPELINE_WINDOW; i++) CHECK(_client_send(client, seq + i, 64, 0));
+    _run_until(&events->received, received + done + PIPELINE_WINDOW);
+    for (int i = 0; i < PIPELINE_WINDOW; i++) _client_ack(client, seq + i);
+    if (test_failures) return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("test_transport_unix: %d messages of 64 bytes acked in %.1f ms, %.0f msgs/sec\n",
+         PIPELINE_TOTAL, seconds * 1e3, PIPELINE_TOTAL / seconds);
+}
+
+int main(void) {
+  char dir[] = "/tmp/otp_transport_XXXXXX";
+  char path[sizeof(dir) + 16];
+  events_s events = { 0 };
+  const transport_cbs_s cbs = {
+    .connected  = _connected,
+    .received   = _received,
+    .terminated = _terminated,
+  };
+
+  if (mkdtemp(dir) == NULL) return 1;
+  snprintf(path, sizeof(path), "%s/otp.sock", dir);
+
+  transport_s *transport = transport_unix_new(path, &cbs, &events);
+  CHECK(transport_start(transport));
+  CHECK(!transport_send(transport, "x", 1));
+
+  int client = _client_connect(path);
+  _run_until(&events.connected, 1);
+
+  test_messages(transport, &events, client);
+  test_batch(transport, &events, client);
+  test_pipeline(transport, &events, client);
+
+  /* A new client replaces the previous one, which is hung up on */
+  int replacement = _client_connect(path);
+  _run_until(&events.connected, 2);
+  CHECK_INT(events.terminated, 1);
+  CHECK_INT(recv(client, message, sizeof(message), 0), 0);
+  close(client);
+
+  events.next_seq = 0;
+  CHECK(_client_send(replacement, 0, 32, 0));
+  _run_until(&events.received, events.received + 1);
+  _client_ack(replacement, 0);
+
+  close(replacement);
+  _run_until(&events.terminated, 2);
+  CHECK(!transport_send(transport, "x", 1));
+
+  transport_free(transport);
+  _loop_once(0);
+  CHECK_INT(handler_count, 0);
+  CHECK(access(path, F_OK) != 0);
+  rmdir(dir);
+
+  return test_result("test_transport_unix");
+}
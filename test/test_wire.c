@@ -0,0 +1,227 @@
+/* Binary frames encoded and decoded back through a socket pair, read in
+ * chunks of every size as they arrive from the companion app */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "wire.h"
+#include "test.h"
+
+#define ENTRY_COUNT 40
+
+typedef struct loopback {
+  otp_info_s entries[ENTRY_COUNT];
+  int        decoded;
+  int        rejected;
+  int        records;
+  uint8_t    record[32];
+} loopback_s;
+
+static void _entry_cb(void *data, otp_info_s *entry, const char *error) {
+  loopback_s *lb = data;
+
+  if (error != NULL || lb->decoded >= ENTRY_COUNT) {
+    lb->rejected++;
+    return;
+  }
+
+  const otp_info_s *sent = &lb->entries[lb->decoded++];
+  CHECK_INT(entry->type, sent->type);
+  CHECK_INT(entry->algorithm, sent->algorithm);
+  CHECK_INT(entry->digits, sent->digits);
+  CHECK_INT(entry->period, sent->period);
+  CHECK_INT(entry->counter, sent->counter);
+  CHECK_INT(entry->deleted, sent->deleted);
+  CHECK(entry->uid == sent->uid);
+  CHECK_INT(entry->rev, sent->rev);
+  CHECK(strcmp(otp_label(entry), otp_label(sent)) == 0);
+  if (!sent->deleted) {
+    CHECK(entry->key != NULL && entry->key->len == sent->key->len &&
+          memcmp(entry->key->bytes, sent->key->bytes, sent->key->len) == 0);
+  }
+}
+
+/* Counts the entries of a frame whose content isn't checked */
+static void _count_cb(void *data, otp_info_s *entry, const char *error) {
+  loopback_s *lb = data;
+
+  if (error != NULL) lb->rejected++;
+  else lb->decoded++;
+}
+
+static void _record_cb(void *data, wire_type_e type, const uint8_t *record, size_t length) {
+  loopback_s *lb = data;
+
+  CHECK_INT(type, WIRE_SYNC_SUMMARY);
+  CHECK(length <= sizeof(lb->record));
+  memcpy(lb->record, record, length);
+  lb->records++;
+}
+
+static void _make_entries(loopback_s *lb) {
+  for (int i = 0; i < ENTRY_COUNT; i++) {
+    otp_info_s *entry = &lb->entries[i];
+    char label[64];
+    uint8_t key[64];
+
+    entry->type = i % 3 == 0 ? HOTP : TOTP;
+    entry->algorithm = i % HASH_ALGO_COUNT;
+    entry->digits = i % 4 == 0 ? 0 : 6 + i % 5;
+    entry->period = i % 2 ? 30 : 60;
+    entry->counter = i * 1000003;
+    entry->uid = 0x8000000000000000ULL | (uint64_t) i * 0x9E3779B97F4A7C15ULL;
+    entry->rev = i + 1;
+    entry->deleted = i % 7 == 6;
+
+    const int len = snprintf(label, sizeof(label), "Issuer %d:user%d@example.com", i, i);
+    otp_set_label(entry, label, len);
+    if (!entry->deleted) {
+      for (int k = 0; k < 64; k++) key[k] = i * 31 + k;
+      otp_set_key(entry, key, 10 + i % 54);
+    }
+  }
+}
+
+/* Seals the entries into one frame, returns its size */
+static size_t _encode(const loopback_s *lb, uint8_t *frame, size_t size) {
+  size_t length = 0;
+
+  for (int i = 0; i < ENTRY_COUNT; i++) {
+    const size_t n = wire_encode_entry(frame + WIRE_HEADER_SIZE + length,
+                                       size - WIRE_HEADER_SIZE - length, &lb->entries[i]);
+    CHECK(n > 0);
+    length += n;
+  }
+  wire_seal(frame, WIRE_ENTRIES, 7, length);
+
+  return WIRE_HEADER_SIZE + length;
+}
+
+/* Sends frame through a socket pair and feeds what arrives in chunks of
+ * chunk bytes. Returns the final decoder status. */
+static wire_decoder_status_e _loopback(wire_decoder_s *decoder, const uint8_t *frame, size_t length, size_t chunk) {
+  wire_decoder_status_e status = WIRE_DECODER_MORE;
+  uint8_t buf[256];
+  size_t received = 0;
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    CHECK(!"socketpair");
+    return WIRE_DECODER_ERROR;
+  }
+
+  for (size_t sent = 0; sent < length; ) {
+    const ssize_t n = write(fds[0], frame + sent, length - sent);
+    if (n <= 0) break;
+    sent += n;
+
+    /* Drain what is there so the writer never blocks */
+    while (received < sent) {
+      const ssize_t r = read(fds[1], buf, chunk < sizeof(buf) ? chunk : sizeof(buf));
+      if (r <= 0) break;
+      received += r;
+
+      size_t offset = 0;
+      while (offset < (size_t) r) {
+        size_t consumed;
+        status = wire_decoder_feed(decoder, buf + offset, r - offset, &consumed);
+        offset += consumed;
+        if (status != WIRE_DECODER_MORE) break;
+      }
+    }
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+  CHECK_INT(received, length);
+
+  return status;
+}
+
+static void test_entries(void) {
+  static uint8_t frame[ENTRY_COUNT * WIRE_RECORD_MAX];
+  static loopback_s lb;
+  wire_decoder_s decoder;
+
+  _make_entries(&lb);
+  const size_t length = _encode(&lb, frame, sizeof(frame));
+
+  wire_header_s header;
+  CHECK(wire_read_header(frame, &header));
+  CHECK_INT(header.version, WIRE_VERSION);
+  CHECK_INT(header.seq, 7);
+  CHECK_INT(header.length, length - WIRE_HEADER_SIZE);
+
+  for (size_t chunk = 1; chunk <= 200; chunk += chunk < 24 ? 1 : 37) {
+    lb.decoded = lb.rejected = 0;
+    wire_decoder_init(&decoder, _entry_cb, NULL, &lb);
+
+    CHECK_INT(_loopback(&decoder, frame, length, chunk), WIRE_DECODER_IDLE);
+    CHECK(decoder.crc_ok);
+    CHECK_INT(lb.decoded, ENTRY_COUNT);
+    CHECK_INT(lb.rejected, 0);
+  }
+
+  /* A flipped bit in a label still decodes but fails the CRC */
+  frame[WIRE_HEADER_SIZE + 30] ^= 0x10;
+  lb.decoded = lb.rejected = 0;
+  wire_decoder_init(&decoder, _count_cb, NULL, &lb);
+  CHECK_INT(_loopback(&decoder, frame, length, 64), WIRE_DECODER_IDLE);
+  CHECK(!decoder.crc_ok);
+  CHECK_INT(lb.decoded, ENTRY_COUNT);
+  frame[WIRE_HEADER_SIZE + 30] ^= 0x10;
+
+  for (int i = 0; i < ENTRY_COUNT; i++) otp_info_clear(&lb.entries[i]);
+}
+
+static void test_ack(void) {
+  uint8_t frame[WIRE_HEADER_SIZE + 8 + 4];
+  const uint8_t status[4] = { WIRE_STATUS_OK, WIRE_STATUS_INVALID, WIRE_STATUS_OK, WIRE_STATUS_DATABASE };
+  const wire_header_s request = { .version = 1, .type = WIRE_ENTRIES, .seq = 513 };
+  wire_header_s header;
+
+  CHECK_INT(wire_encode_ack(frame, sizeof(frame) - 1, &request, status, 4), 0);
+  CHECK_INT(wire_encode_ack(frame, sizeof(frame), &request, status, 4), sizeof(frame));
+  CHECK(wire_read_header(frame, &header));
+  CHECK_INT(header.version, 1);
+  CHECK_INT(header.type, WIRE_ACK);
+  CHECK_INT(header.seq, 513);
+  CHECK_INT(header.crc, wire_crc32(0, frame + WIRE_HEADER_SIZE, header.length));
+  /* Count of records then the stored ones */
+  CHECK_INT(frame[WIRE_HEADER_SIZE + 3], 4);
+  CHECK_INT(frame[WIRE_HEADER_SIZE + 7], 2);
+  CHECK(memcmp(frame + WIRE_HEADER_SIZE + 8, status, 4) == 0);
+}
+
+static void test_records(void) {
+  uint8_t frame[WIRE_HEADER_SIZE + 8];
+  static loopback_s lb;
+  wire_decoder_s decoder;
+
+  for (int i = 0; i < 8; i++) frame[WIRE_HEADER_SIZE + i] = 0xA0 + i;
+  wire_seal(frame, WIRE_SYNC_SUMMARY, 1, 8);
+
+  /* Sync frames need a record callback */
+  wire_decoder_init(&decoder, _entry_cb, NULL, &lb);
+  CHECK_INT(_loopback(&decoder, frame, sizeof(frame), 5), WIRE_DECODER_ERROR);
+
+  wire_decoder_init(&decoder, _entry_cb, _record_cb, &lb);
+  CHECK_INT(_loopback(&decoder, frame, sizeof(frame), 3), WIRE_DECODER_IDLE);
+  CHECK(decoder.crc_ok);
+  CHECK_INT(lb.records, 1);
+  CHECK(memcmp(lb.record, frame + WIRE_HEADER_SIZE, 8) == 0);
+
+  /* A bad magic is an error until the decoder is reset */
+  frame[0] = 'X';
+  wire_decoder_init(&decoder, _entry_cb, _record_cb, &lb);
+  CHECK_INT(_loopback(&decoder, frame, sizeof(frame), 14), WIRE_DECODER_ERROR);
+}
+
+int main(void) {
+  test_entries();
+  test_ack();
+  test_records();
+
+  return test_result("test_wire");
+}